@@ -0,0 +1,156 @@
+//
+//  IVTMovAdmissionTests.mm
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#include "IVTMovAdmission.h"
+#include <vector>
+
+using namespace IVT;
+
+@interface IVTMovAdmissionTests : XCTestCase
+@end
+
+@implementation IVTMovAdmissionTests {
+    MovAdmissionController controller;
+    std::vector<MovAdmissionDecision> observed;
+}
+
+- (void)setUp {
+    controller.policy = MovAdmissionPolicy();
+    controller.reset();
+    observed.clear();
+    auto decisions      = &observed;
+    controller.observer = [decisions](const MovAdmissionDecision &decision) { decisions->push_back(decision); };
+}
+
+static MovAdmissionSignals signalsOf(uint32_t pendingFrames, uint32_t queuedWrites) {
+    MovAdmissionSignals signals;
+    signals.pendingFrames = pendingFrames;
+    signals.queuedWrites  = queuedWrites;
+    return signals;
+}
+
+- (void)testAdmitsWithoutPressure {
+    for (MovTick time = 0; time < 10; ++time) {
+        auto decision = controller.admit(time, false, signalsOf(1, 4), time * 1000);
+        XCTAssertEqual(decision.action, MovAdmissionDecision::ADMIT);
+        XCTAssertEqual(decision.reason, MovAdmissionDecision::NO_PRESSURE);
+        controller.submitted(time, time * 1000);
+        controller.completed(time, time * 1000 + 500);
+    }
+    auto stats = controller.stats();
+    XCTAssertEqual(stats.admitted, 10u);
+    XCTAssertEqual(stats.admittedUnderPressure, 0u);
+    XCTAssertEqual(stats.latencyUs, 500u);
+    XCTAssertTrue(observed.empty());
+}
+
+- (void)testPendingFramesRefuse {
+    auto decision = controller.admit(0, false, signalsOf(controller.policy.maxPendingFrames, 0), 0);
+    XCTAssertEqual(decision.action, MovAdmissionDecision::COALESCE);
+    XCTAssertEqual(decision.reason, MovAdmissionDecision::PENDING_FRAMES);
+    XCTAssertEqual(controller.admit(1, false, signalsOf(controller.policy.maxPendingFrames - 1, 0), 0).action,
+                   MovAdmissionDecision::ADMIT);
+
+    controller.policy.maxPendingFrames = 0;
+    XCTAssertEqual(controller.admit(2, false, signalsOf(100, 0), 0).action, MovAdmissionDecision::ADMIT);
+    XCTAssertEqual(controller.stats().coalesced, 1u);
+    XCTAssertEqual(observed.size(), 1u);
+}
+
+- (void)testQueuedWritesRefuse {
+    controller.policy.refusal = MovAdmissionPolicy::DROP;
+    auto decision = controller.admit(0, false, signalsOf(0, controller.policy.maxQueuedWrites), 0);
+    XCTAssertEqual(decision.action, MovAdmissionDecision::DROP);
+    XCTAssertEqual(decision.reason, MovAdmissionDecision::QUEUED_WRITES);
+    XCTAssertEqual(decision.signals.queuedWrites, controller.policy.maxQueuedWrites);
+    XCTAssertEqual(controller.stats().dropped, 1u);
+    XCTAssertEqual(controller.stats().coalesced, 0u);
+}
+
+- (void)testSmoothedLatencyRefuses {
+    controller.policy.maxLatencyUs = 10000;
+    uint64_t now = 0;
+    for (MovTick time = 0; time < 32; ++time, now += 33000) {
+        controller.submitted(time, now);
+        controller.completed(time, now + 20000);
+    }
+    XCTAssertGreaterThanOrEqual(controller.stats().latencyUs, controller.policy.maxLatencyUs);
+    auto decision = controller.admit(32, false, signalsOf(0, 0), now);
+    XCTAssertEqual(decision.action, MovAdmissionDecision::COALESCE);
+    XCTAssertEqual(decision.reason, MovAdmissionDecision::LATENCY);
+    XCTAssertGreaterThanOrEqual(decision.latencyUs, controller.policy.maxLatencyUs);
+}
+
+- (void)testOutstandingFrameCountsAsLatency {
+    controller.policy.maxLatencyUs = 10000;
+    controller.submitted(0, 0);
+    XCTAssertEqual(controller.admit(1, false, signalsOf(0, 0), 5000).action, MovAdmissionDecision::ADMIT);
+    // the encoder stalled on frame 0, the stall shows before the frame comes back
+    auto decision = controller.admit(2, false, signalsOf(0, 0), 15000);
+    XCTAssertEqual(decision.reason, MovAdmissionDecision::LATENCY);
+    XCTAssertEqual(decision.latencyUs, 15000u);
+
+    controller.completed(0, 16000);
+    controller.submitted(3, 16000);
+    controller.completed(3, 17000);
+    XCTAssertEqual(controller.admit(4, false, signalsOf(0, 0), 17000).action, MovAdmissionDecision::COALESCE);
+    controller.reset();
+    XCTAssertEqual(controller.admit(5, false, signalsOf(0, 0), 17000).action, MovAdmissionDecision::ADMIT);
+}
+
+- (void)testFramesDroppedByEncoderLeaveOutstanding {
+    controller.policy.maxLatencyUs = 10000;
+    controller.submitted(0, 0);
+    controller.submitted(1, 1000);
+    controller.submitted(2, 2000);
+    // frames 0 and 1 never come back
+    controller.completed(2, 3000);
+    XCTAssertEqual(controller.stats().latencyUs, 1000u);
+    XCTAssertEqual(controller.admit(3, false, signalsOf(0, 0), 50000).action, MovAdmissionDecision::ADMIT);
+}
+
+- (void)testRefusalLimitAdmits {
+    controller.policy.maxConsecutiveRefusals = 3;
+    auto pressure = signalsOf(controller.policy.maxPendingFrames, 0);
+    MovTick time = 0;
+    for (int round = 0; round < 2; ++round) {
+        for (uint32_t i = 0; i < controller.policy.maxConsecutiveRefusals; ++i) {
+            XCTAssertEqual(controller.admit(time++, false, pressure, 0).action, MovAdmissionDecision::COALESCE);
+        }
+        auto decision = controller.admit(time++, false, pressure, 0);
+        XCTAssertEqual(decision.action, MovAdmissionDecision::ADMIT);
+        XCTAssertEqual(decision.reason, MovAdmissionDecision::REFUSAL_LIMIT);
+    }
+    auto stats = controller.stats();
+    XCTAssertEqual(stats.coalesced, 6u);
+    XCTAssertEqual(stats.admitted, 2u);
+    XCTAssertEqual(stats.admittedUnderPressure, 2u);
+    XCTAssertEqual(observed.size(), 8u);
+}
+
+- (void)testForcedKeyFramesNeverRefused {
+    controller.policy.refusal = MovAdmissionPolicy::DROP;
+    controller.policy.maxLatencyUs = 1000;
+    controller.submitted(0, 0);
+    auto pressure = signalsOf(100, 100);
+    for (MovTick time = 1; time < 20; ++time) {
+        auto decision = controller.admit(time, true, pressure, time * 100000);
+        XCTAssertEqual(decision.action, MovAdmissionDecision::ADMIT);
+        XCTAssertEqual(decision.reason, MovAdmissionDecision::FORCED_KEY_FRAME);
+    }
+    // a forced key frame resets the run of refusals
+    controller.policy.maxConsecutiveRefusals = 2;
+    XCTAssertEqual(controller.admit(20, false, pressure, 0).action, MovAdmissionDecision::DROP);
+    XCTAssertEqual(controller.admit(21, true, pressure, 0).action, MovAdmissionDecision::ADMIT);
+    XCTAssertEqual(controller.admit(22, false, pressure, 0).action, MovAdmissionDecision::DROP);
+    XCTAssertEqual(controller.admit(23, false, pressure, 0).action, MovAdmissionDecision::DROP);
+    XCTAssertEqual(controller.admit(24, false, pressure, 0).reason, MovAdmissionDecision::REFUSAL_LIMIT);
+    XCTAssertEqual(controller.stats().dropped, 3u);
+}
+
+@end
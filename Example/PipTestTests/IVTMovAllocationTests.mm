@@ -0,0 +1,158 @@
+//
+//  IVTMovAllocationTests.mm
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#include "IVTMovMuxer.h"
+#include <new>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+using namespace IVT;
+
+// the muxer sources are built into this bundle, so their allocations come here rather than to the host app
+static thread_local bool sCounting;
+static thread_local size_t sAllocations;
+
+void *operator new(size_t size) {
+    if (sCounting) {
+        ++sAllocations;
+    }
+    if (void *ptr = malloc(size ?: 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    if (sCounting) {
+        ++sAllocations;
+    }
+    return malloc(size ?: 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &tag) noexcept {
+    return operator new(size, tag);
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    free(ptr);
+}
+
+/// allocations of body on the calling thread
+template <class Body>
+static size_t countAllocations(Body &&body) {
+    sAllocations = 0;
+    sCounting    = true;
+    body();
+    sCounting = false;
+    return sAllocations;
+}
+
+static const int kFrameRate = 30;
+static const int kKeyFrameInterval = 20;
+static const double kPlannedDuration = 20;
+static const size_t kFrameSize = 2000;
+
+/// sets the expected bitrate like MovFile, it sizes the planned memory cache
+class TestMuxer : public MovMuxer {
+public:
+    TestMuxer(const std::string &outputPath) : MovMuxer(kFrameRate, kFrameRate, 640, 360, outputPath.c_str(), kKeyFrameInterval) {
+        bytesPerSecond = kFrameSize * kFrameRate;
+    }
+};
+
+@interface IVTMovAllocationTests : XCTestCase
+@end
+
+@implementation IVTMovAllocationTests {
+    std::string _outputPath;
+    std::vector<uint8_t> _frame;
+}
+
+- (void)setUp {
+    _outputPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"allocation.mov"].fileSystemRepresentation;
+    // one length prefixed NAL unit, the type byte is set per frame
+    _frame.assign(kFrameSize, 0x5a);
+    uint32_t length = (uint32_t)_frame.size() - 4;
+    _frame[0] = length >> 24;
+    _frame[1] = length >> 16;
+    _frame[2] = length >> 8;
+    _frame[3] = length;
+}
+
+- (int)ingest:(MovMuxer &)muxer frame:(int)frame {
+    _frame[4] = frame % kKeyFrameInterval == 0 ? 0x65 : 0x41;
+    EncodedSample sample;
+    sample.data = _frame.data();
+    sample.size = _frame.size();
+    sample.pts  = muxer.timeBase.ticksForFrames(frame);
+    return muxer.ingest(sample);
+}
+
+- (size_t)allocationsAfterFirstFrame:(bool)planned cacheToMemory:(bool)cacheToMemory {
+    TestMuxer muxer(_outputPath);
+    muxer.cacheFileToMemory = cacheToMemory;
+    muxer.expectedDuration  = kPlannedDuration;
+    if (planned) {
+        muxer.planCapacity(kPlannedDuration);
+    }
+    XCTAssertEqual([self ingest:muxer frame:0], 0);
+    int frames = (int)(kPlannedDuration * kFrameRate);
+    return countAllocations([&] {
+        for (int frame = 1; frame < frames; ++frame) {
+            XCTAssertEqual([self ingest:muxer frame:frame], 0);
+        }
+    });
+}
+
+- (void)testPlannedIngestDoesNotAllocate {
+    XCTAssertEqual([self allocationsAfterFirstFrame:true cacheToMemory:true], 0u);
+    XCTAssertEqual([self allocationsAfterFirstFrame:true cacheToMemory:false], 0u);
+}
+
+/// the counter sees the muxer, the tables of an unplanned segment grow as it is ingested
+- (void)testUnplannedIngestAllocates {
+    XCTAssertGreaterThan([self allocationsAfterFirstFrame:false cacheToMemory:true], 0u);
+}
+
+/// the sync flags of batches are reserved for a second of frames, a longer batch grows them once
+- (void)testBatchSyncsGrowOnce {
+    TestMuxer muxer(_outputPath);
+    muxer.cacheFileToMemory = true;
+    muxer.planCapacity(kPlannedDuration);
+    const size_t batchCount = kFrameRate * 2;
+    std::vector<uint8_t> data;
+    std::vector<size_t> sizes(batchCount, _frame.size());
+    for (size_t i = 0; i < batchCount; ++i) {
+        _frame[4] = i % kKeyFrameInterval == 0 ? 0x65 : 0x41;
+        data.insert(data.end(), _frame.begin(), _frame.end());
+    }
+    EncodedBatch batch;
+    batch.data        = data.data();
+    batch.count       = batchCount;
+    batch.sampleSizes = sizes.data();
+    batch.firstPts    = 0;
+    XCTAssertEqual(muxer.ingestBatch(batch), 0);
+    size_t allocations = countAllocations([&] {
+        for (int round = 1; round < 5; ++round) {
+            batch.firstPts = muxer.timeBase.ticksForFrames(round * (int)batchCount);
+            XCTAssertEqual(muxer.ingestBatch(batch), 0);
+        }
+    });
+    XCTAssertEqual(allocations, 0u);
+}
+
+@end
@@ -0,0 +1,170 @@
+//
+//  IVTMovSampleCacheTests.mm
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#include "IVTMovSample.h"
+#include "IVTMovSampleCache.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace IVT;
+
+typedef MovSampleCache<std::string> StringCache;
+
+static MovSampleKey keyOf(int32_t width, int32_t height, int32_t frameRate = 30) {
+    MovSampleKey key;
+    key.width     = width;
+    key.height    = height;
+    key.codecType = movFourCC("avc1");
+    key.profile   = 66;
+    key.frameRate = frameRate;
+    return key;
+}
+
+static StringCache::Ref payloadOf(size_t bytes) {
+    return std::make_shared<const std::string>(bytes, 'x');
+}
+
+@interface IVTMovSampleCacheTests : XCTestCase
+@end
+
+@implementation IVTMovSampleCacheTests
+
+- (void)testConcurrentMissesLoadOnce {
+    StringCache cache(8 << 20);
+    const MovSampleKey key = keyOf(640, 360);
+    const int threadCount  = 16;
+    std::atomic<int> loads { 0 };
+    std::atomic<int> started { 0 };
+    std::vector<StringCache::Ref> results(threadCount);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threadCount; ++i) {
+        threads.emplace_back([&, i] {
+            ++started;
+            while (started.load() < threadCount) {
+                std::this_thread::yield();
+            }
+            results[i] = cache.findOrLoad(key, [&](size_t &bytes) {
+                ++loads;
+                // long enough for every other thread to miss while the load is in flight
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                bytes = 1000;
+                return payloadOf(1000);
+            });
+        });
+    }
+    for (auto &&thread : threads) {
+        thread.join();
+    }
+    XCTAssertEqual(loads.load(), 1);
+    for (auto &&result : results) {
+        XCTAssertTrue(result != nullptr);
+        XCTAssertTrue(result == results[0]);
+    }
+    auto stats = cache.stats();
+    XCTAssertEqual(stats.loads, 1u);
+    XCTAssertEqual(stats.hits + stats.misses, (uint64_t)threadCount);
+    XCTAssertEqual(stats.entries, 1u);
+    XCTAssertEqual(stats.bytes, 1000u);
+}
+
+/// a load runs outside the shard lock, a miss of another key finds or loads while it is in flight
+- (void)testLoadsOfDifferentKeysOverlap {
+    StringCache cache(8 << 20, 1);
+    const MovSampleKey slow = keyOf(640, 360), fast = keyOf(1280, 720);
+    cache.insert(keyOf(320, 180), payloadOf(10), 10);
+    std::atomic<bool> slowLoading { false }, fastDone { false }, overlapped { false };
+    std::thread slowThread([&] {
+        cache.findOrLoad(slow, [&](size_t &bytes) {
+            slowLoading = true;
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            while (!fastDone && std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            overlapped = fastDone.load();
+            bytes      = 10;
+            return payloadOf(10);
+        });
+    });
+    while (!slowLoading) {
+        std::this_thread::yield();
+    }
+    XCTAssertTrue(cache.find(keyOf(320, 180)) != nullptr);
+    XCTAssertTrue(cache.findOrLoad(fast, [](size_t &bytes) {
+        bytes = 10;
+        return payloadOf(10);
+    }) != nullptr);
+    fastDone = true;
+    slowThread.join();
+    XCTAssertTrue(overlapped.load());
+    XCTAssertEqual(cache.stats().loads, 2u);
+}
+
+- (void)testEvictionStaysWithinBudget {
+    const size_t budget = 8 * 1000;
+    StringCache cache(budget);
+    for (int i = 0; i < 400; ++i) {
+        cache.insert(keyOf(16 * (i + 1), 9 * (i + 1)), payloadOf(300), 300);
+        XCTAssertLessThanOrEqual(cache.stats().bytes, budget);
+    }
+    auto stats = cache.stats();
+    XCTAssertGreaterThan(stats.evictions, 0u);
+    XCTAssertEqual(stats.bytes, stats.entries * 300);
+    XCTAssertEqual(stats.entries + stats.evictions, 400u);
+}
+
+- (void)testEvictsLeastRecentlyUsed {
+    StringCache cache(1000, 1);
+    const MovSampleKey a = keyOf(1, 1), b = keyOf(2, 2), c = keyOf(3, 3), d = keyOf(4, 4);
+    cache.insert(a, payloadOf(300), 300);
+    cache.insert(b, payloadOf(300), 300);
+    cache.insert(c, payloadOf(300), 300);
+    XCTAssertTrue(cache.find(a) != nullptr);
+    cache.insert(d, payloadOf(300), 300);
+    XCTAssertTrue(cache.find(a) != nullptr);
+    XCTAssertTrue(cache.find(b) == nullptr);
+    XCTAssertTrue(cache.find(c) != nullptr);
+    XCTAssertTrue(cache.find(d) != nullptr);
+    XCTAssertEqual(cache.stats().evictions, 1u);
+}
+
+/// the builds holding an evicted payload keep using it
+- (void)testEvictedPayloadOutlivesEntry {
+    StringCache cache(1000, 1);
+    cache.insert(keyOf(1, 1), payloadOf(600), 600);
+    StringCache::Ref held = cache.find(keyOf(1, 1));
+    std::weak_ptr<const std::string> watch = held;
+    cache.insert(keyOf(2, 2), payloadOf(600), 600);
+    XCTAssertTrue(cache.find(keyOf(1, 1)) == nullptr);
+    XCTAssertEqual(held->size(), 600u);
+    held = nullptr;
+    XCTAssertTrue(watch.expired());
+}
+
+- (void)testFailedLoadIsNotCached {
+    StringCache cache(8 << 20);
+    int loads = 0;
+    auto failing = [&](size_t &) {
+        ++loads;
+        return StringCache::Ref();
+    };
+    XCTAssertTrue(cache.findOrLoad(keyOf(640, 360), failing) == nullptr);
+    XCTAssertTrue(cache.findOrLoad(keyOf(640, 360), failing) == nullptr);
+    XCTAssertEqual(loads, 2);
+    XCTAssertEqual(cache.stats().entries, 0u);
+}
+
+- (void)testTransposedSizesDiffer {
+    XCTAssertFalse(keyOf(640, 360) == keyOf(360, 640));
+    XCTAssertNotEqual(MovSampleKeyHash()(keyOf(640, 360)), MovSampleKeyHash()(keyOf(360, 640)));
+    XCTAssertFalse(keyOf(640, 360, 30) == keyOf(640, 360, 60));
+}
+
+@end
@@ -0,0 +1,75 @@
+//
+//  IVTMovieFileBuilderTests.mm
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "IVTMovieFileBuilder.h"
+
+static const int kFrameRate = 30;
+static const NSTimeInterval kDuration = 120; // long enough for every core to get a range of its own
+
+@interface IVTMovieFileBuilderTests : XCTestCase
+@end
+
+@implementation IVTMovieFileBuilderTests
+
+/// the frames come from the sample cache as in the app
+- (void)buildWithConcurrency:(NSInteger)maxConcurrency {
+    IVTMovieModel *movieModel = [[IVTMovieModel alloc] init];
+    movieModel.frameRate = kFrameRate;
+    movieModel.duration = kDuration;
+    movieModel.width = 640;
+    movieModel.height = 360;
+    movieModel.outputPath = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"builder%ld.mov", (long)maxConcurrency]];
+    [NSFileManager.defaultManager removeItemAtPath:movieModel.outputPath error:nil];
+    IVTMovieFileBuilder *builder = [[IVTMovieFileBuilder alloc] initWithMovieModel:movieModel];
+    builder.maxConcurrency = maxConcurrency;
+    XCTestExpectation *built = [self expectationWithDescription:@"built"];
+    [builder movieFileBuild:^(NSError *err) {
+        XCTAssertNil(err);
+        [built fulfill];
+    }];
+    [self waitForExpectations:@[ built ] timeout:120];
+    XCTAssertTrue([NSFileManager.defaultManager fileExistsAtPath:movieModel.outputPath]);
+}
+
+/// the baseline of testBuildRanges
+- (void)testBuildSerial {
+    [self measureBlock:^{
+        [self buildWithConcurrency:1];
+    }];
+}
+
+- (void)testBuildRanges {
+    [self measureBlock:^{
+        [self buildWithConcurrency:NSProcessInfo.processInfo.activeProcessorCount];
+    }];
+}
+
+/// a background build promoted while its ranges are encoded finishes like any other
+- (void)testPromoteRanges {
+    IVTMovieModel *movieModel = [[IVTMovieModel alloc] init];
+    movieModel.frameRate = kFrameRate;
+    movieModel.duration = kDuration;
+    movieModel.width = 640;
+    movieModel.height = 360;
+    movieModel.outputPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"builderPromoted.mov"];
+    [NSFileManager.defaultManager removeItemAtPath:movieModel.outputPath error:nil];
+    IVTMovieFileBuilder *builder = [[IVTMovieFileBuilder alloc] initWithMovieModel:movieModel];
+    builder.qos = QOS_CLASS_BACKGROUND;
+    builder.maxConcurrency = 4;
+    XCTestExpectation *built = [self expectationWithDescription:@"built"];
+    [builder movieFileBuild:^(NSError *err) {
+        XCTAssertNil(err);
+        [built fulfill];
+    }];
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, 100 * NSEC_PER_MSEC), dispatch_get_main_queue(), ^{
+        [builder promote];
+    });
+    [self waitForExpectations:@[ built ] timeout:120];
+}
+
+@end
@@ -44,7 +44,17 @@ typedef enum : NSUInteger {
 ///允许后台使用GPU进行计算
 + (void)enableBackgroundGPUUsage;
 
+///按预计的视频尺寸在后台以低优先级提前生成AVPlayer小窗使用的占位视频,开启小窗时直接使用,未完成的任务会提升优先级
+///duration为小窗的视频长度,直播为0,在主线程调用
++ (void)prewarmWithVideoSizes:(NSArray<NSValue *> *)videoSizes duration:(NSTimeInterval)duration;
+
 @property (nonatomic, class) void(^logCallback)(IVTPictureInPictureLogLevel logLevel, const char *tag, const char *log);
+///记录视频生成和解码各阶段的耗时,关闭时几乎没有开销,默认为NO
+@property (nonatomic, class) BOOL traceEnabled;
+///非空时每条Error级别的日志都会把最近的耗时记录以Chrome/Perfetto JSON写入该路径,并通过logCallback输出
+@property (nonatomic, class, nullable, copy) NSString *traceDumpPath;
+///把最近的耗时记录以Chrome/Perfetto JSON写入path
++ (BOOL)dumpTraceToPath:(NSString *)path;
 
 ///当前需要显示在小窗内的view, 用于承载小窗内容。
 @property (nonatomic, nullable) UIView *contentView;
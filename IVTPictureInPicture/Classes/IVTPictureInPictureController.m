@@ -8,6 +8,8 @@
 #import "IVTPictureInPictureAVPlayerView.h"
 #import "IVTPictureInPictureSampleBufferPlayerView.h"
 #import "IVTPictureInPictureInner.h"
+#import "IVTMovTrace.h"
+#import "IVTMoviePrewarmScheduler.h"
 
 #define keypath(OBJ, PATH) \
 (((void)(NO && ((void)OBJ.PATH, NO)), # PATH))
@@ -183,6 +185,17 @@ static IVTPictureInPictureController* sCurrentInstance;
     }
 }
 
++ (void)prewarmWithVideoSizes:(NSArray<NSValue *> *)videoSizes duration:(NSTimeInterval)duration {
+    NSMutableArray<NSValue *> *sizes = [NSMutableArray arrayWithCapacity:videoSizes.count];
+    for (NSValue *value in videoSizes) {
+        CGSize size = value.CGSizeValue;
+        if (size.width > 0 && size.height > 0) {
+            [sizes addObject:[NSValue valueWithCGSize:IVTPIPCompressSize(size)]];
+        }
+    }
+    [IVTMoviePrewarmScheduler.sharedScheduler prewarmSizes:sizes duration:duration];
+}
+
 + (void)setLogCallback:(void (^)(IVTPictureInPictureLogLevel, const char *, const char * _Nonnull))logCallback {
     IVTPictureInPictureLogCallaback = (typeof(IVTPictureInPictureLogCallaback))logCallback;
 }
@@ -191,6 +204,30 @@ static IVTPictureInPictureController* sCurrentInstance;
     return (void (^)(IVTPictureInPictureLogLevel, const char *, const char * _Nonnull))IVTPictureInPictureLogCallaback;
 }
 
++ (void)setTraceEnabled:(BOOL)traceEnabled {
+    IVTMovTraceSetEnabled(traceEnabled);
+}
+
++ (BOOL)traceEnabled {
+    return IVTMovTraceIsEnabled();
+}
+
++ (void)setTraceDumpPath:(NSString *)traceDumpPath {
+    IVTPictureInPictureTraceDumpPath = [traceDumpPath copy];
+}
+
++ (NSString *)traceDumpPath {
+    return IVTPictureInPictureTraceDumpPath;
+}
+
++ (BOOL)dumpTraceToPath:(NSString *)path {
+    int err = IVTMovTraceDump(path.fileSystemRepresentation);
+    if (err) {
+        LOGI("trace dump failed:%d", err);
+    }
+    return err == 0;
+}
+
 static void HookIfNeeded(void) {
     static dispatch_once_t onceToken;
     dispatch_once(&onceToken, ^{
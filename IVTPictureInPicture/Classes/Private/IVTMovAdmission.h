@@ -0,0 +1,185 @@
+//
+//  IVTMovAdmission.h
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#ifndef IVTMovAdmission_h
+#define IVTMovAdmission_h
+
+#ifdef __cplusplus
+
+#include "IVTMovTimeline.h"
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+namespace IVT {
+
+struct MovAdmissionPolicy {
+    enum Refusal {
+        COALESCE, // the frame isn't encoded, the last admitted frame holds through its slot and the sequence goes on
+        DROP,     // the frame isn't encoded and its slot is held too, the frame after the gap becomes a key frame
+    };
+
+    uint32_t maxPendingFrames = 3;      // frames inside the encoder, 0 ignores the signal
+    uint32_t maxQueuedWrites  = 32;     // operations queued on the io backend, 0 ignores the signal
+    uint64_t maxLatencyUs     = 200000; // smoothed time from submit to encoded frame, 0 ignores the signal
+    uint32_t maxConsecutiveRefusals = 4; // then a frame is admitted whatever the pressure, so the picture keeps moving
+    Refusal refusal = COALESCE;
+};
+
+/// depths sampled by the caller before each frame
+struct MovAdmissionSignals {
+    uint32_t pendingFrames = 0;
+    uint32_t queuedWrites  = 0;
+};
+
+struct MovAdmissionDecision {
+    enum Action {
+        ADMIT,
+        COALESCE,
+        DROP,
+    };
+    enum Reason {
+        NO_PRESSURE,
+        PENDING_FRAMES,
+        QUEUED_WRITES,
+        LATENCY,
+        FORCED_KEY_FRAME, // admitted under pressure, forced key frames are never refused
+        REFUSAL_LIMIT,    // admitted under pressure after maxConsecutiveRefusals
+    };
+
+    Action action = ADMIT;
+    Reason reason = NO_PRESSURE;
+    MovTick time  = kMovTickInvalid;
+    MovAdmissionSignals signals;
+    uint64_t latencyUs = 0;
+};
+
+struct MovAdmissionStats {
+    uint64_t admitted  = 0;
+    uint64_t coalesced = 0;
+    uint64_t dropped   = 0;
+    uint64_t admittedUnderPressure = 0;
+    uint64_t latencyUs = 0; // smoothed
+};
+
+/// Sits between the producer of frames and the encoder, refuses frames while the encoder or the writer lags behind,
+/// so a stall costs a few repeated frames instead of a growing queue and a burst afterwards.
+/// Latency is measured from submitted to completed, a frame outstanding for longer counts as it is, so stalls show at once.
+/// Times are microseconds of any monotonic clock. admit and submitted are called from the submitting thread,
+/// completed from the encoder callback.
+class MovAdmissionController {
+public:
+    MovAdmissionPolicy policy;
+    /// every decision but admissions without pressure, called from admit
+    std::function<void(const MovAdmissionDecision &)> observer;
+
+    MovAdmissionDecision admit(MovTick time, bool forcedKeyFrame, MovAdmissionSignals signals, uint64_t nowUs) {
+        MovAdmissionDecision decision;
+        decision.time    = time;
+        decision.signals = signals;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            decision.latencyUs = latencyAt(nowUs);
+            if (policy.maxPendingFrames && signals.pendingFrames >= policy.maxPendingFrames) {
+                decision.reason = MovAdmissionDecision::PENDING_FRAMES;
+            } else if (policy.maxQueuedWrites && signals.queuedWrites >= policy.maxQueuedWrites) {
+                decision.reason = MovAdmissionDecision::QUEUED_WRITES;
+            } else if (policy.maxLatencyUs && decision.latencyUs >= policy.maxLatencyUs) {
+                decision.reason = MovAdmissionDecision::LATENCY;
+            }
+            if (decision.reason != MovAdmissionDecision::NO_PRESSURE) {
+                if (forcedKeyFrame) {
+                    decision.reason = MovAdmissionDecision::FORCED_KEY_FRAME;
+                } else if (refusals >= policy.maxConsecutiveRefusals) {
+                    decision.reason = MovAdmissionDecision::REFUSAL_LIMIT;
+                } else {
+                    decision.action = policy.refusal == MovAdmissionPolicy::DROP ? MovAdmissionDecision::DROP : MovAdmissionDecision::COALESCE;
+                }
+            }
+            switch (decision.action) {
+                case MovAdmissionDecision::ADMIT:
+                    refusals = 0;
+                    ++counters.admitted;
+                    counters.admittedUnderPressure += decision.reason != MovAdmissionDecision::NO_PRESSURE;
+                    break;
+                case MovAdmissionDecision::COALESCE:
+                    ++refusals;
+                    ++counters.coalesced;
+                    break;
+                case MovAdmissionDecision::DROP:
+                    ++refusals;
+                    ++counters.dropped;
+                    break;
+            }
+        }
+        if (observer && decision.reason != MovAdmissionDecision::NO_PRESSURE) {
+            observer(decision);
+        }
+        return decision;
+    }
+
+    /// an admitted frame went to the encoder
+    void submitted(MovTick time, uint64_t nowUs) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (outstanding.size() >= kMaxOutstanding) {
+            outstanding.pop_front();
+        }
+        outstanding.push_back({ time, nowUs });
+    }
+
+    /// the encoder returned the frame of time, frames submitted before it and not returned were dropped by the encoder
+    void completed(MovTick time, uint64_t nowUs) {
+        std::lock_guard<std::mutex> guard(lock);
+        while (!outstanding.empty() && outstanding.front().time <= time) {
+            if (outstanding.front().time == time) {
+                uint64_t sample = nowUs - std::min(nowUs, outstanding.front().submitUs);
+                smoothedUs      = smoothedUs ? smoothedUs - smoothedUs / 8 + sample / 8 : sample;
+            }
+            outstanding.pop_front();
+        }
+    }
+
+    /// forget the outstanding frames, when the encoder is recreated
+    void reset() {
+        std::lock_guard<std::mutex> guard(lock);
+        outstanding.clear();
+        smoothedUs = 0;
+        refusals   = 0;
+    }
+
+    MovAdmissionStats stats() {
+        std::lock_guard<std::mutex> guard(lock);
+        MovAdmissionStats ret = counters;
+        ret.latencyUs         = smoothedUs;
+        return ret;
+    }
+
+private:
+    static constexpr size_t kMaxOutstanding = 64;
+
+    struct Outstanding {
+        MovTick time;
+        uint64_t submitUs;
+    };
+
+    std::mutex lock;
+    std::deque<Outstanding> outstanding; // in submit order, which is time order as the encoder doesn't reorder
+    uint64_t smoothedUs = 0;
+    uint32_t refusals   = 0;
+    MovAdmissionStats counters;
+
+    uint64_t latencyAt(uint64_t nowUs) const {
+        uint64_t oldest = outstanding.empty() ? 0 : nowUs - std::min(nowUs, outstanding.front().submitUs);
+        return std::max(smoothedUs, oldest);
+    }
+};
+
+} // namespace IVT
+#endif
+#endif /* IVTMovAdmission_h */
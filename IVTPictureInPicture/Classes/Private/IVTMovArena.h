@@ -0,0 +1,82 @@
+//
+//  IVTMovArena.h
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#ifndef IVTMovArena_h
+#define IVTMovArena_h
+
+#ifdef __cplusplus
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace IVT {
+
+/// Bump allocator for the scratch data of one job.
+/// Nothing is freed one by one, reset makes all the blocks reusable for the next job.
+class MovArena {
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+    std::vector<Block> blocks;
+    size_t current = 0; // block being filled
+    size_t used    = 0; // bytes used of the current block
+    size_t blockSize;
+
+public:
+    explicit MovArena(size_t blockSize = 64 * 1024) : blockSize(blockSize) {}
+
+    MovArena(const MovArena &) = delete;
+    MovArena &operator=(const MovArena &) = delete;
+    MovArena(MovArena &&) = default;
+
+    void *allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+        for (; current < blocks.size(); ++current, used = 0) {
+            Block &block   = blocks[current];
+            uintptr_t base = (uintptr_t)block.data.get();
+            size_t offset  = ((base + used + align - 1) & ~(uintptr_t)(align - 1)) - base;
+            if (offset + size <= block.size) {
+                used = offset + size;
+                return block.data.get() + offset;
+            }
+        }
+        size_t size1 = std::max(blockSize, size + align);
+        blocks.push_back({ std::unique_ptr<char[]>(new char[size1]), size1 });
+        current        = blocks.size() - 1;
+        uintptr_t base = (uintptr_t)blocks.back().data.get();
+        size_t offset  = ((base + align - 1) & ~(uintptr_t)(align - 1)) - base;
+        used           = offset + size;
+        return blocks.back().data.get() + offset;
+    }
+
+    /// uninitialized storage of count T, T must not need destruction
+    template <class T>
+    T *allocate(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena doesn't run destructors");
+        return (T *)allocate(sizeof(T) * count, alignof(T));
+    }
+
+    void reset() {
+        current = 0;
+        used    = 0;
+    }
+
+    size_t capacity() const {
+        size_t total = 0;
+        for (auto &&block : blocks) {
+            total += block.size;
+        }
+        return total;
+    }
+};
+
+} // namespace IVT
+#endif
+#endif /* IVTMovArena_h */
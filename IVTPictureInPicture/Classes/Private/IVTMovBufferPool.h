@@ -0,0 +1,70 @@
+//
+//  IVTMovBufferPool.h
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#ifndef IVTMovBufferPool_h
+#define IVTMovBufferPool_h
+
+#ifdef __cplusplus
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace IVT {
+
+/// Read buffers shared by the readers of a file, a buffer keeps its capacity when it returns to the pool.
+class MovBufferPool : public std::enable_shared_from_this<MovBufferPool> {
+public:
+    typedef std::vector<uint8_t> Buffer;
+
+    /// returned to the pool when released
+    typedef std::unique_ptr<Buffer, std::function<void(Buffer *)>> Lease;
+
+    explicit MovBufferPool(size_t maxIdle = 4) : maxIdle(maxIdle) {}
+
+    Lease acquire() {
+        Buffer *buffer = nullptr;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (!idle.empty()) {
+                buffer = idle.back().release();
+                idle.pop_back();
+            }
+        }
+        if (!buffer) {
+            buffer = new Buffer();
+        }
+        std::weak_ptr<MovBufferPool> pool = shared_from_this();
+        return Lease(buffer, [pool](Buffer *buffer) {
+            if (auto strongPool = pool.lock()) {
+                strongPool->recycle(buffer);
+            } else {
+                delete buffer;
+            }
+        });
+    }
+
+private:
+    const size_t maxIdle;
+    std::mutex lock;
+    std::vector<std::unique_ptr<Buffer>> idle;
+
+    void recycle(Buffer *buffer) {
+        std::unique_ptr<Buffer> owner(buffer);
+        std::lock_guard<std::mutex> guard(lock);
+        if (idle.size() < maxIdle) {
+            owner->clear();
+            idle.push_back(std::move(owner));
+        }
+    }
+};
+
+} // namespace IVT
+#endif
+#endif /* IVTMovBufferPool_h */
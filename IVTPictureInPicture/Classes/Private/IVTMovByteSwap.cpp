@@ -0,0 +1,180 @@
+//
+//  IVTMovByteSwap.cpp
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#include "IVTMovByteSwap.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define IVT_BSWAP_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define IVT_BSWAP_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace IVT {
+
+namespace {
+
+typedef void (*Kernel32)(uint32_t *, const uint32_t *, size_t, uint32_t);
+typedef void (*Kernel64)(uint64_t *, const uint64_t *, size_t, uint64_t);
+
+struct Kernel {
+    const char *name;
+    Kernel32 swap32, add32;
+    Kernel64 swap64, add64;
+};
+
+// kAdd = false only swaps, the offset is ignored
+template <bool kAdd>
+void scalar32(uint32_t *dst, const uint32_t *src, size_t count, uint32_t offset) {
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = kAdd ? __builtin_bswap32(__builtin_bswap32(src[i]) + offset) : __builtin_bswap32(src[i]);
+    }
+}
+
+template <bool kAdd>
+void scalar64(uint64_t *dst, const uint64_t *src, size_t count, uint64_t offset) {
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = kAdd ? __builtin_bswap64(__builtin_bswap64(src[i]) + offset) : __builtin_bswap64(src[i]);
+    }
+}
+
+#if IVT_BSWAP_X86
+
+#define IVT_SHUFFLE32 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+#define IVT_SHUFFLE64 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8
+
+template <bool kAdd>
+__attribute__((target("sse4.1"))) void sse32(uint32_t *dst, const uint32_t *src, size_t count, uint32_t offset) {
+    const __m128i mask = _mm_setr_epi8(IVT_SHUFFLE32);
+    const __m128i add  = _mm_set1_epi32((int)offset);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        v = kAdd ? _mm_shuffle_epi8(_mm_add_epi32(_mm_shuffle_epi8(v, mask), add), mask) : _mm_shuffle_epi8(v, mask);
+        _mm_storeu_si128((__m128i *)(dst + i), v);
+    }
+    scalar32<kAdd>(dst + i, src + i, count - i, offset);
+}
+
+template <bool kAdd>
+__attribute__((target("sse4.1"))) void sse64(uint64_t *dst, const uint64_t *src, size_t count, uint64_t offset) {
+    const __m128i mask = _mm_setr_epi8(IVT_SHUFFLE64);
+    const __m128i add  = _mm_set1_epi64x((long long)offset);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        v = kAdd ? _mm_shuffle_epi8(_mm_add_epi64(_mm_shuffle_epi8(v, mask), add), mask) : _mm_shuffle_epi8(v, mask);
+        _mm_storeu_si128((__m128i *)(dst + i), v);
+    }
+    scalar64<kAdd>(dst + i, src + i, count - i, offset);
+}
+
+template <bool kAdd>
+__attribute__((target("avx2"))) void avx32(uint32_t *dst, const uint32_t *src, size_t count, uint32_t offset) {
+    const __m256i mask = _mm256_setr_epi8(IVT_SHUFFLE32, IVT_SHUFFLE32);
+    const __m256i add  = _mm256_set1_epi32((int)offset);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        v = kAdd ? _mm256_shuffle_epi8(_mm256_add_epi32(_mm256_shuffle_epi8(v, mask), add), mask) : _mm256_shuffle_epi8(v, mask);
+        _mm256_storeu_si256((__m256i *)(dst + i), v);
+    }
+    scalar32<kAdd>(dst + i, src + i, count - i, offset);
+}
+
+template <bool kAdd>
+__attribute__((target("avx2"))) void avx64(uint64_t *dst, const uint64_t *src, size_t count, uint64_t offset) {
+    const __m256i mask = _mm256_setr_epi8(IVT_SHUFFLE64, IVT_SHUFFLE64);
+    const __m256i add  = _mm256_set1_epi64x((long long)offset);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        v = kAdd ? _mm256_shuffle_epi8(_mm256_add_epi64(_mm256_shuffle_epi8(v, mask), add), mask) : _mm256_shuffle_epi8(v, mask);
+        _mm256_storeu_si256((__m256i *)(dst + i), v);
+    }
+    scalar64<kAdd>(dst + i, src + i, count - i, offset);
+}
+
+#undef IVT_SHUFFLE32
+#undef IVT_SHUFFLE64
+
+#elif IVT_BSWAP_NEON
+
+template <bool kAdd>
+void neon32(uint32_t *dst, const uint32_t *src, size_t count, uint32_t offset) {
+    const uint32x4_t add = vdupq_n_u32(offset);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        uint32x4_t v = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8((const uint8_t *)(src + i))));
+        if (kAdd) {
+            v = vaddq_u32(v, add);
+        }
+        vst1q_u8((uint8_t *)(dst + i), vrev32q_u8(vreinterpretq_u8_u32(v)));
+    }
+    scalar32<kAdd>(dst + i, src + i, count - i, offset);
+}
+
+template <bool kAdd>
+void neon64(uint64_t *dst, const uint64_t *src, size_t count, uint64_t offset) {
+    const uint64x2_t add = vdupq_n_u64(offset);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        uint64x2_t v = vreinterpretq_u64_u8(vrev64q_u8(vld1q_u8((const uint8_t *)(src + i))));
+        if (kAdd) {
+            v = vaddq_u64(v, add);
+        }
+        vst1q_u8((uint8_t *)(dst + i), vrev64q_u8(vreinterpretq_u8_u64(v)));
+    }
+    scalar64<kAdd>(dst + i, src + i, count - i, offset);
+}
+
+#endif
+
+Kernel selectKernel() {
+#if IVT_BSWAP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return { "avx2", avx32<false>, avx32<true>, avx64<false>, avx64<true> };
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return { "sse4.1", sse32<false>, sse32<true>, sse64<false>, sse64<true> };
+    }
+#elif IVT_BSWAP_NEON
+    return { "neon", neon32<false>, neon32<true>, neon64<false>, neon64<true> };
+#endif
+    return { "scalar", scalar32<false>, scalar32<true>, scalar64<false>, scalar64<true> };
+}
+
+const Kernel &kernel() {
+    static const Kernel selected = selectKernel();
+    return selected;
+}
+
+} // namespace
+
+void MovByteSwap::swap32(uint32_t *dst, const uint32_t *src, size_t count) {
+    kernel().swap32(dst, src, count, 0);
+}
+
+void MovByteSwap::swap64(uint64_t *dst, const uint64_t *src, size_t count) {
+    kernel().swap64(dst, src, count, 0);
+}
+
+void MovByteSwap::addBigEndian32(uint32_t *dst, const uint32_t *src, size_t count, uint32_t offset) {
+    kernel().add32(dst, src, count, offset);
+}
+
+void MovByteSwap::addBigEndian64(uint64_t *dst, const uint64_t *src, size_t count, uint64_t offset) {
+    kernel().add64(dst, src, count, offset);
+}
+
+const char *MovByteSwap::kernelName() {
+    return kernel().name;
+}
+
+} // namespace IVT
@@ -0,0 +1,35 @@
+//
+//  IVTMovByteSwap.h
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#ifndef IVTMovByteSwap_h
+#define IVTMovByteSwap_h
+
+#ifdef __cplusplus
+
+#include <cstddef>
+#include <cstdint>
+
+namespace IVT {
+
+/// Bulk conversion of sample tables between host and big-endian order.
+/// The kernel (AVX2, SSE4.1, NEON or scalar) is picked on first use, dst may equal src.
+struct MovByteSwap {
+    /// dst[i] = bswap(src[i])
+    static void swap32(uint32_t *dst, const uint32_t *src, size_t count);
+    static void swap64(uint64_t *dst, const uint64_t *src, size_t count);
+
+    /// dst[i] = bswap(bswap(src[i]) + offset), shifts big-endian stco/co64 entries in one pass
+    static void addBigEndian32(uint32_t *dst, const uint32_t *src, size_t count, uint32_t offset);
+    static void addBigEndian64(uint64_t *dst, const uint64_t *src, size_t count, uint64_t offset);
+
+    /// name of the selected kernel
+    static const char *kernelName();
+};
+
+} // namespace IVT
+#endif
+#endif /* IVTMovByteSwap_h */
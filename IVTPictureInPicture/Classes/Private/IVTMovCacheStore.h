@@ -0,0 +1,208 @@
+//
+//  IVTMovCacheStore.h
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#ifndef IVTMovCacheStore_h
+#define IVTMovCacheStore_h
+
+#ifdef __cplusplus
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace IVT {
+
+/// Bytes of the store pinned by a reader, they stay valid and unchanged until the view is dropped
+/// whatever the writer does to the store. Each part is contiguous and holds whole samples.
+struct MovCacheView {
+    struct Part {
+        std::shared_ptr<char> pin;
+        const char *data;
+        size_t length;
+    };
+    std::vector<Part> parts;
+    size_t size = 0;
+};
+
+/// The data of a segment cached to memory, held in blocks that never move once allocated, so readers can use the bytes
+/// in place while the segment grows. A sample never straddles two blocks. Truncating into a pinned block copies its kept
+/// part first, so later appends never overwrite bytes a view can see. The block list has its own lock, appends copy outside it.
+class MovCacheStore {
+public:
+    static constexpr size_t kBlockSize = 256 << 10;
+
+    MovCacheStore() {}
+    MovCacheStore(const MovCacheStore &) = delete;
+    MovCacheStore(MovCacheStore &&o) : blocks(std::move(o.blocks)), length(o.length) {
+        o.length = 0;
+    }
+
+    MovCacheStore &operator=(MovCacheStore &&o) {
+        if (this != &o) {
+            blocks   = std::move(o.blocks);
+            length   = o.length;
+            o.length = 0;
+        }
+        return *this;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return length;
+    }
+
+    /// allocate the first block for size bytes now, so appends up to it don't allocate, on an empty store
+    void reserve(size_t size) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (blocks.empty()) {
+            size_t capacity = std::max(kBlockSize, size);
+            blocks.push_back({ 0, 0, capacity, std::shared_ptr<char>(new char[capacity], std::default_delete<char[]>()) });
+        }
+    }
+
+    /// append at the end, the bytes become visible to views when it returns
+    void append(const char *ptr, size_t size) {
+        char *target;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (blocks.empty() || blocks.back().capacity - blocks.back().length < size) {
+                if (!blocks.empty() && blocks.back().length == 0) {
+                    blocks.pop_back(); // reserved too small for the first sample
+                }
+                size_t capacity = std::max(kBlockSize, size);
+                blocks.push_back({ length, 0, capacity, std::shared_ptr<char>(new char[capacity], std::default_delete<char[]>()) });
+            }
+            target = blocks.back().data.get() + blocks.back().length;
+        }
+        // only this writer touches the bytes past the end, views can't reach them yet
+        std::memcpy(target, ptr, size);
+        std::lock_guard<std::mutex> guard(lock);
+        blocks.back().length += size;
+        length += size;
+    }
+
+    /// keep the first size bytes
+    void truncate(size_t size) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (size >= length) {
+            return;
+        }
+        while (!blocks.empty() && blocks.back().start >= size) {
+            blocks.pop_back();
+        }
+        if (!blocks.empty()) {
+            Block &back = blocks.back();
+            size_t kept = size - back.start;
+            if (kept < back.length && back.data.use_count() > 1) {
+                // a view may read the bytes the next append would overwrite
+                std::shared_ptr<char> copy(new char[back.capacity], std::default_delete<char[]>());
+                std::memcpy(copy.get(), back.data.get(), kept);
+                back.data = std::move(copy);
+            }
+            back.length = kept;
+        }
+        length = size;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> guard(lock);
+        blocks.clear();
+        length = 0;
+    }
+
+    /// pin [offset, offset + size), false if it is out of the store
+    bool view(MovCacheView &view, size_t size, size_t offset) const {
+        view.parts.clear();
+        view.size = 0;
+        std::lock_guard<std::mutex> guard(lock);
+        if (offset + size > length) {
+            return false;
+        }
+        if (size == 0) {
+            return true;
+        }
+        for (auto it = blockAt(offset); size; ++it) {
+            size_t inBlock = offset - it->start;
+            size_t part    = std::min(size, it->length - inBlock);
+            view.parts.push_back({ it->data, it->data.get() + inBlock, part });
+            view.size += part;
+            offset += part;
+            size -= part;
+        }
+        return true;
+    }
+
+    /// copy [offset, offset + size) to target, returns the bytes copied
+    long read(void *target, size_t size, size_t offset) const {
+        MovCacheView pinned;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (offset > length) {
+                return -1;
+            }
+            size = std::min(size, length - offset);
+        }
+        if (!view(pinned, size, offset)) {
+            return -1;
+        }
+        char *dst = (char *)target;
+        for (auto &&part : pinned.parts) {
+            std::memcpy(dst, part.data, part.length);
+            dst += part.length;
+        }
+        return (long)size;
+    }
+
+    /// calls write(const char *data, size_t length, size_t offset) for each block in order, stops at the first error
+    template <class Write>
+    int forEachBlock(Write &&write) const {
+        std::lock_guard<std::mutex> guard(lock);
+        for (auto &&block : blocks) {
+            if (block.length) {
+                if (int err = write(block.data.get(), block.length, block.start)) {
+                    return err;
+                }
+            }
+        }
+        return 0;
+    }
+
+    size_t memoryUsage() const {
+        std::lock_guard<std::mutex> guard(lock);
+        size_t total = 0;
+        for (auto &&block : blocks) {
+            total += block.capacity;
+        }
+        return total;
+    }
+
+private:
+    struct Block {
+        size_t start; // offset in the store
+        size_t length;
+        size_t capacity;
+        std::shared_ptr<char> data;
+    };
+
+    mutable std::mutex lock;
+    std::vector<Block> blocks;
+    size_t length = 0;
+
+    std::vector<Block>::const_iterator blockAt(size_t offset) const {
+        auto it = std::upper_bound(blocks.begin(), blocks.end(), offset, [](size_t offset, const Block &block) {
+            return offset < block.start;
+        });
+        return it - 1;
+    }
+};
+
+} // namespace IVT
+#endif
+#endif /* IVTMovCacheStore_h */
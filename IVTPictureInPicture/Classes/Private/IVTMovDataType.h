@@ -10,8 +10,24 @@
 
 #ifdef __cplusplus
 
+#include <cassert>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <sys/types.h>
+#include <type_traits>
+#include <utility>
+
 #define PACKED() __attribute__((packed))
 
+/// checks of the muxer, compiled in DEBUG builds only without touching the assert of the includers
+#ifdef DEBUG
+#define MOV_ASSERT(e) assert(e)
+#else
+#define MOV_ASSERT(e) ((void)0)
+#endif
+
 template <class T, std::size_t... N>
 constexpr T _bswap_impl(T i, std::index_sequence<N...>) {
   return (((i >> N * CHAR_BIT & std::uint8_t(-1))
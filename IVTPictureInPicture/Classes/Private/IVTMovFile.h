@@ -12,8 +12,12 @@
 #ifdef __cplusplus
 
 #include "IVTCFObject.h"
+#include "IVTMovAdmission.h"
+#include "IVTMovMuxer.h"
+#include "IVTMovReorder.h"
 #include <VideoToolbox/VideoToolbox.h>
 #include <atomic>
+#include <functional>
 #include <stdio.h>
 #include <string>
 #include <thread>
@@ -28,52 +32,64 @@
 
 namespace IVT {
 
-class IMovFile {
+/// Decodes with its own cursor, read buffer and decompression session,
+/// so consumers decoding one file don't reset each other's GOP progress.
+class IMovReader {
+public:
+    virtual int
+    decodeSample(CMTime atTime, std::function<void(OSStatus status, CVPixelBufferRef image)>
+                 callback) = 0;
+    /// drops the session, the next decode starts from the key frame
+    virtual void cancelReading() = 0;
+    virtual ~IMovReader(){};
+};
+
+class IMovFile : public MovMuxer {
 protected:
     IMovFile(int frameRate, int timeScale, int width, int height,
              const char *outputPath, int maxKeyFrameInterval)
-    : frameRate(frameRate), timeScale(timeScale), width(width),
-    height(height), outputPath(outputPath), maxKeyFrameInterval(maxKeyFrameInterval) {}
+    : MovMuxer(frameRate, timeScale, width, height, outputPath, maxKeyFrameInterval) {}
     
 public:
-    enum FinishWay {
-        BY_CUSTOM,
-        BY_SYSTEM
-    };
     enum EncodeQuality {
         BaseQuality,
         MainQuality,
         HighQuality
     };
+
+    /// stitch refuses ranges encoded with other parameter sets
+    static constexpr int kErrorParameterSetsDiffer = kCMFormatDescriptionError_InvalidParameter;
     
-    struct FinishConfig {
-        FinishWay way = BY_CUSTOM;
-        uint copyLastFrameCount = 0;
-        uint samplePerChunk = 0;
-    };
-    
-    const int frameRate;
-    const int timeScale;
-    const int width;
-    const int height;
-    const int maxKeyFrameInterval;
-    const std::string outputPath;
     bool autoCreateReaderOnWriting = false;
-    bool cacheFileToMemory = false;
-    FinishConfig finishConfig;
-    CMTime lastEncodedFrameTime = kCMTimeInvalid;
+    size_t reorderWindow = 3; // input frames waiting for an earlier one before encodeFrame gives up on it, 0 encodes at once
+    uint32_t reorderMaxHoldFrames = 2; // missing input frames filled with the previous one instead of a key frame
+    bool admissionControl = false; // refuse frames of encodeFrame while the encoder or the writer lags behind, for live producers
+    MovAdmissionPolicy admissionPolicy;
+    std::function<void(const MovAdmissionDecision &)> admissionObserver; // set before the first frame
+    /// plannedDuration > 0 reserves the segment for that many seconds up front, see MovMuxer::planCapacity
     static std::shared_ptr<IMovFile>
-    create(int frameRate, int timeScale, int width, int height, EncodeQuality quality, const char *outputPath, int maxKeyFrameInterval = 5, bool lazyWriter = false);
+    create(int frameRate, int timeScale, int width, int height, EncodeQuality quality, const char *outputPath, int maxKeyFrameInterval = 5, bool lazyWriter = false, double plannedDuration = 0);
     virtual int encodeSample(CMSampleBufferRef buffer) = 0;
     virtual int encodeFrame(CVPixelBufferRef buffer, CMTime frameTime) = 0;
     virtual int
     decodeSample(CMTime atTime, std::function<void(OSStatus status, CVPixelBufferRef image)>
                  callback) = 0;
     
+    /// wait for the frames in the encoder to reach the segments, finishWriting does it first
+    virtual OSStatus completeFrames() = 0;
+    /// take the segments of a file encoding a later or earlier time range, its frames must be completed.
+    /// The ranges are concatenated losslessly by finishWriting, so their sps and pps must equal these of this file
+    virtual int stitch(IMovFile &range) = 0;
     virtual void finishWriting(std::function<void(NSError *err)> completion) = 0;
+    /// a movie of the key frames for scrubbing, one intra decode per thumbnail, call it after the frames are completed
+    virtual NSError *exportKeyFrameMovie(const char *path) = 0;
     
     virtual void cancelWriting() = 0;
+    virtual MovReorderStats reorderStats() = 0;
+    virtual MovAdmissionStats admissionStats() = 0;
     virtual void cancelReading() = 0;
+    /// a new reader keeps the file alive, decodeSample and cancelReading use the reader owned by the file
+    virtual std::shared_ptr<IMovReader> openReader() = 0;
     virtual ~IMovFile(){};
 };
 
@@ -6,19 +6,23 @@
 //
 
 #include "IVTMovFile.h"
+#include "IVTMovBufferPool.h"
 #include "IVTMovFormat.h"
+#include "IVTMovIO.h"
+#include "IVTMovReorder.h"
+#include "IVTMovReplay.h"
+#include "IVTMovSampleIterator.h"
+#include "IVTMovTrace.h"
 #include <AVFoundation/AVFoundation.h>
 #include <assert.h>
 #include <cstddef>
 #include <libgen.h>
-#include <sys/mman.h>
 #include <sys/stat.h>
 #include <array>
+#include <chrono>
 #include <mutex>
 #include <numeric>
 #include <mach/mach_time.h>
-#include <mach/vm_map.h>
-#include <mach/mach.h>
 
 #define CheckStatusAndReturn(exp) \
     ({                             \
@@ -32,322 +36,84 @@
 #endif
 
 
-static BOOL isReadableAddress(void * address) {
-    if (address == MAP_FAILED) {
-        return false;
-    }
-    // Read the memory
-    vm_size_t size = 0;
-    char buf[sizeof(uintptr_t)];
-    kern_return_t error = vm_read_overwrite(mach_task_self(), (vm_address_t)address, sizeof(uintptr_t), (vm_address_t)buf, &size);
-    return error == KERN_SUCCESS;
-}
-
-static inline int64_t dateConvert(time_t time) {
-    static time_t since;
-    if (!since) {
-        struct tm since_tm = { .tm_year = 4, .tm_mday = 1 };
-        since              = timegm(&since_tm);
-    }
-    return (int64_t)(time - since);
-}
-
 namespace IVT {
 
 
-struct stsc {
-    uint firstChunk = 0;
-    uint sampleSize = 0;
-    static constexpr int sampleDescription = 1;
-
-    operator SampleToChunkAtom::SampleToChunkEntry() {
-        return { firstChunk, sampleSize, sampleDescription };
-    }
-};
-
-struct FD {
-    int fd = 0;
-    FD() {}
-    FD(int fd): fd(fd) {
-    }
-    FD(const FD &) = delete;
-    FD(FD && o): fd(o.fd){
-        o.fd = 0;
-    };
-    FD &operator=(const FD &) = delete;
-    FD &operator=(FD &&o) {
-        int fd = o.fd;
-        o.fd = this->fd;
-        this->fd = fd;
-        return *this;
-    }
-    operator int() const {
-        return fd;
-    }
-    ~FD() {
-        if (fd) {
-            close(fd);
-        }
-    }
-};
-
-struct MovSeg {
-    CMTime start    = kCMTimeZero;
-    CMTime writeEnd = kCMTimeZero;
-    std::vector<uint> sampleSizes;  // stsz Sample Size Atoms
-    std::vector<uint> chunkOffsets; // stco Chunk Offset Atoms
-    std::vector<stsc> chunkSampleSizes;   // stsc Sample-to-Chunk Atoms
-    std::vector<uint> keyFrames;    // stss sync sample atoms
-
-    std::string path;
-    FD fd;
-    FD fd_r;
-    uint fileSize = 0;
-    
-    std::vector<char> caches;
-    int lastCacheOffset = 0;
-    bool cacheToMemory;
-
-    int lastSample = 0;
-    int lastSampleOffset = 0;
-
-    MovSeg() {}
-    MovSeg(const MovSeg &) = delete;
-    MovSeg(MovSeg &&)      = default;
-
-    MovSeg &operator=(MovSeg &&) = default;
-
-    int keyFrameForSample(int sample) { //key frame is chunk start
-        int base = 0;
-        for (auto begin = chunkSampleSizes.begin(); begin != chunkSampleSizes.end(); begin++) {
-            auto endChunk = (begin + 1) == chunkSampleSizes.end() ? chunkOffsets.size() + 1 : (begin + 1)->firstChunk;
-            auto end      = base + begin->sampleSize * (endChunk - begin->firstChunk);
-            if (sample < end) {
-                return sample - (sample - base) % begin->sampleSize;
-            }
-            base = (int)end;
-        }
-        assert(false);
-        return -1;
-    }
-    
-    bool validateChunks() {
-        size_t baseSample = 0;
-        size_t  totalSampleSize = 0;
-        for (auto begin = chunkSampleSizes.begin(); begin != chunkSampleSizes.end(); begin++) {
-            auto sampleSize = begin->sampleSize;
-            auto endChunk = (begin + 1) == chunkSampleSizes.end() ? chunkOffsets.size() + 1 : (begin + 1)->firstChunk;
-            for (auto i = begin->firstChunk; i < endChunk; i++) {
-                int chunkOffset = chunkOffsets[i - 1];
-                assert(chunkOffset == totalSampleSize);
-                auto size = std::accumulate(sampleSizes.begin() + baseSample, sampleSizes.begin() + baseSample + sampleSize, 0);
-                totalSampleSize += size;
-                baseSample += sampleSize;
-            }
-        }
-        assert(fileSize == totalSampleSize);
-        assert(baseSample == sampleSizes.size());
-        return true;
-    }
-    
-    void eraseFrameNotLessThan(int frame) {
-        int offset = offsetForSample(frame);
-        fileSize = offset;
-        long deletedSampleCount = sampleSizes.size() - frame;
-        for (auto i = chunkOffsets.size(); i--; ) {
-            auto chunk = i + 1;
-            auto&& back = chunkSampleSizes.back();
-            assert(chunk >= back.firstChunk);
-            
-            deletedSampleCount -= back.sampleSize;
-            if (deletedSampleCount >= 0) {
-                chunkOffsets.pop_back();
-                if (chunk == back.firstChunk) {
-                    chunkSampleSizes.pop_back();
-                }
-            } else {
-                chunkSampleSizes.push_back({.firstChunk = (uint)chunk,.sampleSize = (uint) -deletedSampleCount});
-            }
-            
-            if (deletedSampleCount <= 0) {
-                break;
-            }
-        }
-        
-        sampleSizes.erase(sampleSizes.begin() + frame, sampleSizes.end());
-        assert(validateChunks());
-        for (auto i = keyFrames.size(); i--; ) {
-            if (keyFrames[i] -1 >= frame) {
-                keyFrames.erase(keyFrames.begin() + i);
-            } else {
-                break;
-            }
-        }
-        
-    }
-    int offsetForSample(int sample) {
-        if (abs(lastSample - sample) < 10) {
-            bool neg = lastSample > sample;
-            int sum = 0, i = neg ? sample : lastSample , end = neg ? lastSample : sample;
-            while (i != end) {
-                sum += sampleSizes[i++];
-            }
-            lastSample = sample;
-            lastSampleOffset = neg ? lastSampleOffset - sum : lastSampleOffset + sum;
-            return lastSampleOffset;
-        } else {
-            int base = 0;
-            for (auto begin = chunkSampleSizes.begin(); begin != chunkSampleSizes.end(); begin++) {
-                auto endChunk = (begin + 1) != chunkSampleSizes.end() ? (begin + 1)->firstChunk : chunkOffsets.size() + 1;
-                auto end      = base + begin->sampleSize * (endChunk - begin->firstChunk);
-                if (sample < end) {
-                    int chunk        = begin->firstChunk + (sample - base) / begin->sampleSize;
-                    int offset       = (sample - base) % begin->sampleSize;
-                    int sampleOffset = chunkOffsets[chunk - 1];
-                    for (; offset; --offset) {
-                        sampleOffset += sampleSizes[sample - offset];
-                    }
-                    lastSample       = sample;
-                    lastSampleOffset = sampleOffset;
-                    return sampleOffset;
-                }
-                base = (int)end;
-            }
-        }
-        return -1;
-    }
-    
-    long append(const char* ptr, size_t length) {
-        auto fileSize = this->fileSize;
-        auto ret = write(ptr, length, fileSize);
-        if (ret == -1) {
-            return -1;
-        }
-        this->fileSize = uint(fileSize + length);
-        return length;
-    }
-    
-    long write(const char* ptr, size_t length, off_t offset) {
-        if (cacheToMemory) {
-            return writeToCache(ptr, length, offset);
-        }
-        int fd = this->fd;
-        long w = 0, total = length;
-        while (length != 0 && (w = pwrite(fd, ptr, length, offset)) >= 0) {
-            length -= w;
-            ptr += w;
-            offset += w;
-        }
-        return w == -1 ? -1 : total;
-    }
-    
-    long writeToCache(const char* ptr, size_t length, off_t offset) {
-        if (offset + length > caches.size()) {
-            caches.resize(offset + length);
-        }
-        std::memcpy((&(*caches.begin())) + offset, ptr, length);
-        return length;
-    }
-    
-    void writeToFD(int fd) {
-        if (cacheToMemory) {
-            ::write(fd, &(*caches.begin()), caches.size());
-            return;
-        }
-        char buff[8192];
-        int sourceFD = open(path.data(), O_RDONLY);
-        while (auto count = ::read(sourceFD, buff, 8192)) {
-            ::write(fd, buff, count);
-        }
-        close(fd);
-    }
-    
-    long readToMemory(void* ptr) {
-        if (cacheToMemory) {
-            return readFromCache(ptr, 0 , caches.size());
-        }
-        long size = 0;
-        int fd = open(path.data(), O_RDONLY);
-        while (auto count = ::read(fd, ptr, 8192 * 2)) {
-            size += count;
-            ptr = (char *)ptr + count;
-        }
-        close(fd);
-        return size;
-    }
-    
-    long read(void* ptr, size_t length, off_t offset) const {
-        if (cacheToMemory) {
-            return readFromCache(ptr, length, offset);
-        }
-        int fd = fd_r;
-        char *buf = (char *)ptr;
-        long r = 0, total = length;
-        while (length != 0 && (r = pread(fd, buf, length, offset)) >= 0) {
-            length -= r;
-            buf += r;
-            offset += r;
-        }
-        return r == -1 ? -1 : total;
-    }
-    
-    long readFromCache(void *target, size_t offset, size_t size) const {
-        if (offset > caches.size()) {
-            return -1;
-        }
-        auto read = std::min(size, caches.size() - offset);
-        std::memcpy(target, (&(*caches.begin())) + offset, read);
-        return read;
-    }
-    
-    bool check() const {
-        if (cacheToMemory) {
-            return fileSize == caches.size();
-        }
-        struct stat buffer;
-        fstat(fd, &buffer);
-        return buffer.st_size == fileSize;
-    }
-};
-
 static void releaseVTCompressionSession(CFTypeRef ref) {
     VTCompressionSessionInvalidate((VTCompressionSessionRef)ref);
     CFRelease(ref);
 }
 
+static NSError *finishNSError(const MovMuxer::FinishResult &result) {
+    if (result) {
+        return nil;
+    }
+    NSDictionary *userInfo = result.message.empty() ? nil : @{NSLocalizedDescriptionKey: @(result.message.c_str())};
+    return [NSError errorWithDomain:result.posix ? NSPOSIXErrorDomain : NSOSStatusErrorDomain code:result.error userInfo:userInfo];
+}
+
+static uint64_t nowMicros() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 static void releaseVTDecompressionSession(CFTypeRef ref) {
     VTDecompressionSessionInvalidate((VTDecompressionSessionRef)ref);
     CFRelease(ref);
 }
 
-class MovFile : public IMovFile, public std::enable_shared_from_this<MovFile> {
-    friend class MovFileDelegate;
-    typedef CFObject<VTDecompressionSessionRef, id, releaseVTDecompressionSession> Reader;
-    typedef CFObject<VTCompressionSessionRef, id, releaseVTCompressionSession> Writer;
+class MovFile;
+
+/// Decode cursor of one consumer, sessions of different readers run in parallel.
+class MovReader : public IMovReader {
+    typedef CFObject<VTDecompressionSessionRef, id, releaseVTDecompressionSession> Session;
     struct ReaderFrameRef {
         CFObject<CVImageBufferRef> lastDecodedImage;
         OSStatus lastDecodeError = 0;
     };
-    std::string outputDir;
+    MovFile &file;
+    std::shared_ptr<MovFile> owner; // null for the reader owned by the file
+    std::mutex decodeLock;
+    Session session;
+    MovBufferPool::Lease readBuffer;
+    int lastDecodeSample   = -1;
+    int lastDecodeKeyFrame = 0;
+
+public:
+    MovReader(MovFile &file, std::shared_ptr<MovFile> owner);
+
+    /// creates the session once the format is known
+    OSStatus prepare();
+    int decodeSample(CMTime atTime, std::function<void(OSStatus status, CVPixelBufferRef image)> callback) override;
+    void cancelReading() override;
+};
 
+class MovFile : public IMovFile, public std::enable_shared_from_this<MovFile> {
+    static constexpr size_t kFinishBatchSize = 4 * 1024 * 1024; // bytes of samples in one buffer for the asset writer
+    friend class MovFileDelegate;
+    friend class MovReader;
+    typedef CFObject<VTCompressionSessionRef, id, releaseVTCompressionSession> Writer;
     CFObject<CMVideoFormatDescriptionRef> videoFormat;
-    CMTime lastInputFrameTime = kCMTimeInvalid;
+    MovTick lastInputFrameTime = kMovTickInvalid;
     bool lazyWriter = false;
-    
-    int lastDecodeSample = -1;
-    int lastDecodeKeyFrame = 0;
+
     std::atomic<OSStatus> lastEncodeError;
 
-    uint32_t maxFrameSize = 0;
     EncodeQuality quality;
-    std::vector<uint8_t> readerCache;
 
-    std::vector<MovSeg*> segments;
-    std::mutex segLock;
     std::mutex encodeLock;
-    std::mutex decodeLock;
-
-    Reader reader;
+    MovReorderBuffer<CFObject<CVPixelBufferRef>> reorder = MovReorderBuffer<CFObject<CVPixelBufferRef>>(timeBase); // guarded by encodeLock
+    MovAdmissionController admission;
+
+    // per sample arrays of the buffer being handled, kept like batchSyncs to avoid allocating each time
+    std::vector<size_t> batchSizes;
+    std::vector<MovTick> batchTimes;
+    std::vector<EncodedSample::Sync> batchSyncFlags;
+    std::vector<CMSampleTimingInfo> batchTimings;
+    std::vector<uint8_t> contiguousData; // a frame of a non-contiguous block buffer, grows to the largest of them
+    bool readerPrepared = false; // by autoCreateReaderOnWriting, later decodes prepare the reader themselves
+
+    std::shared_ptr<MovBufferPool> readBuffers = std::make_shared<MovBufferPool>();
+    std::unique_ptr<MovReader> reader; // serves decodeSample and cancelReading of the file
     Writer writer;
     VTCompressionOutputHandler writerCallback;
 
@@ -356,25 +122,16 @@ public:
 
     MovFile(int frameRate, int timeScale, int width, int height, EncodeQuality quality, const char *outputPath, int maxKeyFrameInterval)
     : IMovFile(frameRate, timeScale, width, height, outputPath, maxKeyFrameInterval), quality(quality) {
-        outputDir = dirname((char *)outputPath); // safe in darwin or ios, but not in glibc
-        struct stat sb;
-        if (stat(outputDir.c_str(), &sb) != 0) {
-            mkdir(outputDir.c_str(), 0777);
-        } else if (!S_ISDIR(sb.st_mode)){
-            unlink(outputDir.c_str());
-            mkdir(outputDir.c_str(), 0777);
-        }
-        readerCache.reserve((width * height)>> 3);
+        bytesPerSecond = bitRate() / 8;
+        reader = std::make_unique<MovReader>(*this, nullptr);
         lastEncodeError = 0;
+        // a second of frames in one buffer, larger ones grow them once
+        batchSizes.reserve(frameRate);
+        batchTimes.reserve(frameRate);
+        batchSyncFlags.reserve(frameRate);
+        batchTimings.reserve(frameRate);
     }
     
-    virtual ~MovFile() {
-        for (auto &&seg : segments) {
-            seg->fd = FD();
-            remove(seg->path.data());
-        }
-    }
-
     OSStatus createWriter() {
         lazyWriter = false;
         Writer writer;
@@ -399,6 +156,7 @@ public:
         };
 
         writerCallback = ^(OSStatus status, VTEncodeInfoFlags infoFlags, CMSampleBufferRef  _Nullable sampleBuffer) {
+            MOV_TRACE_SPAN("encoder callback");
             auto movFile = strongThis();
             if (!movFile) {
                 return;
@@ -407,6 +165,9 @@ public:
                 movFile->lastEncodeError = status ?: kVTInvalidSessionErr;
                 return;
             }
+            if (movFile->admissionControl) {
+                movFile->admission.completed(movFile->ticksForTime(CMSampleBufferGetPresentationTimeStamp(sampleBuffer)), nowMicros());
+            }
             if (!(infoFlags & kVTEncodeInfo_FrameDropped)) {
                 if (CMSampleBufferDataIsReady(sampleBuffer)) {
                     movFile->handleEncodedFrame(sampleBuffer);
@@ -415,7 +176,9 @@ public:
         };
         
         this->writer = std::move(writer);
-        lastInputFrameTime = kCMTimeInvalid;
+        lastInputFrameTime = kMovTickInvalid;
+        admission.reset();
+        admission.observer = admissionObserver;
         return 0;
     }
     
@@ -441,22 +204,6 @@ public:
         }
     }
 
-    OSStatus createReader() {
-        std::lock_guard<std::mutex> sentry(decodeLock);
-        if (this->reader) {
-            return 0;
-        }
-        Reader reader;
-        NSDictionary *destImageAttributes =@{
-#if TARGET_OS_IPHONE
-        (id)kCVPixelBufferOpenGLESCompatibilityKey: @(YES),
-#endif
-        (id)kCVPixelBufferPixelFormatTypeKey : @(kCVPixelFormatType_32BGRA)};
-        CheckStatusAndReturn(VTDecompressionSessionCreate(nullptr, videoFormat, nullptr, (__bridge CFDictionaryRef)destImageAttributes, nullptr, reader.out()));
-        this->reader = std::move(reader);
-        return 0;
-    }
-
     int pendingFrames() {
         CFObject<CFNumberRef> ret;
         if (writer) {
@@ -484,41 +231,10 @@ public:
         val.timescale = frameRate;
     }
 
-    MovSeg *findMovSeg(CMTime time) {
-        for (auto seg : segments) {
-            if (CMTimeCompare(time, seg->start) >= 0 && CMTimeCompare(time, seg->writeEnd) <= 0) {
-                return seg;
-            }
-        }
-        return nullptr;
+    MovTick ticksForTime(CMTime time) {
+        return timeBase.ticks(time.value, time.timescale);
     }
 
-    MovSeg &ensureMovSeg(CMTime time, bool *needInsert) {
-        
-        for (auto&& seg : segments) {
-            if (CMTimeCompare(time, seg->start) >= 0) {
-                *needInsert = false;
-                return *seg;
-            }
-        }
-        
-        
-        MovSeg& ret = *new MovSeg();
-        ret.start   = time;
-        ret.path    = outputDir + "/mov_data_seg" + std::to_string(time.value * timeScale / time.timescale);
-        ret.cacheToMemory = cacheFileToMemory;
-        if (!cacheFileToMemory) {
-            int fd   = open(ret.path.data(), O_CREAT | O_TRUNC | O_WRONLY, 0660);
-            int fd_r = open(ret.path.data(), O_RDONLY);
-            fcntl(fd_r, F_RDAHEAD, 1);
-            fcntl(fd_r, F_NOCACHE, 0);
-            ret.fd = fd;
-            ret.fd_r = fd_r;
-        }
-        *needInsert = true;
-        return ret;
-    }
-    
     int encodeSample(CMSampleBufferRef sample) override {
         if (CMSampleBufferGetDataBuffer(sample)) {
             return handleEncodedFrame(sample);
@@ -529,7 +245,6 @@ public:
     }
     
     int encodeFrame(CVPixelBufferRef buffer, CMTime frameTime) override {
-        VTEncodeInfoFlags flag = 0;
         if (lastEncodeError) {
             return lastEncodeError;
         }
@@ -537,229 +252,226 @@ public:
             createWriter();
         }
         fixTime(frameTime);
+        MovTick frameTick = ticksForTime(frameTime);
+        std::lock_guard<std::mutex> sentry(encodeLock);
+        reorder.window = reorderWindow;
+        reorder.maxHoldFrames = reorderMaxHoldFrames;
+        admission.policy = admissionPolicy;
+        return reorder.push(frameTick, CFObject<CVPixelBufferRef>(buffer), [this](MovTick tick, const CFObject<CVPixelBufferRef> &frame) {
+            return submitFrame(frame, tick);
+        });
+    }
+
+    /// frames come in time order from the reorder buffer unless the time jumps, called with encodeLock held
+    int submitFrame(CVPixelBufferRef buffer, MovTick frameTick) {
+        VTEncodeInfoFlags flag = 0;
+        CMTime frameTime = CMTimeMake(frameTick, timeScale);
         CFObject<CFMutableDictionaryRef> options;
-        CMTime _lastInputFrameTime = this->lastInputFrameTime;
-        if (!CMTIME_IS_VALID(_lastInputFrameTime) || CMTimeCompare(frameTime, _lastInputFrameTime) < 0 || CMTimeCompare(CMTimeSubtract(frameTime, _lastInputFrameTime), CMTimeMake(2, frameRate)) >=0) {
-            if (CMTIME_IS_VALID(lastEncodedFrameTime) && findMovSeg(frameTime)) {
+        MovTick _lastInputFrameTime = this->lastInputFrameTime;
+        if (_lastInputFrameTime == kMovTickInvalid || frameTick < _lastInputFrameTime || frameTick - _lastInputFrameTime >= timeBase.ticksForFrames(2)) {
+            if (lastEncodedFrameTime != kMovTickInvalid && findMovSeg(frameTick)) {
                 return 0;
             }
             options = [NSMutableDictionary new];
             CFDictionarySetValue(options, kVTEncodeFrameOptionKey_ForceKeyFrame, kCFBooleanTrue);
         }
-        std::lock_guard<std::mutex> sentry(encodeLock);
+        if (admissionControl) {
+            MovAdmissionSignals signals;
+            signals.pendingFrames = admissionPolicy.maxPendingFrames ? (uint32_t)pendingFrames() : 0;
+            signals.queuedWrites  = (uint32_t)io->queuedOperations();
+            auto decision = admission.admit(frameTick, options.get() != nullptr, signals, nowMicros());
+            // refused frames are not encoded, the muxer holds the sample before them through their slots
+            if (decision.action == MovAdmissionDecision::COALESCE) {
+                lastInputFrameTime = frameTick; // the next frame goes on from the held one
+                return 0;
+            }
+            if (decision.action == MovAdmissionDecision::DROP) {
+                return 0; // the next frame comes after a gap and becomes a key frame
+            }
+        }
+        MOV_TRACE_SPAN("encode submit");
         auto session = writer.get();
         OSStatus err = !session ? kVTInvalidSessionErr : VTCompressionSessionEncodeFrameWithOutputHandler(session, buffer, frameTime, kCMTimeInvalid, options, &flag, writerCallback);
         if (err) {
             writer = nullptr;
             writerCallback = nullptr;
+        } else if (admissionControl) {
+            admission.submitted(frameTick, nowMicros());
         }
-        lastInputFrameTime = frameTime;
+        lastInputFrameTime = frameTick;
         return err;
     }
     
-    static bool validateSampleData(const char *dataPointer, size_t totalLength) {
-        int i = 0;
-        while(i < totalLength) {
-            buint& size = *(buint*)(dataPointer + i);
-            uint k = size;
-            i += k + 4;
+    void configureCodec() {
+        CMVideoCodecType subType = CMFormatDescriptionGetMediaSubType(videoFormat);
+        int lengthSize = 0;
+        if (subType == kCMVideoCodecType_HEVC) {
+            codec = CODEC_HEVC;
+            if (@available(iOS 11, *)) {
+                CMVideoFormatDescriptionGetHEVCParameterSetAtIndex(videoFormat, 0, nullptr, nullptr, nullptr, &lengthSize);
+            }
+        } else {
+            codec = CODEC_H264;
+            CMVideoFormatDescriptionGetH264ParameterSetAtIndex(videoFormat, 0, nullptr, nullptr, nullptr, &lengthSize);
+        }
+        if (lengthSize > 0) {
+            nalLengthSize = lengthSize;
         }
-        return i == totalLength;
     }
 
+    /// CoreMedia adapter of the muxer
     int handleEncodedFrame(CMSampleBufferRef frame) {
-        bool isKeyFrame = ![[(__bridge NSDictionary *)CFArrayGetValueAtIndex(CMSampleBufferGetSampleAttachmentsArray(frame, true), 0) objectForKey:(__bridge NSString *)kCMSampleAttachmentKey_NotSync] boolValue];
-
         if (!videoFormat) {
             videoFormat = CMSampleBufferGetFormatDescription(frame);
+            configureCodec();
         }
         
-        if (!reader && autoCreateReaderOnWriting) {
-            createReader();
+        // once, prepare takes the decode lock and creates the session
+        if (autoCreateReaderOnWriting && !readerPrepared) {
+            readerPrepared = reader->prepare() == 0;
         }
 
-        CMTime decodeTime           = CMSampleBufferGetDecodeTimeStamp(frame);
-        CMTime presentTime          = CMSampleBufferGetPresentationTimeStamp(frame);
-        assert(!CMTIME_IS_VALID(decodeTime) || (CMTimeCompare(decodeTime, presentTime) == 0 && "time differs is not supported"));
-        bool needInsert;
-        MovSeg &seg = ensureMovSeg(presentTime, &needInsert);
-        std::unique_ptr<MovSeg> segCleaner;
-        if (needInsert) {
-            segCleaner = std::unique_ptr<MovSeg>(&seg);
-        }
-        if (!isKeyFrame && !seg.chunkSampleSizes.size()) {
-            return kVTVideoEncoderNotAvailableNowErr;
+        EncodedSample sample;
+        CFArrayRef attachments = CMSampleBufferGetSampleAttachmentsArray(frame, false);
+        if (attachments && CFArrayGetCount(attachments) > 0) {
+            auto notSync = (CFBooleanRef)CFDictionaryGetValue((CFDictionaryRef)CFArrayGetValueAtIndex(attachments, 0), kCMSampleAttachmentKey_NotSync);
+            if (notSync) {
+                sample.sync = CFBooleanGetValue(notSync) ? EncodedSample::NOT_SYNC : EncodedSample::SYNC;
+            }
         }
-        CMTime segTime       = CMTimeSubtract(presentTime, seg.start);
-        int sampleNum        = (int)(segTime.value * frameRate / segTime.timescale);
+        CMTime decodeTime = CMSampleBufferGetDecodeTimeStamp(frame);
+        sample.pts = ticksForTime(CMSampleBufferGetPresentationTimeStamp(frame));
+        sample.dts = CMTIME_IS_VALID(decodeTime) ? ticksForTime(decodeTime) : kMovTickInvalid;
         
         size_t totalLength;
+        size_t lengthAtOffset;
         char *dataPointer;
         CMBlockBufferRef dataBuffer = CMSampleBufferGetDataBuffer(frame);
-        OSStatus err = CMBlockBufferGetDataPointer(dataBuffer, 0, NULL, &totalLength, &dataPointer);
-        if (seg.sampleSizes.size() && CMTimeCompare(presentTime, seg.start) >= 0 && CMTimeCompare(presentTime, seg.writeEnd) <= 0) {
-            std::lock_guard<std::mutex> sentry(segLock);
-            assert(isKeyFrame);
-            seg.writeEnd = presentTime.value == 0 ? kCMTimeZero : CMTimeSubtract(presentTime, CMTimeMake(1, frameRate));
-            seg.eraseFrameNotLessThan(sampleNum);
-            lastEncodedFrameTime = seg.writeEnd;
-        }
-        assert(!CMTIME_IS_VALID(lastEncodedFrameTime) || CMTimeSubtract(presentTime, lastEncodedFrameTime).value != 0);
-        int offset   = seg.fileSize;
-        if (err == noErr) {
-            assert(validateSampleData(dataPointer, totalLength));
-            maxFrameSize = MAX(maxFrameSize, (uint32_t)totalLength);
-            if (seg.append(dataPointer, totalLength) == -1) {
-                return errno;
+        CheckStatusAndReturn(CMBlockBufferGetDataPointer(dataBuffer, 0, &lengthAtOffset, &totalLength, &dataPointer));
+        if (lengthAtOffset < totalLength) {
+            // copied rather than made contiguous by a new block buffer, ingest copies the data before returning
+            contiguousData.resize(totalLength);
+            CheckStatusAndReturn(CMBlockBufferCopyDataBytes(dataBuffer, 0, totalLength, contiguousData.data()));
+            dataPointer = (char *)contiguousData.data();
+        }
+        sample.data = (const uint8_t *)dataPointer;
+        sample.size = totalLength;
+        
+        CMItemCount sampleCount = CMSampleBufferGetNumSamples(frame);
+        size_t sizeCount = 0;
+        if (sampleCount > 1 && CMSampleBufferGetSampleSizeArray(frame, 0, nullptr, &sizeCount) == noErr && sizeCount == sampleCount) {
+            batchSizes.resize(sampleCount);
+            batchTimes.resize(sampleCount);
+            batchSyncFlags.resize(sampleCount);
+            batchTimings.resize(sampleCount);
+            size_t *sizes = batchSizes.data();
+            MovTick *times = batchTimes.data();
+            EncodedSample::Sync *syncs = batchSyncFlags.data();
+            CMSampleTimingInfo *timings = batchTimings.data();
+            CMSampleBufferGetSampleSizeArray(frame, sampleCount, sizes, nullptr);
+            CMItemCount timingCount = 0;
+            bool timed = CMSampleBufferGetSampleTimingInfoArray(frame, sampleCount, timings, &timingCount) == noErr && timingCount == sampleCount;
+            CFIndex attachmentCount = attachments ? CFArrayGetCount(attachments) : 0;
+            for (CMItemCount i = 0; timed && i < sampleCount; ++i) {
+                timed = CMTIME_IS_VALID(timings[i].presentationTimeStamp);
+            }
+            for (CMItemCount i = 0; i < sampleCount; ++i) {
+                times[i] = timed ? ticksForTime(timings[i].presentationTimeStamp) : sample.pts + timeBase.ticksForFrames(i);
+                syncs[i] = EncodedSample::SYNC_UNKNOWN;
+                if (i < attachmentCount) {
+                    auto notSync = (CFBooleanRef)CFDictionaryGetValue((CFDictionaryRef)CFArrayGetValueAtIndex(attachments, i), kCMSampleAttachmentKey_NotSync);
+                    if (notSync) {
+                        syncs[i] = CFBooleanGetValue(notSync) ? EncodedSample::NOT_SYNC : EncodedSample::SYNC;
+                    }
+                }
             }
-            seg.writeEnd = presentTime;
-        } else {
-            return err;
+            EncodedBatch batch;
+            batch.data        = sample.data;
+            batch.count       = sampleCount;
+            batch.sampleSizes = sizes;
+            batch.pts         = times;
+            batch.syncs       = syncs;
+            return ingestBatch(batch);
         }
-        lastEncodedFrameTime = presentTime;
-        // assert(sampleNum == seg.sampleSizes.size());
-        std::lock_guard<std::mutex> sentry(segLock);
-        seg.sampleSizes.push_back((int)totalLength);
-        if (isKeyFrame) {
-            seg.keyFrames.push_back(sampleNum + 1);
-            uint chunkNum = (uint)seg.chunkOffsets.size() + 1;
-            seg.chunkOffsets.push_back(offset);
-            if (seg.chunkSampleSizes.size() > 1) {
-                int prevSampleSize = ((&seg.chunkSampleSizes.back()) - 1)->sampleSize;
-                if (seg.chunkSampleSizes.back().sampleSize == prevSampleSize) {
-                    seg.chunkSampleSizes.pop_back();
-                }
+        return ingest(sample);
+    }
+
+    OSStatus completeFrames() override {
+        {
+            std::lock_guard<std::mutex> sentry(encodeLock);
+            if (int err = reorder.flush([this](MovTick tick, const CFObject<CVPixelBufferRef> &frame) {
+                return submitFrame(frame, tick);
+            })) {
+                return err;
             }
-            seg.chunkSampleSizes.push_back({chunkNum, 0});
         }
-        seg.chunkSampleSizes.back().sampleSize++;
-        if (needInsert) {
-            segments.insert(segments.begin(), segCleaner.release());
+        if (!lazyWriter || writer){
+            return VTCompressionSessionCompleteFrames(writer, kCMTimeInvalid) ?: (OSStatus)lastEncodeError;
         }
         return 0;
     }
 
-    void mergeSegments(MovSeg &finalSeg) {
-        uint32_t fileSize   = 0;
-        uint32_t chunkCount = 0;
-        uint32_t sampleSize = 0;
-        for (auto&& seg : segments) {
-            assert(seg->check());
-            assert(CMTimeCompare(finalSeg.writeEnd, seg->writeEnd) <= 0);
-            finalSeg.writeEnd = seg->writeEnd;
-            finalSeg.sampleSizes.insert(finalSeg.sampleSizes.end(), seg->sampleSizes.begin(), seg->sampleSizes.end());
-            for (auto &&frame : seg->keyFrames) {
-                finalSeg.keyFrames.push_back(frame + sampleSize);
-            }
-            for (auto &&offset : seg->chunkOffsets) {
-                finalSeg.chunkOffsets.push_back(offset + fileSize);
-            }
-            auto &&begin = seg->chunkSampleSizes.begin();
-            if (finalSeg.chunkSampleSizes.size() && begin->sampleSize == finalSeg.chunkSampleSizes.back().sampleSize) {
-                ++begin;
-            }
-            for (; begin != seg->chunkSampleSizes.end(); ++begin) {
-                finalSeg.chunkSampleSizes.push_back({ begin->firstChunk + chunkCount, begin->sampleSize });
+    int stitch(IMovFile &range) override {
+        auto &other = static_cast<MovFile &>(range);
+        if (!other.videoFormat) {
+            return 0;
+        }
+        if (videoFormat) {
+            SampleFormat format = sampleFormat(), otherFormat = other.sampleFormat();
+            // avcC and hvcC hold the parameter sets
+            if (format.codecType != otherFormat.codecType || format.extension != otherFormat.extension) {
+                return kErrorParameterSetsDiffer;
             }
-            fileSize += seg->fileSize;
-            chunkCount += seg->chunkOffsets.size();
-            sampleSize += seg->sampleSizes.size();
         }
-
-        finalSeg.path     = outputPath;
-        finalSeg.fd       = open(finalSeg.path.data(), O_CREAT | O_RDWR, 0660);
-        finalSeg.fileSize = fileSize;
-        assert(finalSeg.validateChunks());
+        if (int err = adoptSegments(other)) {
+            return err;
+        }
+        if (!videoFormat) {
+            videoFormat = other.videoFormat;
+        }
+        return 0;
     }
-    
 
     void finishWriting(std::function<void(NSError *err)> completion) override {
-        if (!lazyWriter || writer){
-            if(auto err = VTCompressionSessionCompleteFrames(writer, kCMTimeInvalid) ?: (OSStatus)lastEncodeError) {
-                completion([NSError errorWithDomain:NSOSStatusErrorDomain code:err userInfo:nil]);
-                return;
-            }
-        }
-        if (segments.empty()) {
-            completion([NSError errorWithDomain:NSOSStatusErrorDomain code:-1 userInfo:@{NSLocalizedDescriptionKey:@"No media generated"}]);
+        if (OSStatus err = completeFrames()) {
+            completion([NSError errorWithDomain:NSOSStatusErrorDomain code:err userInfo:nil]);
             return;
         }
         if (finishConfig.way == BY_SYSTEM) {
-            finishWritingWithAVAsset(completion);
-            return;
-        }
-        MovSeg finalSeg = {};
-        mergeSegments(finalSeg);
-        
-        uint copyLastCount = finishConfig.copyLastFrameCount;
-        uint lastFrameSize = 0;
-        int lastFrameOffset = 0;
-        int lastKeyFrameOffset = 0;
-        uint batchCopySize = 0;
-        uint batchCopyCount = 0;
-        uint compensateCopyCount = 0;
-        int copyFrameInterval = maxKeyFrameInterval;
-        if (copyLastCount > 0) {
-            if (finalSeg.sampleSizes.empty()) {
-                completion([NSError errorWithDomain:NSOSStatusErrorDomain code:-1 userInfo:@{@"copy frame error": @"no frame to copy"}]);
-                return;
+            if (replayRecorder) {
+                replayRecorder->finish(finishConfig.way, finishConfig.copyLastFrameCount, finishConfig.fillMode, finishConfig.samplePerChunk,
+                                       finishConfig.chunkPolicy, finishConfig.chunkBytes, finishConfig.chunkDuration);
             }
-            lastFrameSize = finalSeg.sampleSizes.back();
-            auto lastKeyFrame = finalSeg.keyFrames.back() - 1;
-            auto sampleCount = finalSeg.sampleSizes.size();
-            auto populateStart = std::min(uint(lastKeyFrame + copyFrameInterval), uint(sampleCount + copyLastCount));
-            bool isLastKey = sampleCount == lastKeyFrame + 1;
-            
-            finalSeg.sampleSizes.reserve(finalSeg.sampleSizes.size() + copyLastCount);
-            auto leftCount = copyLastCount - (populateStart - sampleCount);
-            auto compensate = leftCount % copyFrameInterval;
-            leftCount -= compensate;
-            populateStart += compensate;
-            compensateCopyCount = uint(populateStart - sampleCount);
-            batchCopyCount = uint(leftCount / copyFrameInterval);
-            
-            finalSeg.sampleSizes.insert(finalSeg.sampleSizes.end(), compensateCopyCount, lastFrameSize);
-            long long copySize = lastFrameSize * compensateCopyCount;
-            for (uint i = 0 ; i < batchCopyCount; i++) {
-                finalSeg.sampleSizes.insert(finalSeg.sampleSizes.end(), finalSeg.sampleSizes.begin() + lastKeyFrame, finalSeg.sampleSizes.begin() + lastKeyFrame + copyFrameInterval);
-                if (!isLastKey) {
-                    finalSeg.keyFrames.push_back((uint)(populateStart + 1 + i * copyFrameInterval));
-                }
+            if (segments.empty()) {
+                completion([NSError errorWithDomain:NSOSStatusErrorDomain code:-1 userInfo:@{NSLocalizedDescriptionKey:@"No media generated"}]);
+                return;
             }
-            batchCopySize = std::accumulate(finalSeg.sampleSizes.begin() + lastKeyFrame, finalSeg.sampleSizes.begin() + lastKeyFrame + copyFrameInterval, 0u);
-            copySize += batchCopySize * batchCopyCount;
-            if (isLastKey) {
-                finalSeg.keyFrames.reserve(finalSeg.keyFrames.size() + copyLastCount);
-                for (uint i = 0 ; i < copyLastCount; i++) {
-                    finalSeg.keyFrames.push_back(lastKeyFrame + i + 2);
-                }
+            if (int err = io->flush()) {
+                completion([NSError errorWithDomain:NSPOSIXErrorDomain code:err userInfo:nil]);
+                return;
             }
-            
-            finalSeg.chunkSampleSizes.back().sampleSize += copyLastCount;
-            finalSeg.fileSize += copySize;
-            finalSeg.writeEnd = CMTimeAdd(finalSeg.writeEnd, CMTimeMakeWithSeconds(copyLastCount / (double)frameRate, timeScale));
-            lastFrameOffset = int(- copySize - lastFrameSize);
-            lastKeyFrameOffset = lastFrameOffset - std::accumulate(finalSeg.sampleSizes.begin() + lastKeyFrame, finalSeg.sampleSizes.begin() + sampleCount - 1 , 0u);
+            finishWritingWithAVAsset(completion);
+            return;
         }
-        
-        reorderChunks(finalSeg);
-        
-        FileTypeAtom fileTypeAtom = {};
-        MediaDataAtom mediaData   = {};
-        CMTime cmduration = CMTimeAdd(finalSeg.writeEnd, CMTimeMake(1, frameRate));
-        int64_t duration          = cmduration.value * timeScale / cmduration.timescale;
-        time_t now                = time(NULL);
-        uint64_t createTime       = dateConvert(now);
-        MovieAtom movieAtom = MovieAtom(createTime, createTime, timeScale, frameRate, duration, width, height);
         assert(videoFormat);
+        completion(finishNSError(finish(sampleFormat())));
+    }
+
+    NSError *exportKeyFrameMovie(const char *path) override {
+        if (!videoFormat) {
+            return [NSError errorWithDomain:NSOSStatusErrorDomain code:-1 userInfo:@{NSLocalizedDescriptionKey:@"No media generated"}];
+        }
+        return finishNSError(exportKeyFrames(path, sampleFormat()));
+    }
+    
+    SampleFormat sampleFormat() {
+        SampleFormat format;
         CFDictionaryRef pixelApsectRation = (CFDictionaryRef) CMFormatDescriptionGetExtension(videoFormat, kCMFormatDescriptionExtension_PixelAspectRatio);
-        int hspacing = 0;
-        int vspacing  = 0;
         if (pixelApsectRation) {
             CFNumberRef cfhSpacing= (CFNumberRef) CFDictionaryGetValue(pixelApsectRation, kCMFormatDescriptionKey_PixelAspectRatioHorizontalSpacing);
             CFNumberRef cfvSpacing= (CFNumberRef) CFDictionaryGetValue(pixelApsectRation, kCMFormatDescriptionKey_PixelAspectRatioVerticalSpacing);
-            CFNumberGetValue(cfhSpacing, kCFNumberSInt32Type, &hspacing);
-            CFNumberGetValue(cfvSpacing, kCFNumberSInt32Type, &vspacing);
+            CFNumberGetValue(cfhSpacing, kCFNumberSInt32Type, &format.hspacing);
+            CFNumberGetValue(cfvSpacing, kCFNumberSInt32Type, &format.vspacing);
         }
         NSDictionary *extensionAtoms = (__bridge NSDictionary *) CMFormatDescriptionGetExtension(videoFormat, kCMFormatDescriptionExtension_SampleDescriptionExtensionAtoms);
         assert(extensionAtoms);
@@ -767,328 +479,152 @@ public:
         NSData *atomContent = [extensionAtoms objectForKey:extensionAtomType];
         assert(extensionAtomType);
         assert(atomContent);
-        VideoExtensionAtom extAtom;
-        extAtom.type = *(uint*) extensionAtomType.UTF8String;
-        extAtom.dataLength = (uint32_t)atomContent.length;
-        extAtom.atomData = atomContent.bytes;
+        format.extensionType = *(uint*) extensionAtomType.UTF8String;
+        format.extension.assign((const uint8_t *)atomContent.bytes, (const uint8_t *)atomContent.bytes + atomContent.length);
         CFStringRef formatName = (CFStringRef) CMFormatDescriptionGetExtension(videoFormat, kCMFormatDescriptionExtension_FormatName);
-        FourCharCode subType  = CMFormatDescriptionGetMediaSubType(videoFormat);
-        CMMediaType mediaType = CMFormatDescriptionGetMediaType(videoFormat);
-        assert(mediaType == kCMMediaType_Video);
-        movieAtom.videoTrack.media.mediaInfo.sampleTable.description.
-        data[0].fillIn(*(buint*)&subType,extAtom, CFStringGetCStringPtr(formatName, kCFStringEncodingASCII),hspacing, vspacing);
-        movieAtom.videoTrack.media.mediaInfo.sampleTable.handleInfo(finalSeg.sampleSizes, finalSeg.chunkOffsets, finalSeg.chunkSampleSizes, finalSeg.keyFrames);
-        movieAtom.calcSize();
-        uint dataSize     = finalSeg.fileSize;
-        mediaData.setSizeWithDataSize(dataSize, 0);
-        uint headerSize   = fileTypeAtom.size + mediaData.headerSize() + movieAtom.size;
-        uint dataOffset = headerSize;
-        movieAtom.videoTrack.media.mediaInfo.sampleTable.chunkOffsetAtom.updateOffset(dataOffset);
-        finalSeg.fileSize = dataSize + headerSize;
-        ftruncate(finalSeg.fd, finalSeg.fileSize);
-        auto mapSize            = finalSeg.fileSize;
-        void *base              = mmap(NULL, mapSize, PROT_WRITE, MAP_FILE | MAP_SHARED, finalSeg.fd, 0);
-        if (!isReadableAddress(base)) {
-            if (base != MAP_FAILED) {
-                munmap(base, mapSize);;
-            }
-            base = malloc(headerSize);
-            if (base == nullptr) {
-                completion([NSError errorWithDomain:NSOSStatusErrorDomain code:-1 userInfo:@{@"generate file error": @"no memory available"}]);
-                return;
-            }
-            auto addr               = (uint8_t *)base;
-            safewrite(fileTypeAtom);
-            safewrite(movieAtom);
-            addr = mediaData.writeTo(addr);
-            write(finalSeg.fd, base, headerSize);
-            free(base);
-            for (auto&& seg : segments) {
-                seg->writeToFD(finalSeg.fd);
-            }
-            if (copyLastCount > 0) {
-                char *compensateBuff = (char *) malloc(batchCopySize);// 补偿帧最大缓冲
-                if (compensateBuff == nullptr) {
-                    completion([NSError errorWithDomain:NSOSStatusErrorDomain code:-1 userInfo:@{@"generate file error": @"no memory available"}]);
-                    return;
-                }
-                pread(finalSeg.fd, compensateBuff, batchCopySize, mapSize + lastKeyFrameOffset);
-                
-                for (int i = 0; i < compensateCopyCount; i++) {
-                    write(finalSeg.fd, compensateBuff + (lastFrameOffset - lastKeyFrameOffset), lastFrameSize);
-                }
-                
-                for (int i = 0; i < batchCopyCount; i++) {
-                    write(finalSeg.fd, compensateBuff, batchCopySize);
-                }
-                free(compensateBuff);
-            }
-            completion(nil);
-            return;
-        }
-        auto addr               = (uint8_t *)base;
-        safewrite(fileTypeAtom);
-        safewrite(movieAtom);
-        addr = mediaData.writeTo(addr);
-        for (auto&& seg : segments) {
-            addr += seg->readToMemory(addr);
-        }
-        if (copyLastCount > 0) {
-            auto lastFrameAddr = (uint8_t *)base + mapSize + lastFrameOffset;
-            auto lastKeyFrameAddr = (uint8_t *)base + mapSize + lastKeyFrameOffset;
-            
-            for (int i = 0; i < compensateCopyCount; i++) {
-                assert(addr + lastFrameSize <= (uint8_t *)base + mapSize);
-                memcpy(addr, lastFrameAddr, lastFrameSize);
-                addr += lastFrameSize;
-            }
-            
-            for (int i = 0; i < batchCopyCount; i++) {
-                assert(addr + batchCopySize <= (uint8_t *)base + mapSize);
-                memcpy(addr, lastKeyFrameAddr, batchCopySize);
-                addr += batchCopySize;
-            }
-        }
-        
-        munmap(base, mapSize);
-        completion(nil);
-    }
-    
-    void reorderChunks(MovSeg& finalSeg) {
-        const uint samplePerChunk = finishConfig.samplePerChunk;
-        if (samplePerChunk == 0) {
-            return;
-        }
-        auto finalChunkCount = finalSeg.sampleSizes.size() / samplePerChunk;
-        auto leftCount = finalSeg.sampleSizes.size() % samplePerChunk;
-        if (leftCount) {
-            finalChunkCount++;
-        }
-        finalSeg.chunkSampleSizes.clear();
-        finalSeg.chunkSampleSizes.push_back({1, 60});
-        if (leftCount) {
-            finalSeg.chunkSampleSizes.push_back({static_cast<uint>(finalChunkCount), static_cast<uint>(leftCount)});
-        }
-        finalSeg.chunkOffsets.clear();
-        finalSeg.chunkOffsets.reserve(finalChunkCount);
-        uint offset = 0;
-        for (size_t i = 0, end = finalSeg.sampleSizes.size(); i < end; i++) {
-            if (i % samplePerChunk == 0) {
-                finalSeg.chunkOffsets.push_back(offset);
-            }
-            offset += finalSeg.sampleSizes[i];
+        if (const char *name = formatName ? CFStringGetCStringPtr(formatName, kCFStringEncodingASCII) : nullptr) {
+            format.formatName = name;
         }
+        format.codecType = CMFormatDescriptionGetMediaSubType(videoFormat);
+        assert(CMFormatDescriptionGetMediaType(videoFormat) == kCMMediaType_Video);
+        return format;
     }
     
+    /// feeds the writer in batches of kFinishBatchSize bytes as it becomes ready, so memory doesn't grow with the recording
     void finishWritingWithAVAsset(std::function<void(NSError *err)> completion) {
         @autoreleasepool {
             AVAssetWriter *writer = nil;
+            AVAssetWriterInput *input = nil;
             @try {
                 NSString *outputPath1 = [NSString stringWithUTF8String:outputPath.data()];
                 NSURL *url = [NSURL fileURLWithPath:outputPath1];
                 [NSFileManager.defaultManager removeItemAtPath:outputPath1 error:nil];
                 writer = [AVAssetWriter assetWriterWithURL:url fileType:AVFileTypeMPEG4 error:nil];
-                AVAssetWriterInput *input = [AVAssetWriterInput assetWriterInputWithMediaType:AVMediaTypeVideo outputSettings:nil sourceFormatHint:videoFormat];
+                input = [AVAssetWriterInput assetWriterInputWithMediaType:AVMediaTypeVideo outputSettings:nil sourceFormatHint:videoFormat];
                 writer.shouldOptimizeForNetworkUse = YES;
                 [writer addInput:input];
                 [writer startWriting];
                 [writer startSessionAtSourceTime:kCMTimeZero];
-                CFObject<CMSampleBufferRef> buf;
-                int err = mergeSamples(buf.out());
+            } @catch (NSException *exception) {
+                DLOG("%@",exception);
+                completion([NSError errorWithDomain:AVFoundationErrorDomain code:AVErrorUnknown userInfo:nil]);
+                return;
+            }
+            bool holdLast = finishConfig.fillMode != FILL_COPY;
+            auto samples = std::make_shared<MovSampleIterator>(segments, timeBase, kFinishBatchSize, holdLast ? 0 : finishConfig.copyLastFrameCount);
+            auto batch = std::make_shared<MovSampleIterator::Batch>();
+            auto self = shared_from_this();
+            dispatch_queue_t queue = dispatch_queue_create("IVTMovFile.finish", DISPATCH_QUEUE_SERIAL);
+            [input requestMediaDataWhenReadyOnQueue:queue usingBlock:^{
+                OSStatus err = 0;
+                bool done = false;
+                @try {
+                    while (input.readyForMoreMediaData) {
+                        if (!samples->next(*batch)) {
+                            err = samples->error();
+                            done = true;
+                            break;
+                        }
+                        CFObject<CMSampleBufferRef> buf;
+                        if ((err = self->createBatchSample(*batch, buf.out()))) {
+                            break;
+                        }
+                        if (![input appendSampleBuffer:buf]) {
+                            err = AVErrorUnknown;
+                            break;
+                        }
+                        if (batch->last) {
+                            done = true;
+                            break;
+                        }
+                    }
+                } @catch (NSException *exception) {
+                    DLOG("%@",exception);
+                    err = AVErrorUnknown;
+                }
+                if (!err && !done) {
+                    return; // called again when the input is ready
+                }
                 if (err) {
-                     completion([NSError errorWithDomain:NSOSStatusErrorDomain code:err userInfo:nil]);
+                    [writer cancelWriting];
+                    completion(writer.error ?: [NSError errorWithDomain:NSOSStatusErrorDomain code:err userInfo:nil]);
                     return;
                 }
-                [input appendSampleBuffer:buf];
                 [input markAsFinished];
                 [writer finishWritingWithCompletionHandler:^{
                     completion(writer.error);
                 }];
-            } @catch (NSException *exception) {
-                DLOG("%@",exception);
-                completion([NSError errorWithDomain:AVFoundationErrorDomain code:AVErrorUnknown userInfo:nil]);
-            }
+            }];
         }
-        
     }
-    
-    int mergeSamples(CMSampleBufferRef *outRef) {
-        int keyFrameCount = 0, sampleCount = 0, fileSize = 0;
-        for (auto seg : segments) {
-            keyFrameCount += seg->keyFrames.size();
-            fileSize += seg->fileSize;
-            sampleCount += seg->sampleSizes.size();
-        }
-        int copyLastCount = finishConfig.copyLastFrameCount;
-        int lastFrameSize = 0;
-        bool isLastKeyFrame = false;
-        if (copyLastCount > 0) {
-            lastFrameSize = segments.back()->sampleSizes.back();
-            fileSize += copyLastCount * lastFrameSize;
-            sampleCount += copyLastCount;
-            if (segments.back()->keyFrames.back() == segments.back()->sampleSizes.size()) {
-                isLastKeyFrame = true;
-            }
-        }
-        auto&& keyFrames = std::vector<uint>();
-        keyFrames.reserve(keyFrameCount);
-        auto&& sampleSizes = std::make_unique<size_t[]>(sampleCount);
-        auto data = malloc(fileSize);
-        if (!data) {
-            return kVTAllocationFailedErr;
-        }
-        uint frameOffset = 0, dataOffset = 0;
-        for (auto seg : segments) {
-            for (auto key : seg->keyFrames) {
-                keyFrames.push_back(key + frameOffset - 1);
-            }
-            std::copy_n(seg->sampleSizes.begin(), seg->sampleSizes.size(), sampleSizes.get() + frameOffset);
-            auto size = seg->fileSize;
-            auto readSize = seg->read(((char *)data) + dataOffset, size, 0);
-            assert(readSize == size);
-            frameOffset += seg->sampleSizes.size();
-            dataOffset += size;
-        }
-        
-        if (copyLastCount > 0) {
-            void * src = ((char *)data) + dataOffset - lastFrameSize;
-            for(int i = 0; i < copyLastCount ; ++i) {
-                memcpy(((char *)data) + dataOffset, src, lastFrameSize);
-                dataOffset += lastFrameSize;
-                sampleSizes[sampleCount - copyLastCount + i] = lastFrameSize;
-            }
-            if (isLastKeyFrame) {
-                auto lastKeyFrame = keyFrames.back();
-                for(int i = 1; i <= copyLastCount ; ++i) {
-                    keyFrames.push_back(lastKeyFrame + i);
-                }
-            }
-        }
-        
+
+    /// a sample buffer copying the samples of batch, the writer may keep it after the next batch is read
+    int createBatchSample(const MovSampleIterator::Batch &batch, CMSampleBufferRef *outRef) {
         CFObject<CMBlockBufferRef> blockBuffer;
-        CheckStatusAndReturn(CMBlockBufferCreateWithMemoryBlock(NULL, data, fileSize, kCFAllocatorMalloc, NULL, 0, fileSize, 0, blockBuffer.out()));
+        CheckStatusAndReturn(CMBlockBufferCreateWithMemoryBlock(NULL, NULL, batch.size, kCFAllocatorDefault, NULL, 0, batch.size, kCMBlockBufferAssureMemoryNowFlag, blockBuffer.out()));
+        CheckStatusAndReturn(CMBlockBufferReplaceDataBytes(batch.data, blockBuffer, 0, batch.size));
+        CMItemCount sampleCount = batch.sampleSizes.size();
         CMSampleTimingInfo timeInfoArray[1] = { {
             .duration = CMTimeMake(1, frameRate),
-            .presentationTimeStamp = kCMTimeZero,
+            .presentationTimeStamp = CMTimeMake(batch.firstFrame, frameRate),
             .decodeTimeStamp = kCMTimeInvalid,
         } };
+        // the asset writer takes no edit list, the last sample lasts for the filled frames instead, held samples for the frames they hold
+        uint32_t fillCount = batch.last && finishConfig.fillMode != FILL_COPY ? finishConfig.copyLastFrameCount : 0;
+        std::unique_ptr<CMSampleTimingInfo[]> holdTimeInfo;
+        if (fillCount > 0 || std::any_of(batch.frames.begin(), batch.frames.end(), [](uint32_t frames) { return frames != 1; })) {
+            holdTimeInfo = std::make_unique<CMSampleTimingInfo[]>(sampleCount);
+            int64_t frame = batch.firstFrame;
+            for (int i = 0; i < sampleCount; ++i) {
+                holdTimeInfo[i] = timeInfoArray[0];
+                holdTimeInfo[i].presentationTimeStamp = CMTimeMake(frame, frameRate);
+                holdTimeInfo[i].duration = CMTimeMake(batch.frames[i], frameRate);
+                frame += batch.frames[i];
+            }
+            holdTimeInfo[sampleCount - 1].duration = CMTimeMake(batch.frames[sampleCount - 1] + fillCount, frameRate);
+        }
         //core media will crash without timeinfo;
-        CheckStatusAndReturn(CMSampleBufferCreate(NULL, blockBuffer, true, NULL, NULL, videoFormat, sampleCount, 1, timeInfoArray, sampleCount, sampleSizes.get(), outRef));
-        
+        CheckStatusAndReturn(CMSampleBufferCreate(NULL, blockBuffer, true, NULL, NULL, videoFormat, sampleCount, holdTimeInfo ? sampleCount : 1, holdTimeInfo ? holdTimeInfo.get() : timeInfoArray, sampleCount, batch.sampleSizes.data(), outRef));
+
         CFArrayRef attachmentArray = CMSampleBufferGetSampleAttachmentsArray(*outRef, true);
-        
-        for (auto frame : keyFrames) {
-            assert(frame < sampleCount);
-            CFMutableDictionaryRef dictionary = (CFMutableDictionaryRef)CFArrayGetValueAtIndex(attachmentArray, frame);
-            CFDictionarySetValue(dictionary, kCMSampleAttachmentKey_NotSync, kCFBooleanFalse);
-        }
-        for (uint i = sampleCount; i--; ) {
+        for (CMItemCount i = 0; i < sampleCount; ++i) {
             CFMutableDictionaryRef dictionary = (CFMutableDictionaryRef)CFArrayGetValueAtIndex(attachmentArray, i);
-            if (!CFDictionaryContainsKey(dictionary, kCMSampleAttachmentKey_NotSync)) {
-                CFDictionarySetValue(dictionary, kCMSampleAttachmentKey_NotSync, kCFBooleanTrue);
-            }
+            CFDictionarySetValue(dictionary, kCMSampleAttachmentKey_NotSync, batch.syncs[i] ? kCFBooleanFalse : kCFBooleanTrue);
         }
-        
         return 0;
     }
 
     int decodeSample(CMTime atTime, std::function<void(OSStatus status, CVPixelBufferRef image)> callback) override {
-        fixTime(atTime);
-        if(!reader && videoFormat) {
-            createReader();
-        }
-        MovSeg *seg = findMovSeg(atTime);
-        if (!seg) {
-            return kVTFrameSiloInvalidTimeStampErr;
-        }
-        
-        segLock.lock();
-        CMTime segTime = CMTimeSubtract(atTime, seg->start);
-        int sampleNum  = (int)(segTime.value * frameRate / segTime.timescale);
-        assert(sampleNum < seg->sampleSizes.size());
-        int targetSampleNum = sampleNum;
-        int keyFrame = seg->keyFrameForSample(targetSampleNum);
-        if (keyFrame < 0) {
-            return kVTParameterErr;
-        }
-        if (sampleNum != lastDecodeSample + 1) {
-            if (keyFrame == lastDecodeKeyFrame && sampleNum > lastDecodeSample) {
-                targetSampleNum = lastDecodeSample + 1;
-            } else {
-                targetSampleNum = keyFrame;
-            }
-        }
-        assert(targetSampleNum <= sampleNum);
-        int frameNum = sampleNum - targetSampleNum + 1;
-        size_t sizes[frameNum];
-        int totalSize = 0;
-        int offset  = seg->offsetForSample(targetSampleNum);
-        do {
-            size_t size = seg->sampleSizes[targetSampleNum];
-            int i = frameNum - (sampleNum - targetSampleNum) - 1;
-            sizes[i] = size;
-            totalSize += size;
-        } while (++targetSampleNum <= sampleNum);
-        segLock.unlock();
-        readerCache.reserve(MAX(maxFrameSize, totalSize));
-        auto readSize = seg->read(readerCache.data(), totalSize, offset);
-        assert(readSize == totalSize);
-        CFObject<CMBlockBufferRef> blockBuffer;
-        CheckStatusAndReturn(CMBlockBufferCreateWithMemoryBlock(NULL, readerCache.data(), totalSize, kCFAllocatorNull, NULL, 0, totalSize, 0, blockBuffer.out()));
-        CMSampleTimingInfo timeInfoArray[1] = { {
-            .duration = CMTimeMake(1, frameRate),
-            .presentationTimeStamp = atTime,
-            .decodeTimeStamp = kCMTimeInvalid,
-        } };
-        //core media will crash without timeinfo;
-        CFObject<CMSampleBufferRef> sampleBuffer;
-        CheckStatusAndReturn(CMSampleBufferCreate(NULL, blockBuffer, true, NULL, NULL, videoFormat, frameNum, 1, timeInfoArray, frameNum, sizes, sampleBuffer.out()));
-        
-        //setSampleAttachment(sampleBuffer, keyFrame == targetSampleNum);
-        __block ReaderFrameRef ref;
-        {
-            OSStatus error;
-            std::lock_guard<std::mutex> sentry(decodeLock);
-            auto session = reader.get();
-            if (session) {
-                error = VTDecompressionSessionDecodeFrameWithOutputHandler(session, sampleBuffer, 0, nullptr, ^(OSStatus status, VTDecodeInfoFlags infoFlags, CVImageBufferRef  _Nullable imageBuffer, CMTime presentationTimeStamp, CMTime presentationDuration) {
-                        ref.lastDecodedImage = imageBuffer;
-                        ref.lastDecodeError  = status;
-                });
-            } else {
-                return kVTInvalidSessionErr;
-            }
-            error = error ?: ref.lastDecodeError;
-            if (!ref.lastDecodedImage && !error) {
-                error = kVTVideoDecoderBadDataErr;
-            }
-            if (error) {
-                lastDecodeSample = -1;
-                reader = nullptr;
-                return error;
-            }
-        }
-        lastDecodeSample = sampleNum;
-        lastDecodeKeyFrame = keyFrame;
-        
-        callback(0, ref.lastDecodedImage);
-        return 0;
+        return reader->decodeSample(atTime, callback);
     }
 
     void cancelReading() override {
-        std::lock_guard<std::mutex> sentry(decodeLock);
-        reader = nullptr;
-        lastDecodeSample = -1;
+        reader->cancelReading();
+    }
+
+    std::shared_ptr<IMovReader> openReader() override {
+        return std::make_shared<MovReader>(*this, shared_from_this());
+    }
+
+    MovReorderStats reorderStats() override {
+        std::lock_guard<std::mutex> sentry(encodeLock);
+        return reorder.stats();
+    }
+
+    MovAdmissionStats admissionStats() override {
+        return admission.stats();
     }
 
     void cancelWriting() override {
         std::lock_guard<std::mutex> sentry(encodeLock);
+        reorder.reset();
         writer = nullptr;
         writerCallback = nullptr;
     }
 public:
-   static std::shared_ptr<IMovFile> create(int frameRate, int timeScale, int width, int height, EncodeQuality quality, const char *outputPath, int maxKeyFrameInterval, bool lazyWriter) {
+   static std::shared_ptr<IMovFile> create(int frameRate, int timeScale, int width, int height, EncodeQuality quality, const char *outputPath, int maxKeyFrameInterval, bool lazyWriter, double plannedDuration) {
        auto&& ret = std::shared_ptr<MovFile>((MovFile *)new MovFile(frameRate, timeScale, width, height, quality, outputPath, maxKeyFrameInterval));
+       ret->planCapacity(plannedDuration);
        if (!lazyWriter) {
            ret->createWriter();
        } else {
@@ -1098,8 +634,150 @@ public:
     }
 };
 
-std::shared_ptr<IMovFile> IMovFile::create(int frameRate, int timeScale, int width, int height, EncodeQuality quality, const char *outputPath, int maxKeyFrameInterval, bool lazyWriter) {
-    auto&& ret = MovFile::create(frameRate, timeScale, width, height, quality, outputPath, maxKeyFrameInterval, lazyWriter);
+MovReader::MovReader(MovFile &file, std::shared_ptr<MovFile> owner)
+: file(file), owner(std::move(owner)), readBuffer(file.readBuffers->acquire()) {}
+
+OSStatus MovReader::prepare() {
+    std::lock_guard<std::mutex> sentry(decodeLock);
+    if (session || !file.videoFormat) {
+        return 0;
+    }
+    NSDictionary *destImageAttributes =@{
+#if TARGET_OS_IPHONE
+    (id)kCVPixelBufferOpenGLESCompatibilityKey: @(YES),
+#endif
+    (id)kCVPixelBufferPixelFormatTypeKey : @(kCVPixelFormatType_32BGRA)};
+    CheckStatusAndReturn(VTDecompressionSessionCreate(nullptr, file.videoFormat, nullptr, (__bridge CFDictionaryRef)destImageAttributes, nullptr, session.out()));
+    return 0;
+}
+
+static void releasePin(void *refCon, void *, size_t) {
+    delete (std::shared_ptr<char> *)refCon;
+}
+
+/// a block buffer over the parts of view, each part holds its pin until the block buffer is freed
+static OSStatus createPinnedBlockBuffer(const MovCacheView &view, CMBlockBufferRef *blockBuffer) {
+    CheckStatusAndReturn(CMBlockBufferCreateEmpty(NULL, (uint32_t)view.parts.size(), 0, blockBuffer));
+    for (auto &&part : view.parts) {
+        CMBlockBufferCustomBlockSource source = {
+            .version = kCMBlockBufferCustomBlockSourceVersion,
+            .FreeBlock = releasePin,
+            .refCon = new std::shared_ptr<char>(part.pin),
+        };
+        if (OSStatus err = CMBlockBufferAppendMemoryBlock(*blockBuffer, (void *)part.data, part.length, kCFAllocatorNull, &source, 0, part.length, 0)) {
+            delete (std::shared_ptr<char> *)source.refCon;
+            CFRelease(*blockBuffer);
+            *blockBuffer = NULL;
+            return err;
+        }
+    }
+    return 0;
+}
+
+int MovReader::decodeSample(CMTime atTime, std::function<void(OSStatus status, CVPixelBufferRef image)> callback) {
+    file.fixTime(atTime);
+    prepare();
+    MovTick atTick = file.ticksForTime(atTime);
+    if (file.replayRecorder) {
+        file.replayRecorder->decode(atTick);
+    }
+    MovSeg *seg = file.findMovSeg(atTick);
+    if (!seg) {
+        return kVTFrameSiloInvalidTimeStampErr;
+    }
+
+    std::unique_lock<std::mutex> decodeSentry(decodeLock);
+    std::unique_lock<std::mutex> segSentry(file.segLock);
+    int sampleNum  = seg->sampleAtFrame(file.timeBase.framesForTicks(atTick - seg->start));
+    assert(sampleNum < seg->sampleSizes.size());
+    int targetSampleNum = sampleNum;
+    int keyFrame = seg->keyFrameForSample(targetSampleNum);
+    if (keyFrame < 0) {
+        return kVTParameterErr;
+    }
+    if (sampleNum != lastDecodeSample + 1) {
+        if (keyFrame == lastDecodeKeyFrame && sampleNum > lastDecodeSample) {
+            targetSampleNum = lastDecodeSample + 1;
+        } else {
+            targetSampleNum = keyFrame;
+        }
+    }
+    assert(targetSampleNum <= sampleNum);
+    int frameNum = sampleNum - targetSampleNum + 1;
+    size_t sizes[frameNum];
+    int totalSize = 0;
+    int offset  = seg->offsetForSample(targetSampleNum);
+    auto sampleSize = seg->sampleSizes.iteratorAt(targetSampleNum);
+    do {
+        size_t size = *sampleSize++;
+        int i = frameNum - (sampleNum - targetSampleNum) - 1;
+        sizes[i] = size;
+        totalSize += size;
+    } while (++targetSampleNum <= sampleNum);
+    // segments cached to memory are decoded in place, the pins keep the bytes while the writer goes on
+    MovCacheView view;
+    bool pinned = seg->pin(view, totalSize, offset);
+    segSentry.unlock();
+    CFObject<CMBlockBufferRef> blockBuffer;
+    if (pinned) {
+        CheckStatusAndReturn(createPinnedBlockBuffer(view, blockBuffer.out()));
+    } else {
+        auto &buffer = *readBuffer;
+        buffer.reserve(MAX(file.maxFrameSize, totalSize));
+        buffer.resize(totalSize);
+        MovTraceSpan readSpan("decode read");
+        auto readSize = seg->read(buffer.data(), totalSize, offset);
+        readSpan.end();
+        assert(readSize == totalSize);
+        CheckStatusAndReturn(CMBlockBufferCreateWithMemoryBlock(NULL, buffer.data(), totalSize, kCFAllocatorNull, NULL, 0, totalSize, 0, blockBuffer.out()));
+    }
+    CMSampleTimingInfo timeInfoArray[1] = { {
+        .duration = CMTimeMake(1, file.frameRate),
+        .presentationTimeStamp = atTime,
+        .decodeTimeStamp = kCMTimeInvalid,
+    } };
+    //core media will crash without timeinfo;
+    CFObject<CMSampleBufferRef> sampleBuffer;
+    CheckStatusAndReturn(CMSampleBufferCreate(NULL, blockBuffer, true, NULL, NULL, file.videoFormat, frameNum, 1, timeInfoArray, frameNum, sizes, sampleBuffer.out()));
+
+    __block ReaderFrameRef ref;
+    {
+        OSStatus error;
+        MOV_TRACE_SPAN("decode submit");
+        if (session) {
+            error = VTDecompressionSessionDecodeFrameWithOutputHandler(session, sampleBuffer, 0, nullptr, ^(OSStatus status, VTDecodeInfoFlags infoFlags, CVImageBufferRef  _Nullable imageBuffer, CMTime presentationTimeStamp, CMTime presentationDuration) {
+                    ref.lastDecodedImage = imageBuffer;
+                    ref.lastDecodeError  = status;
+            });
+        } else {
+            return kVTInvalidSessionErr;
+        }
+        error = error ?: ref.lastDecodeError;
+        if (!ref.lastDecodedImage && !error) {
+            error = kVTVideoDecoderBadDataErr;
+        }
+        if (error) {
+            lastDecodeSample = -1;
+            session = nullptr;
+            return error;
+        }
+    }
+    lastDecodeSample = sampleNum;
+    lastDecodeKeyFrame = keyFrame;
+    decodeSentry.unlock();
+
+    callback(0, ref.lastDecodedImage);
+    return 0;
+}
+
+void MovReader::cancelReading() {
+    std::lock_guard<std::mutex> sentry(decodeLock);
+    session = nullptr;
+    lastDecodeSample = -1;
+}
+
+std::shared_ptr<IMovFile> IMovFile::create(int frameRate, int timeScale, int width, int height, EncodeQuality quality, const char *outputPath, int maxKeyFrameInterval, bool lazyWriter, double plannedDuration) {
+    auto&& ret = MovFile::create(frameRate, timeScale, width, height, quality, outputPath, maxKeyFrameInterval, lazyWriter, plannedDuration);
     return std::move(ret);
 }
 
@@ -11,7 +11,14 @@
 
 #ifdef __cplusplus
 
+#include "IVTMovByteSwap.h"
 #include "IVTMovDataType.h"
+#include "IVTMovPackedTable.h"
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <string_view>
+#include <vector>
 namespace IVT {
 #define IdentityMatrix \
 { 1, 0, 0, 0, 1, 0, 0, 0, 1 }
@@ -197,30 +204,55 @@ struct PACKED() TrackHeaderAtom : FullAtom {
 };
 
 struct EditListAtom : FullAtom {
-    static constexpr int curEntries = 1;
-    const bint numberOfEntries      = curEntries;
-    struct PACKED() {
-        buint64_t duration PACKED();
-        buint64_t mediaStart PACKED();
-        bff32 rate = 1.0;
-    } listTable[curEntries];
+    struct PACKED() Entry {
+        buint64_t duration PACKED();  // in the movie time scale
+        bint64_t mediaStart PACKED(); // in the media time scale, -1 for an empty edit
+        bff32 rate = 1.0;             // 0 dwells on mediaStart for the duration
+    };
+    typedef std::vector<Entry> List;
+    List entries;
+
+    /// plays the media of duration once if entries is empty
+    EditListAtom(uint64_t duration, List entries = {})
+        : FullAtom("elst")
+        , entries(std::move(entries)) {
+        if (this->entries.empty()) {
+            this->entries.push_back({ duration, 0, 1.0 });
+        }
+        calcSize();
+    }
+
+    static uint64_t totalDuration(uint64_t duration, const List &entries) {
+        if (entries.empty()) {
+            return duration;
+        }
+        uint64_t total = 0;
+        for (auto &&entry : entries) {
+            total += entry.duration;
+        }
+        return total;
+    }
 
-    EditListAtom(uint64_t duration)
-        : FullAtom("elst") {
-        listTable[0].duration = duration;
-        vf.version            = duration > UINT32_MAX;
-        size                  = sizeof(EditListAtom) - (vf.version ? 0 : 8);
+    size_t calcSize() {
+        vf.version = std::any_of(entries.begin(), entries.end(), [](const Entry &entry) {
+            return uint64_t(entry.duration) > UINT32_MAX || int64_t(entry.mediaStart) > INT32_MAX;
+        });
+        size = uint32_t(sizeof(FullAtom) + 4 + entries.size() * (vf.version ? sizeof(Entry) : 12));
+        return size;
     }
 
     DEF_WRITE {
         addr = FullAtom::writeTo(addr);
+        bint numberOfEntries = (int)entries.size();
         addr += copy<4>(addr, &numberOfEntries);
-        if (vf.version) {
-            addr += copy<sizeof(listTable)>(addr, &listTable);
-        } else {
-            addr += copy<4>(addr, &(bint32_t &)listTable[0].duration);
-            addr += copy<4>(addr, &(bint32_t &)listTable[0].mediaStart);
-            addr += copy<4>(addr, &listTable[0].rate);
+        for (auto &&entry : entries) {
+            if (vf.version) {
+                addr += copy<sizeof(Entry)>(addr, &entry);
+            } else {
+                addr += copy<4>(addr, &(bint32_t &)entry.duration);
+                addr += copy<4>(addr, &(bint32_t &)entry.mediaStart);
+                addr += copy<4>(addr, &entry.rate);
+            }
         }
         return addr;
     }
@@ -228,10 +260,15 @@ struct EditListAtom : FullAtom {
 
 struct EditAtom : Atom {
     EditListAtom editList;
-    EditAtom(uint64_t duration)
+    EditAtom(uint64_t duration, EditListAtom::List entries = {})
         : Atom("edts")
-        , editList(duration) {
-        size = sizeof(Atom) + editList.size;
+        , editList(duration, std::move(entries)) {
+        calcSize();
+    }
+
+    size_t calcSize() {
+        size = uint32_t(sizeof(Atom) + editList.calcSize());
+        return size;
     }
 
     DEF_WRITE {
@@ -380,7 +417,7 @@ struct PACKED() VideoSampleDescription {
 
 #if defined(DEBUG)
 #define safewrite(f) ({ \
-auto base = addr;  addr = f.writeTo(addr); assert(addr - base == (uint)f.size);\
+auto base = addr;  addr = f.writeTo(addr); MOV_ASSERT(addr - base == (uint)f.size);\
 })
 #else
 #define safewrite(f) addr = f.writeTo(addr)
@@ -416,7 +453,7 @@ struct PACKED() AVCCDesciption : Atom {
         pictureParameterSetLength  = ppsLength;
         sps                        = std::make_unique<uint8_t[]>(spsLength);
         copy<sizeofrange(AVCProfileIndication, AVCLevelIndication)>(&AVCProfileIndication, _sps + 1);
-        assert(AVCProfileIndication && AVCLevelIndication);
+        MOV_ASSERT(AVCProfileIndication && AVCLevelIndication);
         pps = std::make_unique<uint8_t[]>(ppsLength);
         std::copy_n(_sps, spsLength, sps.get());
         std::copy_n(_pps, ppsLength, pps.get());
@@ -504,18 +541,6 @@ struct PACKED() SampleDescriptionAtom : FullAtom {
     }
 };
 
-struct PACKED() SampleToTimeAtom : FullAtom {
-    bint entryCount = 1;
-    struct {
-        bint sampleCount;    // need set
-        bint sampleDuration; // need set
-    } entries[1];
-    SampleToTimeAtom()
-        : FullAtom(sizeof(SampleToTimeAtom), "stts") {}
-
-    DEF_SIMPLE_WRITE
-};
-
 template <class T = buint>
 struct PACKED() MovArray {
     bint entryCount;
@@ -524,10 +549,30 @@ struct PACKED() MovArray {
     MovArray() {}
 
     template <class K>
-    MovArray(std::vector<K> list) {
-        entries    = std::move(std::make_unique<T[]>(list.size()));
+    MovArray(const std::vector<K> &list) {
+        entries    = std::make_unique<T[]>(list.size());
         entryCount = list.size();
-        std::copy_n(list.begin(), list.size(), entries.get());
+        if constexpr (sizeof(T) == sizeof(K) && std::is_integral<K>::value && (sizeof(K) == 4 || sizeof(K) == 8)) {
+            using unsigned_type = typename sized_unsigned_type<sizeof(K)>::type;
+            auto dst = (unsigned_type *)entries.get();
+            auto src = (const unsigned_type *)list.data();
+            if constexpr (sizeof(K) == 4) {
+                MovByteSwap::swap32(dst, src, list.size());
+            } else {
+                MovByteSwap::swap64(dst, src, list.size());
+            }
+        } else {
+            std::copy_n(list.begin(), list.size(), entries.get());
+        }
+    }
+
+    MovArray(const MovPackedTable &table) {
+        static_assert(sizeof(T) == 4, "packed tables hold 32 bit values");
+        entries    = std::make_unique<T[]>(table.size());
+        entryCount = table.size();
+        auto dst   = (uint32_t *)entries.get();
+        table.copyTo(dst, 0, table.size());
+        MovByteSwap::swap32(dst, dst, table.size());
     }
 
     size_t size() {
@@ -543,6 +588,24 @@ struct PACKED() MovArray {
     }
 };
 
+struct PACKED() SampleToTimeAtom : FullAtom {
+    struct Entry {
+        bint sampleCount;
+        bint sampleDuration;
+    };
+    MovArray<Entry> entries;
+    SampleToTimeAtom()
+        : FullAtom("stts") {}
+
+    DEF_CALC_SIZE(sizeof(FullAtom) + entries.size())
+
+    DEF_WRITE {
+        addr = FullAtom::writeTo(addr);
+        addr = entries.writeTo(addr);
+        return addr;
+    }
+};
+
 struct PACKED() SyncSampleAtom : FullAtom {
     MovArray<> samples;
 
@@ -608,18 +671,15 @@ struct PACKED() ChunkOffsetAtom : FullAtom {
     }
     
     void updateOffset(int offset) {
-        int count = offsets.entryCount;
-        auto&& array = offsets.entries;
-        for (int i = count; i--; ) {
-            auto addr = array.get() + i;
-            *addr = *addr + offset;
-        }
+        auto array = (uint32_t *)offsets.entries.get();
+        MovByteSwap::addBigEndian32(array, array, (int)offsets.entryCount, offset);
     }
 };
 
 struct SampleTableAtom : Atom {
     SampleDescriptionAtom description;
     SampleToTimeAtom timeInfo; // no b frame;
+    uint32_t sampleDuration = 0; // of every sample if handleInfo gets no times, not written
     SyncSampleAtom syncSamples;
     SampleToChunkAtom sampleToChunk;
     SampleSizeAtom sizeAtom;
@@ -629,13 +689,17 @@ struct SampleTableAtom : Atom {
         : Atom("stbl")
         , description(width, height) {}
 
-    DEF_CALC_SIZE(sizeof(Atom) + description.calcSize() + timeInfo.size + syncSamples.calcSize()  + sampleToChunk.calcSize()+ sizeAtom.calcSize() + chunkOffsetAtom.calcSize())
+    DEF_CALC_SIZE(sizeof(Atom) + description.calcSize() + timeInfo.calcSize() + syncSamples.calcSize()  + sampleToChunk.calcSize()+ sizeAtom.calcSize() + chunkOffsetAtom.calcSize())
 
     void handleInfo(MovArray<> &&sampleSizes,
                     MovArray<> &&chunkOffsets,
                     MovArray<SampleToChunkAtom::SampleToChunkEntry> &&chunkSizes,
-                    MovArray<> &&keyFrames) {
-        timeInfo.entries[0].sampleCount = sampleSizes.entryCount;
+                    MovArray<> &&keyFrames,
+                    MovArray<SampleToTimeAtom::Entry> &&sampleTimes = {}) {
+        if (sampleTimes.entryCount == 0) {
+            sampleTimes = std::vector<SampleToTimeAtom::Entry>{ { sampleSizes.entryCount, sampleDuration } };
+        }
+        timeInfo.entries                = std::move(sampleTimes);
         sizeAtom.sampleSizes            = std::move(sampleSizes);
         chunkOffsetAtom.offsets         = std::move(chunkOffsets);
         sampleToChunk.sizes             = std::move(chunkSizes);
@@ -700,13 +764,14 @@ struct TrackAtom : Atom {
     EditAtom edits;
     MediaAtom media;
 
-    TrackAtom(uint64_t createTime, uint64_t modTime, uint32_t timescale, int64_t duration, uint32_t width, uint32_t height)
+    /// duration is of the media, the track lasts as long as the edits
+    TrackAtom(uint64_t createTime, uint64_t modTime, uint32_t timescale, int64_t duration, uint32_t width, uint32_t height, EditListAtom::List editList = {})
         : Atom("trak")
-        , header(createTime, modTime, duration, width, height)
-        , edits(duration)
+        , header(createTime, modTime, EditListAtom::totalDuration(duration, editList), width, height)
+        , edits(duration, std::move(editList))
         , media(createTime, modTime, timescale, duration, width, height) {}
 
-    DEF_CALC_SIZE(sizeof(Atom) + header.size + edits.size + media.calcSize())
+    DEF_CALC_SIZE(sizeof(Atom) + header.size + edits.calcSize() + media.calcSize())
 
     DEF_WRITE {
         addr = Atom::writeTo(addr);
@@ -721,11 +786,11 @@ struct MovieAtom : Atom {
     MovHeaderAtom header;
     TrackAtom videoTrack;
 
-    MovieAtom(uint64_t createTime, uint64_t modTime, uint32_t timescale, uint32_t frameRate, int64_t duration, uint32_t width, uint32_t height)
+    MovieAtom(uint64_t createTime, uint64_t modTime, uint32_t timescale, uint32_t frameRate, int64_t duration, uint32_t width, uint32_t height, EditListAtom::List editList = {})
         : Atom("moov")
-        , header(createTime, modTime, timescale, duration)
-        , videoTrack(createTime, modTime, timescale, duration, width, height) {
-        videoTrack.media.mediaInfo.sampleTable.timeInfo.entries[0].sampleDuration = timescale / frameRate;
+        , header(createTime, modTime, timescale, EditListAtom::totalDuration(duration, editList))
+        , videoTrack(createTime, modTime, timescale, duration, width, height, std::move(editList)) {
+        videoTrack.media.mediaInfo.sampleTable.sampleDuration = timescale / frameRate;
     }
 
     DEF_CALC_SIZE(sizeof(Atom) + header.size + videoTrack.calcSize());
@@ -0,0 +1,264 @@
+//
+//  IVTMovH264Synth.cpp
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#include "IVTMovH264Synth.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace IVT {
+
+namespace {
+
+class BitWriter {
+public:
+    std::vector<uint8_t> bytes;
+
+    void u(int count, uint32_t value) {
+        while (count--) {
+            bit((value >> count) & 1);
+        }
+    }
+
+    void ue(uint32_t value) {
+        uint64_t code = (uint64_t)value + 1;
+        int length = 0;
+        while ((code >> (length + 1)) != 0) {
+            ++length;
+        }
+        u(length, 0);
+        u(length + 1, (uint32_t)code);
+    }
+
+    void se(int32_t value) {
+        ue(value <= 0 ? (uint32_t)(-(int64_t)value * 2) : (uint32_t)value * 2 - 1);
+    }
+
+    void alignZero() {
+        while (bits) {
+            bit(0);
+        }
+    }
+
+    void byte(uint8_t value) {
+        u(8, value);
+    }
+
+    /// rbsp_trailing_bits
+    void trailing() {
+        bit(1);
+        alignZero();
+    }
+
+private:
+    uint8_t current = 0;
+    int bits        = 0;
+
+    void bit(uint32_t b) {
+        current = (uint8_t)(current << 1 | b);
+        if (++bits == 8) {
+            bytes.push_back(current);
+            current = 0;
+            bits    = 0;
+        }
+    }
+};
+
+/// NAL unit with emulation prevention bytes
+std::vector<uint8_t> nalUnit(int refIdc, int type, const std::vector<uint8_t> &rbsp) {
+    std::vector<uint8_t> nal;
+    nal.reserve(rbsp.size() + rbsp.size() / 64 + 1);
+    nal.push_back((uint8_t)(refIdc << 5 | type));
+    int zeros = 0;
+    for (uint8_t b : rbsp) {
+        if (zeros >= 2 && b <= 3) {
+            nal.push_back(3);
+            zeros = 0;
+        }
+        nal.push_back(b);
+        zeros = b == 0 ? zeros + 1 : 0;
+    }
+    return nal;
+}
+
+void appendLengthPrefixed(std::vector<uint8_t> &sample, const std::vector<uint8_t> &nal) {
+    uint32_t length = (uint32_t)nal.size();
+    uint8_t prefix[4] = { (uint8_t)(length >> 24), (uint8_t)(length >> 16), (uint8_t)(length >> 8), (uint8_t)length };
+    sample.insert(sample.end(), prefix, prefix + 4);
+    sample.insert(sample.end(), nal.begin(), nal.end());
+}
+
+uint8_t levelForFrameSize(int macroblocks) {
+    static const struct {
+        int maxFrameSize;
+        uint8_t level;
+    } levels[] = { { 1620, 30 }, { 3600, 31 }, { 5120, 32 }, { 8192, 40 }, { 22080, 50 }, { 36864, 51 } };
+    for (auto &&entry : levels) {
+        if (macroblocks <= entry.maxFrameSize) {
+            return entry.level;
+        }
+    }
+    return 60;
+}
+
+constexpr int kConstraintFlags = 0xc0; // constraint_set0 and 1, constrained baseline
+constexpr int kNALSlice = 1, kNALIDR = 5, kNALSPS = 7, kNALPPS = 8;
+constexpr int kMBTypeIPCM = 25;
+constexpr int kMBTypeI16x16DC = 3; // I_16x16_2_0_0, DC prediction without residual
+
+} // namespace
+
+MovColor MovColor::fromRGB(uint8_t r, uint8_t g, uint8_t b) {
+    auto clamp = [](double v) {
+        return (uint8_t)std::min(255.0, std::max(0.0, std::round(v)));
+    };
+    MovColor color;
+    color.y  = clamp(16 + (65.481 * r + 128.553 * g + 24.966 * b) / 255);
+    color.cb = clamp(128 + (-37.797 * r - 74.203 * g + 112.0 * b) / 255);
+    color.cr = clamp(128 + (112.0 * r - 93.786 * g - 18.214 * b) / 255);
+    return color;
+}
+
+MovH264Synth::MovH264Synth(int width, int height, MovColor color)
+: width(width), height(height), color(color), mbWidth((width + 15) / 16), mbHeight((height + 15) / 16) {
+    level = levelForFrameSize(mbWidth * mbHeight);
+
+    BitWriter sps;
+    sps.byte(MovH264Synth::kProfileIdc);
+    sps.byte(kConstraintFlags);
+    sps.byte(level);
+    sps.ue(0); // seq_parameter_set_id
+    sps.ue(kLog2MaxFrameNum - 4);
+    sps.ue(2); // pic_order_cnt_type, output order is decoding order
+    sps.ue(1); // max_num_ref_frames
+    sps.u(1, 0); // gaps_in_frame_num_value_allowed_flag
+    sps.ue(mbWidth - 1);
+    sps.ue(mbHeight - 1);
+    sps.u(1, 1); // frame_mbs_only_flag
+    sps.u(1, 1); // direct_8x8_inference_flag
+    int cropRight = (mbWidth * 16 - width) / 2, cropBottom = (mbHeight * 16 - height) / 2;
+    sps.u(1, cropRight || cropBottom);
+    if (cropRight || cropBottom) {
+        sps.ue(0);
+        sps.ue(cropRight);
+        sps.ue(0);
+        sps.ue(cropBottom);
+    }
+    sps.u(1, 0); // vui_parameters_present_flag
+    sps.trailing();
+    spsNAL = nalUnit(3, kNALSPS, sps.bytes);
+
+    BitWriter pps;
+    pps.ue(0); // pic_parameter_set_id
+    pps.ue(0); // seq_parameter_set_id
+    pps.u(1, 0); // entropy_coding_mode_flag, CAVLC
+    pps.u(1, 0); // bottom_field_pic_order_in_frame_present_flag
+    pps.ue(0); // num_slice_groups_minus1
+    pps.ue(0); // num_ref_idx_l0_default_active_minus1
+    pps.ue(0); // num_ref_idx_l1_default_active_minus1
+    pps.u(1, 0); // weighted_pred_flag
+    pps.u(2, 0); // weighted_bipred_idc
+    pps.se(0); // pic_init_qp_minus26
+    pps.se(0); // pic_init_qs_minus26
+    pps.se(0); // chroma_qp_index_offset
+    pps.u(1, 1); // deblocking_filter_control_present_flag
+    pps.u(1, 0); // constrained_intra_pred_flag
+    pps.u(1, 0); // redundant_pic_cnt_present_flag
+    pps.trailing();
+    ppsNAL = nalUnit(3, kNALPPS, pps.bytes);
+}
+
+std::vector<uint8_t> MovH264Synth::avcC() const {
+    std::vector<uint8_t> record = { 1, MovH264Synth::kProfileIdc, kConstraintFlags, level, 0xff, 0xe1 };
+    record.push_back((uint8_t)(spsNAL.size() >> 8));
+    record.push_back((uint8_t)spsNAL.size());
+    record.insert(record.end(), spsNAL.begin(), spsNAL.end());
+    record.push_back(1);
+    record.push_back((uint8_t)(ppsNAL.size() >> 8));
+    record.push_back((uint8_t)ppsNAL.size());
+    record.insert(record.end(), ppsNAL.begin(), ppsNAL.end());
+    return record;
+}
+
+MovMuxer::SampleFormat MovH264Synth::sampleFormat() const {
+    MovMuxer::SampleFormat format;
+    format.codecType = movFourCC("avc1");
+    memcpy(&format.extensionType, "avcC", 4);
+    format.extension  = avcC();
+    format.formatName = "H.264";
+    return format;
+}
+
+std::vector<uint8_t> MovH264Synth::idrFrame(uint32_t idrPicId) const {
+    BitWriter slice;
+    slice.ue(0); // first_mb_in_slice
+    slice.ue(7); // slice_type, I for the whole picture
+    slice.ue(0); // pic_parameter_set_id
+    slice.u(kLog2MaxFrameNum, 0); // frame_num
+    slice.ue(idrPicId);
+    slice.u(1, 0); // no_output_of_prior_pics_flag
+    slice.u(1, 0); // long_term_reference_flag
+    slice.se(0); // slice_qp_delta
+    slice.ue(1); // disable_deblocking_filter_idc, keeps the color exact
+
+    // the first macroblock carries the color, the others copy it from their neighbours with DC prediction
+    slice.ue(kMBTypeIPCM);
+    slice.alignZero();
+    uint8_t y = std::max<uint8_t>(color.y, 1), cb = std::max<uint8_t>(color.cb, 1), cr = std::max<uint8_t>(color.cr, 1);
+    for (int i = 0; i < 256; ++i) {
+        slice.byte(y);
+    }
+    for (int i = 0; i < 64; ++i) {
+        slice.byte(cb);
+    }
+    for (int i = 0; i < 64; ++i) {
+        slice.byte(cr);
+    }
+    for (int mb = 1; mb < mbWidth * mbHeight; ++mb) {
+        int x = mb % mbWidth, row = mb / mbWidth;
+        slice.ue(kMBTypeI16x16DC);
+        slice.ue(0); // intra_chroma_pred_mode, DC
+        slice.se(0); // mb_qp_delta
+        // coeff_token of the empty Intra16x16DCLevel, nC counts 16 coefficients for an I_PCM neighbour
+        bool left = x > 0, top = row > 0;
+        int nA = left && mb - 1 == 0 ? 16 : 0, nB = top && mb - mbWidth == 0 ? 16 : 0;
+        int nC = left && top ? (nA + nB + 1) >> 1 : left ? nA : nB;
+        if (nC < 2) {
+            slice.u(1, 1);
+        } else if (nC < 4) {
+            slice.u(2, 3);
+        } else if (nC < 8) {
+            slice.u(4, 15);
+        } else {
+            slice.u(6, 3);
+        }
+    }
+    slice.trailing();
+    std::vector<uint8_t> sample;
+    appendLengthPrefixed(sample, nalUnit(3, kNALIDR, slice.bytes));
+    return sample;
+}
+
+std::vector<uint8_t> MovH264Synth::skipFrame(uint32_t frameNum) const {
+    BitWriter slice;
+    slice.ue(0); // first_mb_in_slice
+    slice.ue(5); // slice_type, P for the whole picture
+    slice.ue(0); // pic_parameter_set_id
+    slice.u(kLog2MaxFrameNum, frameNum & ((1u << kLog2MaxFrameNum) - 1));
+    slice.u(1, 0); // num_ref_idx_active_override_flag
+    slice.u(1, 0); // ref_pic_list_modification_flag_l0
+    slice.u(1, 0); // adaptive_ref_pic_marking_mode_flag
+    slice.se(0); // slice_qp_delta
+    slice.ue(1); // disable_deblocking_filter_idc
+    slice.ue(mbWidth * mbHeight); // mb_skip_run
+    slice.trailing();
+    std::vector<uint8_t> sample;
+    appendLengthPrefixed(sample, nalUnit(2, kNALSlice, slice.bytes));
+    return sample;
+}
+
+} // namespace IVT
@@ -0,0 +1,72 @@
+//
+//  IVTMovH264Synth.h
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#ifndef IVTMovH264Synth_h
+#define IVTMovH264Synth_h
+
+#ifdef __cplusplus
+
+#include "IVTMovMuxer.h"
+#include <cstdint>
+#include <vector>
+
+namespace IVT {
+
+/// video range YCbCr, black by default
+struct MovColor {
+    uint8_t y  = 16;
+    uint8_t cb = 128;
+    uint8_t cr = 128;
+
+    /// BT.601
+    static MovColor fromRGB(uint8_t r, uint8_t g, uint8_t b);
+};
+
+/// Writes a constrained baseline H.264 stream of a solid color without an encoder, for placeholder movies.
+/// The IDR codes the first macroblock as I_PCM and predicts all the others by DC from it, so its size is a few bits a macroblock,
+/// the following frames skip every macroblock. Samples are NAL units with 4 byte length prefixes, sps and pps go to avcC.
+class MovH264Synth {
+public:
+    static constexpr uint8_t kProfileIdc = 66;
+
+    const int width;
+    const int height;
+    const MovColor color;
+
+    /// any even size, the frame is cropped from whole macroblocks
+    MovH264Synth(int width, int height, MovColor color = MovColor());
+
+    const std::vector<uint8_t> &sps() const {
+        return spsNAL;
+    }
+
+    const std::vector<uint8_t> &pps() const {
+        return ppsNAL;
+    }
+
+    /// AVCDecoderConfigurationRecord
+    std::vector<uint8_t> avcC() const;
+    /// the description of the samples for MovMuxer::finish
+    MovMuxer::SampleFormat sampleFormat() const;
+
+    /// a sync sample, consecutive IDRs need different idrPicId
+    std::vector<uint8_t> idrFrame(uint32_t idrPicId = 0) const;
+    /// a reference frame repeating the previous one, frameNum counts the frames since the IDR
+    std::vector<uint8_t> skipFrame(uint32_t frameNum) const;
+
+private:
+    static constexpr int kLog2MaxFrameNum = 16;
+    int mbWidth;
+    int mbHeight;
+    uint8_t level;
+    std::vector<uint8_t> spsNAL;
+    std::vector<uint8_t> ppsNAL;
+};
+
+} // namespace IVT
+#endif
+#endif /* IVTMovH264Synth_h */
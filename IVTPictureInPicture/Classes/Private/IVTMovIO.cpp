@@ -0,0 +1,381 @@
+//
+//  IVTMovIO.cpp
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#include "IVTMovIO.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<liburing.h>)
+#define IVT_HAS_IO_URING 1
+#endif
+#endif
+
+#if IVT_HAS_IO_URING
+#include <liburing.h>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+#endif
+
+namespace IVT {
+
+#if IVT_HAS_IO_URING
+
+/// Keeps up to queueDepth operations in flight on one ring, so a thread can drive many files at once.
+/// Writes are staged in registered buffers, copies chain a fixed read and a fixed write through one buffer.
+class MovUringIO : public MovIO {
+    static constexpr size_t kDirectAlign = 4096;
+
+    struct Op {
+        int fd            = -1;
+        char *buf         = nullptr;
+        size_t length     = 0;
+        off_t offset      = 0;
+        bool isWrite      = false;
+        int buffer        = -1;      // registered buffer released with this op
+        long *transferred = nullptr; // for reads waited by the caller
+        int *error        = nullptr;
+    };
+
+    io_uring ring;
+    bool fixedBuffers = false;
+    bool broken       = false;
+    size_t bufferSize;
+    std::vector<iovec> buffers;
+    std::vector<int> freeBuffers;
+    std::vector<Op> ops;
+    std::vector<int> freeOps;
+    std::unordered_map<int, int> directFds;
+    unsigned unsubmitted = 0;
+    int firstError       = 0;
+    std::mutex lock;
+
+    void submit() {
+        if (unsubmitted) {
+            io_uring_submit(&ring);
+            unsubmitted = 0;
+        }
+    }
+
+    io_uring_sqe *nextSqe() {
+        io_uring_sqe *sqe;
+        while (!(sqe = io_uring_get_sqe(&ring))) {
+            submit();
+        }
+        ++unsubmitted;
+        return sqe;
+    }
+
+    void recordError(const Op &op, int error) {
+        if (op.error && !*op.error) {
+            *op.error = error;
+        } else if (!firstError) {
+            firstError = error;
+        }
+    }
+
+    void complete(int index, int res) {
+        Op &op = ops[index];
+        if (res < 0) {
+            recordError(op, -res);
+        } else if (op.isWrite && (size_t)res < op.length) {
+            if (MovSyncIO::pwriteAll(op.fd, op.buf + res, op.length - res, op.offset + res) == -1) {
+                recordError(op, errno);
+            }
+        } else if (op.transferred) {
+            *op.transferred += res;
+        }
+        if (op.buffer >= 0) {
+            freeBuffers.push_back(op.buffer);
+        }
+        op = Op();
+        freeOps.push_back(index);
+    }
+
+    /// wait for one completion, false if the ring is unusable
+    bool reap() {
+        submit();
+        io_uring_cqe *cqe = nullptr;
+        int ret;
+        while ((ret = io_uring_wait_cqe(&ring, &cqe)) == -EINTR) {
+        }
+        if (ret < 0) {
+            broken = true;
+            return false;
+        }
+        int index = (int)(uintptr_t)io_uring_cqe_get_data(cqe);
+        int res   = cqe->res;
+        io_uring_cqe_seen(&ring, cqe);
+        complete(index, res);
+        return true;
+    }
+
+    void drain() {
+        while (freeOps.size() != ops.size() && reap()) {
+        }
+    }
+
+    int acquireOp() {
+        while (freeOps.empty()) {
+            if (!reap()) {
+                return -1;
+            }
+        }
+        int index = freeOps.back();
+        freeOps.pop_back();
+        return index;
+    }
+
+    int acquireBuffer() {
+        while (freeBuffers.empty()) {
+            if (!reap()) {
+                return -1;
+            }
+        }
+        int index = freeBuffers.back();
+        freeBuffers.pop_back();
+        return index;
+    }
+
+    void release(int op, int buffer) {
+        if (op >= 0) {
+            freeOps.push_back(op);
+        }
+        if (buffer >= 0) {
+            freeBuffers.push_back(buffer);
+        }
+    }
+
+    io_uring_sqe *prepare(int index) {
+        Op &op            = ops[index];
+        io_uring_sqe *sqe = nextSqe();
+        if (op.isWrite) {
+            if (fixedBuffers && op.buffer >= 0) {
+                io_uring_prep_write_fixed(sqe, op.fd, op.buf, (unsigned)op.length, op.offset, op.buffer);
+            } else {
+                io_uring_prep_write(sqe, op.fd, op.buf, (unsigned)op.length, op.offset);
+            }
+        } else {
+            if (fixedBuffers && op.buffer >= 0) {
+                io_uring_prep_read_fixed(sqe, op.fd, op.buf, (unsigned)op.length, op.offset, op.buffer);
+            } else {
+                io_uring_prep_read(sqe, op.fd, op.buf, (unsigned)op.length, op.offset);
+            }
+        }
+        io_uring_sqe_set_data(sqe, (void *)(uintptr_t)index);
+        return sqe;
+    }
+
+    int directFdFor(int fd) {
+        auto it = directFds.find(fd);
+        if (it != directFds.end()) {
+            return it->second;
+        }
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+        int directFd  = open(path, O_WRONLY | O_DIRECT);
+        directFds[fd] = directFd;
+        return directFd;
+    }
+
+public:
+    bool valid = false;
+
+    MovUringIO(unsigned queueDepth, size_t bufferSize)
+    : bufferSize((std::max<size_t>(bufferSize, kDirectAlign) + kDirectAlign - 1) & ~(kDirectAlign - 1)) {
+        queueDepth = std::max(queueDepth, 4u);
+        if (io_uring_queue_init(queueDepth, &ring, 0) != 0) {
+            return;
+        }
+        ops.resize(queueDepth);
+        for (int i = (int)queueDepth; i--;) {
+            freeOps.push_back(i);
+        }
+        for (unsigned i = 0, count = queueDepth / 2; i < count; ++i) {
+            void *ptr = nullptr;
+            if (posix_memalign(&ptr, kDirectAlign, this->bufferSize) != 0) {
+                break;
+            }
+            buffers.push_back({ ptr, this->bufferSize });
+            freeBuffers.push_back((int)i);
+        }
+        if (buffers.empty()) {
+            io_uring_queue_exit(&ring);
+            return;
+        }
+        fixedBuffers = io_uring_register_buffers(&ring, buffers.data(), (unsigned)buffers.size()) == 0;
+        valid        = true;
+    }
+
+    ~MovUringIO() {
+        if (valid) {
+            flush();
+            io_uring_queue_exit(&ring);
+        }
+        for (auto &&buffer : buffers) {
+            free(buffer.iov_base);
+        }
+    }
+
+    long write(int fd, const void *ptr, size_t length, off_t offset) override {
+        std::lock_guard<std::mutex> guard(lock);
+        drain();
+        return MovSyncIO::pwriteAll(fd, ptr, length, offset);
+    }
+
+    long read(int fd, void *ptr, size_t length, off_t offset) override {
+        std::lock_guard<std::mutex> guard(lock);
+        drain(); // reads must observe the queued writes
+        if (broken) {
+            return MovSyncIO::preadAll(fd, ptr, length, offset);
+        }
+        long transferred = 0;
+        int error        = 0;
+        for (size_t done = 0; done < length;) {
+            int index = acquireOp();
+            if (index < 0) {
+                return MovSyncIO::preadAll(fd, ptr, length, offset);
+            }
+            size_t chunk = std::min(bufferSize, length - done);
+            Op &op       = ops[index];
+            op.fd          = fd;
+            op.buf         = (char *)ptr + done;
+            op.length      = chunk;
+            op.offset      = offset + done;
+            op.transferred = &transferred;
+            op.error       = &error;
+            prepare(index);
+            done += chunk;
+        }
+        drain();
+        if (error) {
+            errno = error;
+            return -1;
+        }
+        return transferred;
+    }
+
+    int queueWrite(int fd, const void *ptr, size_t length, off_t offset) override {
+        std::lock_guard<std::mutex> guard(lock);
+        const char *src = (const char *)ptr;
+        while (length) {
+            int buffer = broken ? -1 : acquireBuffer();
+            int index  = buffer < 0 ? -1 : acquireOp();
+            if (index < 0) {
+                release(index, buffer);
+                return MovSyncIO::pwriteAll(fd, src, length, offset) == -1 ? errno : 0;
+            }
+            size_t chunk = std::min(bufferSize, length);
+            Op &op       = ops[index];
+            op.fd        = fd;
+            op.buf       = (char *)buffers[buffer].iov_base;
+            op.length    = chunk;
+            op.offset    = offset;
+            op.isWrite   = true;
+            op.buffer    = buffer;
+            memcpy(op.buf, src, chunk);
+            prepare(index);
+            src += chunk;
+            offset += chunk;
+            length -= chunk;
+        }
+        submit();
+        return 0;
+    }
+
+    int queueCopy(int inFd, off_t inOffset, int outFd, off_t outOffset, size_t length, bool direct) override {
+        std::lock_guard<std::mutex> guard(lock);
+        int directFd = direct ? directFdFor(outFd) : -1;
+        while (length) {
+            int buffer = broken ? -1 : acquireBuffer();
+            int readOp = buffer < 0 ? -1 : acquireOp();
+            int writeOp = readOp < 0 ? -1 : acquireOp();
+            if (writeOp < 0) {
+                release(readOp, buffer);
+                return MovSyncIO().queueCopy(inFd, inOffset, outFd, outOffset, length, false);
+            }
+            // the head is cut to reach the alignment, so the rest goes through O_DIRECT in whole pages
+            size_t chunk    = std::min(bufferSize, length);
+            size_t misalign = outOffset % kDirectAlign;
+            if (misalign) {
+                chunk = std::min(chunk, kDirectAlign - misalign);
+            }
+            bool aligned = directFd > 0 && !misalign && chunk % kDirectAlign == 0;
+            char *buf    = (char *)buffers[buffer].iov_base;
+
+            Op &r    = ops[readOp];
+            r.fd     = inFd;
+            r.buf    = buf;
+            r.length = chunk;
+            r.offset = inOffset;
+            io_uring_sqe_set_flags(prepare(readOp), IOSQE_IO_LINK);
+
+            Op &w      = ops[writeOp];
+            w.fd       = aligned ? directFd : outFd;
+            w.buf      = buf;
+            w.length   = chunk;
+            w.offset   = outOffset;
+            w.isWrite  = true;
+            w.buffer   = buffer;
+            prepare(writeOp);
+
+            inOffset += chunk;
+            outOffset += chunk;
+            length -= chunk;
+        }
+        submit();
+        return 0;
+    }
+
+    int flush() override {
+        std::lock_guard<std::mutex> guard(lock);
+        drain();
+        for (auto &&pair : directFds) {
+            if (pair.second > 0) {
+                close(pair.second);
+            }
+        }
+        directFds.clear();
+        int error  = firstError;
+        firstError = 0;
+        return error;
+    }
+
+    size_t queuedOperations() override {
+        std::lock_guard<std::mutex> guard(lock);
+        io_uring_cqe *cqe = nullptr;
+        while (!broken && io_uring_peek_cqe(&ring, &cqe) == 0) {
+            int index = (int)(uintptr_t)io_uring_cqe_get_data(cqe);
+            int res   = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+            complete(index, res);
+        }
+        return ops.size() - freeOps.size();
+    }
+};
+
+#endif
+
+std::shared_ptr<MovIO> MovIO::create(Kind kind, unsigned queueDepth, size_t bufferSize) {
+#if IVT_HAS_IO_URING
+    if (kind == IO_URING) {
+        auto io = std::make_shared<MovUringIO>(queueDepth, bufferSize);
+        if (io->valid) {
+            return io;
+        }
+    }
+#else
+    (void)kind;
+    (void)queueDepth;
+    (void)bufferSize;
+#endif
+    return sync();
+}
+
+} // namespace IVT
@@ -0,0 +1,195 @@
+//
+//  IVTMovIO.h
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#ifndef IVTMovIO_h
+#define IVTMovIO_h
+
+#ifdef __cplusplus
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <memory>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace IVT {
+
+struct FD {
+    int fd = 0;
+    FD() {}
+    FD(int fd): fd(fd) {
+    }
+    FD(const FD &) = delete;
+    FD(FD && o): fd(o.fd){
+        o.fd = 0;
+    };
+    FD &operator=(const FD &) = delete;
+    FD &operator=(FD &&o) {
+        int fd = o.fd;
+        o.fd = this->fd;
+        this->fd = fd;
+        return *this;
+    }
+    operator int() const {
+        return fd;
+    }
+    ~FD() {
+        if (fd) {
+            close(fd);
+        }
+    }
+};
+
+/// Backend of the segment reads and writes.
+/// Queued operations may complete asynchronously, errors of them are reported by flush.
+class MovIO {
+public:
+    enum Kind {
+        SYNC,
+        IO_URING, // linux only, falls back to SYNC elsewhere
+    };
+
+    virtual ~MovIO() {}
+
+    /// write all the bytes, -1 on error
+    virtual long write(int fd, const void *ptr, size_t length, off_t offset) = 0;
+    /// read up to length bytes, reads observe all the queued writes, -1 on error
+    virtual long read(int fd, void *ptr, size_t length, off_t offset) = 0;
+    /// the data is copied before returning, ptr can be reused at once
+    virtual int queueWrite(int fd, const void *ptr, size_t length, off_t offset) {
+        return write(fd, ptr, length, offset) == -1 ? errno : 0;
+    }
+    /// copy length bytes of inFd at inOffset to outFd at outOffset,
+    /// direct asks to bypass the page cache of outFd where the backend can
+    virtual int queueCopy(int inFd, off_t inOffset, int outFd, off_t outOffset, size_t length, bool direct) = 0;
+    /// wait for all the queued operations, returns the first error
+    virtual int flush() {
+        return 0;
+    }
+    /// operations queued and not completed yet, how far the backend lags behind the writers
+    virtual size_t queuedOperations() {
+        return 0;
+    }
+
+    static std::shared_ptr<MovIO> sync();
+    static std::shared_ptr<MovIO> create(Kind kind, unsigned queueDepth = 64, size_t bufferSize = 256 * 1024);
+};
+
+class MovSyncIO : public MovIO {
+public:
+    static long pwriteAll(int fd, const void *ptr, size_t length, off_t offset) {
+        const char *buf = (const char *)ptr;
+        long w = 0, total = length;
+        while (length != 0 && (w = pwrite(fd, buf, length, offset)) > 0) {
+            length -= w;
+            buf += w;
+            offset += w;
+        }
+        return length != 0 ? -1 : total;
+    }
+
+    static long preadAll(int fd, void *ptr, size_t length, off_t offset) {
+        char *buf = (char *)ptr;
+        long r = 0, total = 0;
+        while (length != 0 && (r = pread(fd, buf, length, offset)) > 0) {
+            length -= r;
+            buf += r;
+            offset += r;
+            total += r;
+        }
+        return r == -1 ? -1 : total;
+    }
+
+    long write(int fd, const void *ptr, size_t length, off_t offset) override {
+        return pwriteAll(fd, ptr, length, offset);
+    }
+
+    long read(int fd, void *ptr, size_t length, off_t offset) override {
+        return preadAll(fd, ptr, length, offset);
+    }
+
+    int queueCopy(int inFd, off_t inOffset, int outFd, off_t outOffset, size_t length, bool /* direct */) override {
+        char buff[16384];
+        while (length) {
+            long count = preadAll(inFd, buff, std::min(length, sizeof(buff)), inOffset);
+            if (count <= 0) {
+                return count == 0 ? EIO : errno;
+            }
+            if (pwriteAll(outFd, buff, count, outOffset) == -1) {
+                return errno;
+            }
+            length -= count;
+            inOffset += count;
+            outOffset += count;
+        }
+        return 0;
+    }
+};
+
+inline std::shared_ptr<MovIO> MovIO::sync() {
+    static auto io = std::make_shared<MovSyncIO>();
+    return io;
+}
+
+/// reserve disk blocks of [offset, offset + length) without changing the file size
+inline bool preallocateFile(int fd, off_t offset, off_t length) {
+    if (fd <= 0 || length <= 0) {
+        return false;
+    }
+#if defined(__APPLE__)
+    // F_PEOFPOSMODE allocates from the physical end of file, which is `offset` as long as all reservation goes here
+    fstore_t store = { F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, length, 0 };
+    if (fcntl(fd, F_PREALLOCATE, &store) == -1) {
+        store.fst_flags = F_ALLOCATEALL;
+        return fcntl(fd, F_PREALLOCATE, &store) != -1;
+    }
+    return true;
+#elif defined(__linux__)
+    return fallocate(fd, FALLOC_FL_KEEP_SIZE, offset, length) == 0;
+#else
+    return false;
+#endif
+}
+
+/// set the file to its final size, reserved blocks beyond it are released
+inline bool trimFile(int fd, off_t size) {
+    return fd > 0 && ftruncate(fd, size) == 0;
+}
+
+/// Grow the reservation of an append-only file in large extents,
+/// so appending one frame doesn't allocate blocks and update metadata each time
+struct MovPreallocation {
+    off_t extentSize = 0; // 0 means disabled
+    off_t reserved   = 0;
+
+    static constexpr off_t kMinExtent = 256 * 1024;
+    static constexpr off_t kMaxExtent = 64 * 1024 * 1024;
+
+    /// extent for bytesPerSecond of data lasting seconds
+    static off_t extentFor(long bytesPerSecond, double seconds) {
+        off_t size = (off_t)(bytesPerSecond * seconds);
+        size = std::min(std::max(size, kMinExtent), kMaxExtent);
+        return (size + 4095) & ~(off_t)4095;
+    }
+
+    void ensure(int fd, off_t end) {
+        if (extentSize == 0 || end <= reserved) {
+            return;
+        }
+        off_t grow = std::max(extentSize, end - reserved);
+        if (preallocateFile(fd, reserved, grow)) {
+            reserved += grow;
+        } else {
+            extentSize = 0; // not supported by the file system, stop trying
+        }
+    }
+};
+
+} // namespace IVT
+#endif
+#endif /* IVTMovIO_h */
@@ -0,0 +1,798 @@
+//
+//  IVTMovMuxer.cpp
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#include "IVTMovMuxer.h"
+#include "IVTMovReplay.h"
+#include "IVTMovTrace.h"
+#include "IVTMovValidator.h"
+#include <cmath>
+#include <libgen.h>
+#include <numeric>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/vm_map.h>
+#endif
+
+namespace IVT {
+
+static bool validateSampleData(const char *dataPointer, size_t totalLength) {
+    size_t i = 0;
+    while(i < totalLength) {
+        buint& size = *(buint*)(dataPointer + i);
+        uint k = size;
+        i += k + 4;
+    }
+    return i == totalLength;
+}
+
+static bool isReadableAddress(void * address) {
+    if (address == MAP_FAILED) {
+        return false;
+    }
+#if defined(__APPLE__)
+    // Read the memory
+    vm_size_t size = 0;
+    char buf[sizeof(uintptr_t)];
+    kern_return_t error = vm_read_overwrite(mach_task_self(), (vm_address_t)address, sizeof(uintptr_t), (vm_address_t)buf, &size);
+    return error == KERN_SUCCESS;
+#else
+    return true;
+#endif
+}
+
+static inline int64_t dateConvert(time_t time) {
+    static time_t since;
+    if (!since) {
+        struct tm since_tm = {};
+        since_tm.tm_year   = 4;
+        since_tm.tm_mday   = 1;
+        since              = timegm(&since_tm);
+    }
+    return (int64_t)(time - since);
+}
+
+static MovMuxer::FinishResult finishError(int error, bool posix, std::string message = {}) {
+    MovMuxer::FinishResult result;
+    result.error   = error;
+    result.posix   = posix;
+    result.message = std::move(message);
+    return result;
+}
+
+/// loaded bytes of the output of size are at base, only its boxes are checked if the samples are not loaded
+static MovMuxer::FinishResult checkOutput(const void *base, size_t loaded, size_t size) {
+    auto result = MovValidator::validateHeader(base, loaded, size);
+    if (result) {
+        return {};
+    }
+    char message[256];
+    snprintf(message, sizeof(message), "invalid output: %s at %llu", result.message, (unsigned long long)result.position);
+    return finishError(-1, false, message);
+}
+
+/// fill the sample description of table from format, extAtom is referred by the table until it is written
+static void describeSamples(SampleTableAtom &table, const MovMuxer::SampleFormat &format, VideoExtensionAtom &extAtom) {
+    extAtom.type = format.extensionType;
+    extAtom.dataLength = (uint32_t)format.extension.size();
+    extAtom.atomData = format.extension.data();
+    uint32_t subType = format.codecType;
+    table.description.data[0].fillIn(*(buint*)&subType, extAtom, format.formatName.empty() ? nullptr : format.formatName.c_str(), format.hspacing, format.vspacing);
+}
+
+/// stts of seg, empty if every sample lasts a frame
+static std::vector<SampleToTimeAtom::Entry> sampleTimesOf(const MovSeg &seg, const MovTimeBase &timeBase) {
+    std::vector<SampleToTimeAtom::Entry> times;
+    if (seg.holds.empty()) {
+        return times;
+    }
+    auto add = [&](uint32_t count, MovTick duration) {
+        if (count == 0) {
+            return;
+        }
+        if (times.size() && times.back().sampleDuration == (int)duration) {
+            times.back().sampleCount = times.back().sampleCount + (int)count;
+        } else {
+            times.push_back({ (int)count, (int)duration });
+        }
+    };
+    uint32_t next = 0, held = 0;
+    for (auto &&hold : seg.holds) {
+        add(hold.sample - next, timeBase.frameTicks);
+        add(1, timeBase.ticksForFrames(1 + hold.held - held));
+        next = hold.sample + 1;
+        held = hold.held;
+    }
+    add((uint32_t)seg.sampleSizes.size() - next, timeBase.frameTicks);
+    return times;
+}
+
+MovMuxer::MovMuxer(int frameRate, int timeScale, int width, int height, const char *outputPath, int maxKeyFrameInterval)
+: frameRate(frameRate), timeScale(timeScale), width(width), height(height), maxKeyFrameInterval(maxKeyFrameInterval),
+  outputPath(outputPath), timeBase(frameRate, timeScale) {
+    std::string path = outputPath;
+    outputDir = dirname(&path[0]); // glibc modifies the argument
+    struct stat sb;
+    if (stat(outputDir.c_str(), &sb) != 0) {
+        mkdir(outputDir.c_str(), 0777);
+    } else if (!S_ISDIR(sb.st_mode)){
+        unlink(outputDir.c_str());
+        mkdir(outputDir.c_str(), 0777);
+    }
+}
+
+MovMuxer::~MovMuxer() {
+    for (auto &&seg : segments) {
+        delete seg;
+    }
+}
+
+MovSeg &MovMuxer::ensureMovSeg(MovTick time, bool *needInsert) {
+    // a sample rewrites or continues the newest segment covering it, new segments only start before all the others,
+    // after a gap the segment before it holds its last sample through the gap
+    MovSeg *seg = segments.find(time, timeBase.frameTicks);
+    if (!seg && !segments.empty() && time >= segments.front()->start) {
+        seg = segments.floor(time);
+    }
+    if (seg) {
+        *needInsert = false;
+        return *seg;
+    }
+
+    bool planned = plannedSeg != nullptr;
+    MovSeg& ret = planned ? *plannedSeg.release() : *new MovSeg();
+    ret.start   = time;
+    ret.cacheToMemory = cacheFileToMemory;
+    ret.io = io;
+    if (planned && cacheFileToMemory) {
+        ret.caches.reserve(plannedBytes);
+    }
+    if (!cacheFileToMemory) {
+        if (!log) {
+            off_t extentSize = !preallocate ? 0 : MovPreallocation::extentFor(bytesPerSecond, expectedDuration > 0 ? expectedDuration : kDefaultExtentDuration);
+            log = std::make_shared<MovSegmentLog>(outputDir + "/mov_data_log" + std::to_string((uintptr_t)this), io, extentSize);
+        }
+        ret.log = log;
+        log->attach(ret.extents, time);
+    }
+    *needInsert = true;
+    return ret;
+}
+
+void MovMuxer::planCapacity(double duration) {
+    if (duration <= 0) {
+        plannedSeg = nullptr;
+        return;
+    }
+    size_t frames = (size_t)std::ceil(duration * frameRate) + 1;
+    // forced key frames after gaps come on top of the cadence
+    size_t gops   = frames / std::max(maxKeyFrameInterval, 1) + 2;
+    plannedSeg.reset(new MovSeg());
+    plannedSeg->reserve(frames, gops);
+    plannedBytes = (size_t)(bytesPerSecond * duration * 1.25);
+    segments.reserve(4);
+    batchSyncs.reserve(frameRate);
+}
+
+int MovMuxer::ingest(const EncodedSample &sample) {
+    if (sample.sampleCount > 1 && sample.sampleSizes) {
+        EncodedBatch batch;
+        batch.data        = sample.data;
+        batch.count       = sample.sampleCount;
+        batch.sampleSizes = sample.sampleSizes;
+        batch.firstPts    = sample.pts;
+        detectSyncs(batch);
+        if (sample.sync != EncodedSample::SYNC_UNKNOWN) {
+            batchSyncs[0] = sample.sync == EncodedSample::SYNC;
+        }
+        return ingestRuns(batch);
+    }
+    MOV_ASSERT(sample.dts == kMovTickInvalid || (sample.dts == sample.pts && "time differs is not supported"));
+    uint8_t isKeyFrame = sample.sync != EncodedSample::SYNC_UNKNOWN ? sample.sync == EncodedSample::SYNC : isSyncByNALTypes(sample.data, sample.size, nalLengthSize, codec);
+    return ingestRun(sample.data, &sample.size, &isKeyFrame, 1, sample.pts);
+}
+
+int MovMuxer::ingestBatch(const EncodedBatch &batch) {
+    detectSyncs(batch);
+    return ingestRuns(batch);
+}
+
+void MovMuxer::detectSyncs(const EncodedBatch &batch) {
+    batchSyncs.resize(batch.count);
+    const uint8_t *data = batch.data;
+    for (size_t i = 0; i < batch.count; ++i) {
+        auto sync     = batch.syncs ? batch.syncs[i] : EncodedSample::SYNC_UNKNOWN;
+        batchSyncs[i] = sync != EncodedSample::SYNC_UNKNOWN ? sync == EncodedSample::SYNC : isSyncByNALTypes(data, batch.sampleSizes[i], nalLengthSize, codec);
+        data += batch.sampleSizes[i];
+    }
+}
+
+int MovMuxer::ingestRuns(const EncodedBatch &batch) {
+    auto timeAt = [&](size_t i) {
+        return batch.pts ? batch.pts[i] : batch.firstPts + timeBase.ticksForFrames(i);
+    };
+    const uint8_t *data = batch.data;
+    for (size_t begin = 0, end; begin < batch.count; begin = end) {
+        // a gap starts a new run, as the sample after it may rewrite or open a segment
+        size_t runLength = batch.sampleSizes[begin];
+        for (end = begin + 1; end < batch.count && timeAt(end) == timeAt(end - 1) + timeBase.frameTicks; ++end) {
+            runLength += batch.sampleSizes[end];
+        }
+        if (int err = ingestRun(data, batch.sampleSizes + begin, batchSyncs.data() + begin, end - begin, timeAt(begin))) {
+            return err;
+        }
+        data += runLength;
+    }
+    return 0;
+}
+
+int MovMuxer::ingestRun(const uint8_t *data, const size_t *sizes, const uint8_t *syncs, size_t count, MovTick presentTime) {
+    bool needInsert;
+    MovSeg &seg = ensureMovSeg(presentTime, &needInsert);
+    std::unique_ptr<MovSeg> segCleaner;
+    if (needInsert) {
+        segCleaner = std::unique_ptr<MovSeg>(&seg);
+    }
+    if (!syncs[0] && !seg.chunkSampleSizes.size()) {
+        return kErrorNeedSyncSample;
+    }
+    int64_t frame = timeBase.framesForTicks(presentTime - seg.start);
+    int sampleNum = seg.sampleAtFrame(frame);
+
+    const char *dataPointer = (const char *)data;
+    if (seg.sampleSizes.size() && presentTime >= seg.start && presentTime <= seg.writeEnd) {
+        std::lock_guard<std::mutex> sentry(segLock);
+        MOV_ASSERT(syncs[0]);
+        if (seg.frameOfSample(sampleNum) < frame) {
+            ++sampleNum; // frame is held by the sample, which stays and is cut at frame
+        }
+        seg.writeEnd = presentTime == 0 ? 0 : presentTime - timeBase.frameTicks;
+        seg.eraseFrameNotLessThan(sampleNum);
+        seg.holdUntil(frame);
+        segments.update(&seg);
+        lastEncodedFrameTime = seg.writeEnd;
+    } else if (seg.sampleSizes.size() && presentTime > seg.writeEnd + timeBase.frameTicks) {
+        // frames refused or dropped before this one, the last sample holds through their slots
+        std::lock_guard<std::mutex> sentry(segLock);
+        seg.holdUntil(frame);
+        sampleNum = (int)seg.sampleSizes.size();
+    } else if (seg.sampleSizes.empty() && !needInsert) {
+        // emptied by a rewrite that failed to append, it starts again here
+        std::lock_guard<std::mutex> sentry(segLock);
+        seg.start = presentTime;
+        segments.update(&seg);
+        sampleNum = 0;
+    }
+    MOV_ASSERT(sampleNum == (int)seg.sampleSizes.size());
+    MOV_ASSERT(lastEncodedFrameTime == kMovTickInvalid || presentTime != lastEncodedFrameTime);
+    int offset   = seg.fileSize;
+    size_t totalLength = 0;
+    size_t syncCount   = 0;
+    for (size_t i = 0; i < count; ++i) {
+        MOV_ASSERT(validateSampleData(dataPointer + totalLength, sizes[i]));
+        maxFrameSize = std::max(maxFrameSize, (uint32_t)sizes[i]);
+        totalLength += sizes[i];
+        syncCount += syncs[i];
+    }
+    MovTraceSpan appendSpan("segment append");
+    if (seg.append(dataPointer, totalLength) == -1) {
+        return errno;
+    }
+    appendSpan.end();
+    MovTick lastTime = presentTime + timeBase.ticksForFrames(count - 1);
+    if (replayRecorder) {
+        for (size_t i = 0; i < count; ++i) {
+            replayRecorder->sample(presentTime + timeBase.ticksForFrames(i), sizes[i], syncs[i]);
+        }
+    }
+    lastEncodedFrameTime = lastTime;
+    std::lock_guard<std::mutex> sentry(segLock);
+    seg.writeEnd = lastTime;
+    if (!needInsert) {
+        segments.update(&seg);
+    }
+    if (count > 1) {
+        seg.sampleSizes.reserve(count);
+        seg.keyFrames.reserve(syncCount);
+        seg.chunkOffsets.reserve(syncCount, 3);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        seg.sampleSizes.push_back((int)sizes[i]);
+        if (syncs[i]) {
+            seg.keyFrames.push_back(sampleNum + (int)i + 1);
+            uint chunkNum = (uint)seg.chunkOffsets.size() + 1;
+            seg.chunkOffsets.push_back(offset);
+            if (seg.chunkSampleSizes.size() > 1) {
+                uint prevSampleSize = ((&seg.chunkSampleSizes.back()) - 1)->sampleSize;
+                if (seg.chunkSampleSizes.back().sampleSize == prevSampleSize) {
+                    seg.chunkSampleSizes.pop_back();
+                }
+            }
+            seg.chunkSampleSizes.push_back({chunkNum, 0});
+        }
+        seg.chunkSampleSizes.back().sampleSize++;
+        offset += (int)sizes[i];
+    }
+    if (needInsert) {
+        segments.insert(segCleaner.release());
+    }
+    return 0;
+}
+
+int MovMuxer::adoptSegments(MovMuxer &other) {
+    if (&other == this || other.timeScale != timeScale || other.frameRate != frameRate) {
+        return EINVAL;
+    }
+    std::lock(segLock, other.segLock);
+    std::lock_guard<std::mutex> sentry(segLock, std::adopt_lock);
+    std::lock_guard<std::mutex> otherSentry(other.segLock, std::adopt_lock);
+    if (other.segments.empty()) {
+        return 0;
+    }
+    if (!segments.empty() && (other.codec != codec || other.nalLengthSize != nalLengthSize)) {
+        return EINVAL;
+    }
+    for (auto &&seg : other.segments) {
+        if (seg->keyFrames.empty() || seg->keyFrames[0] != 1) {
+            return EINVAL;
+        }
+        for (auto &&mine : segments) {
+            if (seg->start <= mine->writeEnd && mine->start <= seg->writeEnd) {
+                return EINVAL;
+            }
+        }
+    }
+    codec         = other.codec;
+    nalLengthSize = other.nalLengthSize;
+    maxFrameSize  = std::max(maxFrameSize, other.maxFrameSize);
+    for (auto &&seg : other.segments) {
+        segments.insert(seg);
+    }
+    other.segments.clear();
+    if (lastEncodedFrameTime == kMovTickInvalid || lastEncodedFrameTime < other.lastEncodedFrameTime) {
+        lastEncodedFrameTime = other.lastEncodedFrameTime;
+    }
+    other.lastEncodedFrameTime = kMovTickInvalid;
+    return 0;
+}
+
+int MovMuxer::recordReplay(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        return errno;
+    }
+    replayRecorder = std::make_shared<MovReplayRecorder>(file, frameRate, timeScale, width, height, maxKeyFrameInterval);
+    return 0;
+}
+
+void MovMuxer::mergeSegments(MovSeg &finalSeg) {
+    MOV_TRACE_SPAN("mergeSegments");
+    uint32_t fileSize   = 0;
+    uint32_t chunkCount = 0;
+    uint32_t sampleSize = 0;
+    const MovSeg *prev  = nullptr;
+    for (auto&& seg : segments) {
+        MOV_ASSERT(seg->check());
+        if (seg->sampleSizes.empty()) {
+            continue;
+        }
+        MOV_ASSERT(finalSeg.writeEnd <= seg->writeEnd);
+        if (prev) {
+            // nothing was written between the segments, the last sample before holds through it
+            finalSeg.holdUntil(finalSeg.frameOfSample(sampleSize - 1) + 1 + timeBase.gapFrames(prev->writeEnd, seg->start));
+        }
+        uint32_t held = finalSeg.holds.empty() ? 0 : finalSeg.holds.back().held;
+        for (auto &&hold : seg->holds) {
+            finalSeg.holds.push_back({ hold.sample + sampleSize, hold.held + held });
+        }
+        prev = seg;
+        finalSeg.writeEnd = seg->writeEnd;
+        finalSeg.sampleSizes.append(seg->sampleSizes.begin(), seg->sampleSizes.end());
+        for (auto &&frame : seg->keyFrames) {
+            finalSeg.keyFrames.push_back(frame + sampleSize);
+        }
+        for (auto &&offset : seg->chunkOffsets) {
+            finalSeg.chunkOffsets.push_back(offset + fileSize);
+        }
+        auto &&begin = seg->chunkSampleSizes.begin();
+        if (finalSeg.chunkSampleSizes.size() && begin->sampleSize == finalSeg.chunkSampleSizes.back().sampleSize) {
+            ++begin;
+        }
+        for (; begin != seg->chunkSampleSizes.end(); ++begin) {
+            finalSeg.chunkSampleSizes.push_back({ begin->firstChunk + chunkCount, begin->sampleSize });
+        }
+        fileSize += seg->fileSize;
+        chunkCount += seg->chunkOffsets.size();
+        sampleSize += seg->sampleSizes.size();
+    }
+
+    finalSeg.path     = outputPath;
+    finalSeg.fd       = open(finalSeg.path.data(), O_CREAT | O_RDWR, 0660);
+    finalSeg.fileSize = fileSize;
+    MOV_ASSERT(finalSeg.validateChunks());
+}
+
+MovMuxer::FinishResult MovMuxer::finish(const SampleFormat &format) {
+    if (replayRecorder) {
+        replayRecorder->finish(finishConfig.way, finishConfig.copyLastFrameCount, finishConfig.fillMode, finishConfig.samplePerChunk,
+                               finishConfig.chunkPolicy, finishConfig.chunkBytes, finishConfig.chunkDuration);
+    }
+    if (segments.empty()) {
+        return finishError(-1, false, "No media generated");
+    }
+    if (int err = io->flush()) {
+        return finishError(err, true);
+    }
+    MovSeg finalSeg = {};
+    mergeSegments(finalSeg);
+
+    EditListAtom::List edits = fillEdits(finalSeg);
+    uint copyLastCount = finishConfig.fillMode == FILL_COPY ? finishConfig.copyLastFrameCount : 0;
+    uint lastFrameSize = 0;
+    int lastFrameOffset = 0;
+    int lastKeyFrameOffset = 0;
+    uint batchCopySize = 0;
+    uint batchCopyCount = 0;
+    uint compensateCopyCount = 0;
+    int copyFrameInterval = maxKeyFrameInterval;
+    if (copyLastCount > 0) {
+        if (finalSeg.sampleSizes.empty()) {
+            return finishError(-1, false, "no frame to copy");
+        }
+        lastFrameSize = finalSeg.sampleSizes.back();
+        auto lastKeyFrame = finalSeg.keyFrames.back() - 1;
+        auto sampleCount = finalSeg.sampleSizes.size();
+        auto populateStart = std::min(uint(lastKeyFrame + copyFrameInterval), uint(sampleCount + copyLastCount));
+        bool isLastKey = sampleCount == lastKeyFrame + 1;
+
+        auto leftCount = copyLastCount - (populateStart - sampleCount);
+        auto compensate = leftCount % copyFrameInterval;
+        leftCount -= compensate;
+        populateStart += compensate;
+        compensateCopyCount = uint(populateStart - sampleCount);
+        batchCopyCount = uint(leftCount / copyFrameInterval);
+
+        finalSeg.sampleSizes.appendRepeated(compensateCopyCount, lastFrameSize);
+        long long copySize = lastFrameSize * compensateCopyCount;
+        std::vector<uint> lastGOP(finalSeg.sampleSizes.iteratorAt(lastKeyFrame), finalSeg.sampleSizes.iteratorAt(lastKeyFrame + copyFrameInterval));
+        for (uint i = 0 ; i < batchCopyCount; i++) {
+            finalSeg.sampleSizes.append(lastGOP.begin(), lastGOP.end());
+            if (!isLastKey) {
+                finalSeg.keyFrames.push_back((uint)(populateStart + 1 + i * copyFrameInterval));
+            }
+        }
+        batchCopySize = std::accumulate(lastGOP.begin(), lastGOP.end(), 0u);
+        copySize += batchCopySize * batchCopyCount;
+        if (isLastKey) {
+            for (uint i = 0 ; i < copyLastCount; i++) {
+                finalSeg.keyFrames.push_back(lastKeyFrame + i + 2);
+            }
+        }
+
+        // only the last chunk grows, split it from its run
+        uint lastChunk = (uint)finalSeg.chunkOffsets.size();
+        uint lastChunkSampleSize = finalSeg.chunkSampleSizes.back().sampleSize + copyLastCount;
+        if (finalSeg.chunkSampleSizes.back().firstChunk == lastChunk) {
+            finalSeg.chunkSampleSizes.back().sampleSize = lastChunkSampleSize;
+        } else {
+            finalSeg.chunkSampleSizes.push_back({lastChunk, lastChunkSampleSize});
+        }
+        finalSeg.fileSize += copySize;
+        finalSeg.writeEnd += timeBase.ticksForFrames(copyLastCount);
+        lastFrameOffset = int(- copySize - lastFrameSize);
+        lastKeyFrameOffset = lastFrameOffset - std::accumulate(finalSeg.sampleSizes.iteratorAt(lastKeyFrame), finalSeg.sampleSizes.iteratorAt(sampleCount - 1), 0u);
+    }
+
+    reorderChunks(finalSeg);
+
+    MovTraceSpan moovSpan("moov build");
+    FileTypeAtom fileTypeAtom = {};
+    MediaDataAtom mediaData   = {};
+    int64_t duration          = finalSeg.writeEnd + timeBase.frameTicks;
+    time_t now                = time(NULL);
+    uint64_t createTime       = dateConvert(now);
+    MovieAtom movieAtom = MovieAtom(createTime, createTime, timeScale, frameRate, duration, width, height, std::move(edits));
+    VideoExtensionAtom extAtom;
+    describeSamples(movieAtom.videoTrack.media.mediaInfo.sampleTable, format, extAtom);
+    movieAtom.videoTrack.media.mediaInfo.sampleTable.handleInfo(finalSeg.sampleSizes, finalSeg.chunkOffsets, finalSeg.chunkSampleSizes, finalSeg.keyFrames,
+                                                                sampleTimesOf(finalSeg, timeBase));
+    movieAtom.calcSize();
+    moovSpan.end();
+    uint dataSize     = finalSeg.fileSize;
+    mediaData.setSizeWithDataSize(dataSize, 0);
+    uint headerSize   = fileTypeAtom.size + mediaData.headerSize() + movieAtom.size;
+    uint dataOffset = headerSize;
+    movieAtom.videoTrack.media.mediaInfo.sampleTable.chunkOffsetAtom.updateOffset(dataOffset);
+    finalSeg.fileSize = dataSize + headerSize;
+    if (preallocate) {
+        preallocateFile(finalSeg.fd, 0, finalSeg.fileSize);
+    }
+    trimFile(finalSeg.fd, finalSeg.fileSize);
+    auto mapSize            = finalSeg.fileSize;
+    // direct copy writes through the io backend instead of faulting in the mapped pages
+    void *base              = finishConfig.directCopy ? MAP_FAILED : mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, finalSeg.fd, 0);
+    if (!isReadableAddress(base)) {
+        if (base != MAP_FAILED) {
+            munmap(base, mapSize);;
+        }
+        base = malloc(headerSize);
+        if (base == nullptr) {
+            return finishError(-1, false, "no memory available");
+        }
+        auto addr               = (uint8_t *)base;
+        safewrite(fileTypeAtom);
+        safewrite(movieAtom);
+        addr = mediaData.writeTo(addr);
+        long written = io->write(finalSeg.fd, base, headerSize, 0);
+        // the samples are not read back, that would go through the page cache the copy bypasses
+        FinishResult result = checkOutput(base, headerSize, mapSize);
+        free(base);
+        if (written == -1) {
+            return finishError(errno, true);
+        }
+        off_t writeOffset = headerSize;
+        MovTraceSpan copySpan("mdat copy");
+        for (auto&& seg : segments) {
+            if (int err = seg->writeToFD(finalSeg.fd, writeOffset, finishConfig.directCopy)) {
+                io->flush();
+                return finishError(err, true);
+            }
+            writeOffset += seg->fileSize;
+        }
+        if (copyLastCount > 0) {
+            char *compensateBuff = (char *) malloc(batchCopySize);// 补偿帧最大缓冲
+            if (compensateBuff == nullptr) {
+                return finishError(-1, false, "no memory available");
+            }
+            if (io->read(finalSeg.fd, compensateBuff, batchCopySize, mapSize + lastKeyFrameOffset) != (long)batchCopySize) {
+                int err = errno ? errno : EIO;
+                free(compensateBuff);
+                io->flush();
+                return finishError(err, true);
+            }
+
+            for (int i = 0; i < compensateCopyCount; i++) {
+                io->queueWrite(finalSeg.fd, compensateBuff + (lastFrameOffset - lastKeyFrameOffset), lastFrameSize, writeOffset);
+                writeOffset += lastFrameSize;
+            }
+
+            for (int i = 0; i < batchCopyCount; i++) {
+                io->queueWrite(finalSeg.fd, compensateBuff, batchCopySize, writeOffset);
+                writeOffset += batchCopySize;
+            }
+            free(compensateBuff);
+        }
+        if (int err = io->flush()) {
+            return finishError(err, true);
+        }
+        copySpan.end();
+        return result;
+    }
+    auto addr               = (uint8_t *)base;
+    safewrite(fileTypeAtom);
+    safewrite(movieAtom);
+    addr = mediaData.writeTo(addr);
+    MovTraceSpan copySpan("mdat copy");
+    for (auto&& seg : segments) {
+        long read = seg->readToMemory(addr);
+        if (read < 0) {
+            int err = errno;
+            munmap(base, mapSize);
+            return finishError(err, true);
+        }
+        addr += read;
+    }
+    if (copyLastCount > 0) {
+        auto lastFrameAddr = (uint8_t *)base + mapSize + lastFrameOffset;
+        auto lastKeyFrameAddr = (uint8_t *)base + mapSize + lastKeyFrameOffset;
+
+        for (int i = 0; i < compensateCopyCount; i++) {
+            MOV_ASSERT(addr + lastFrameSize <= (uint8_t *)base + mapSize);
+            memcpy(addr, lastFrameAddr, lastFrameSize);
+            addr += lastFrameSize;
+        }
+
+        for (int i = 0; i < batchCopyCount; i++) {
+            MOV_ASSERT(addr + batchCopySize <= (uint8_t *)base + mapSize);
+            memcpy(addr, lastKeyFrameAddr, batchCopySize);
+            addr += batchCopySize;
+        }
+    }
+
+    copySpan.end();
+    FinishResult result = checkOutput(base, mapSize, mapSize);
+    munmap(base, mapSize);
+    return result;
+}
+
+MovMuxer::FinishResult MovMuxer::exportKeyFrames(const char *path, const SampleFormat &format) {
+    MOV_TRACE_SPAN("exportKeyFrames");
+    if (segments.empty()) {
+        return finishError(-1, false, "No media generated");
+    }
+    if (int err = io->flush()) {
+        return finishError(err, true);
+    }
+    struct KeyFrame {
+        const MovSeg *seg;
+        uint offset; // in the segment
+    };
+    std::vector<KeyFrame> keyFrames;
+    std::vector<uint> sampleSizes, chunkOffsets;
+    std::vector<SampleToTimeAtom::Entry> sampleTimes;
+    uint dataSize = 0, maxSize = 0, frameCount = 0, lastKeyFrame = 0; // in frames of the timeline
+    // a key frame lasts until the next one, so it shows at its time in the movie written by finish
+    auto addDuration = [&](uint frames) {
+        int duration = (int)timeBase.ticksForFrames(frames);
+        if (sampleTimes.size() && sampleTimes.back().sampleDuration == duration) {
+            sampleTimes.back().sampleCount = sampleTimes.back().sampleCount + 1;
+        } else {
+            sampleTimes.push_back({ 1, duration });
+        }
+    };
+    const MovSeg *prev = nullptr;
+    for (auto &&seg : segments) {
+        MOV_ASSERT(seg->keyFrames.size() == seg->chunkOffsets.size());
+        if (seg->sampleSizes.empty()) {
+            continue;
+        }
+        if (prev) {
+            frameCount += timeBase.gapFrames(prev->writeEnd, seg->start);
+        }
+        prev = seg;
+        auto chunkOffset = seg->chunkOffsets.begin();
+        for (auto keyFrame : seg->keyFrames) {
+            uint frame = frameCount + (uint)seg->frameOfSample(keyFrame - 1);
+            if (keyFrames.size()) {
+                addDuration(frame - lastKeyFrame);
+            }
+            uint size = seg->sampleSizes[keyFrame - 1]; // a key frame starts its chunk
+            keyFrames.push_back({ seg, *chunkOffset++ });
+            sampleSizes.push_back(size);
+            chunkOffsets.push_back(dataSize);
+            dataSize += size;
+            maxSize = std::max(maxSize, size);
+            lastKeyFrame = frame;
+        }
+        frameCount += (uint)seg->frameOfSample((uint32_t)seg->sampleSizes.size() - 1) + 1;
+    }
+    if (keyFrames.empty()) {
+        return finishError(-1, false, "no key frame");
+    }
+    addDuration(frameCount - lastKeyFrame);
+    std::vector<uint> syncSamples(keyFrames.size());
+    std::iota(syncSamples.begin(), syncSamples.end(), 1u);
+
+    FileTypeAtom fileTypeAtom = {};
+    MediaDataAtom mediaData   = {};
+    uint64_t createTime       = dateConvert(time(NULL));
+    MovieAtom movieAtom = MovieAtom(createTime, createTime, timeScale, frameRate, timeBase.ticksForFrames(frameCount), width, height);
+    auto &&sampleTable  = movieAtom.videoTrack.media.mediaInfo.sampleTable;
+    VideoExtensionAtom extAtom;
+    describeSamples(sampleTable, format, extAtom);
+    sampleTable.handleInfo(sampleSizes, chunkOffsets, std::vector<SampleToChunkAtom::SampleToChunkEntry>{ { 1, 1 } }, syncSamples, sampleTimes);
+    movieAtom.calcSize();
+    mediaData.setSizeWithDataSize(dataSize, 0);
+    uint headerSize = fileTypeAtom.size + mediaData.headerSize() + movieAtom.size;
+    sampleTable.chunkOffsetAtom.updateOffset(headerSize);
+
+    int outFd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0660);
+    if (outFd == -1) {
+        return finishError(errno, true);
+    }
+    FD fd = outFd;
+    std::vector<uint8_t> buffer(std::max(headerSize, maxSize));
+    auto addr = buffer.data();
+    safewrite(fileTypeAtom);
+    safewrite(movieAtom);
+    addr = mediaData.writeTo(addr);
+    if (io->write(fd, buffer.data(), headerSize, 0) == -1) {
+        return finishError(errno, true);
+    }
+    off_t writeOffset = headerSize;
+    for (size_t i = 0; i < keyFrames.size(); ++i) {
+        uint size = sampleSizes[i];
+        if (keyFrames[i].seg->read(buffer.data(), size, keyFrames[i].offset) != size) {
+            return finishError(errno ?: EIO, true);
+        }
+        if (io->write(fd, buffer.data(), size, writeOffset) == -1) {
+            return finishError(errno, true);
+        }
+        writeOffset += size;
+    }
+    FinishResult result;
+    void *output = mmap(NULL, writeOffset, PROT_READ, MAP_SHARED, fd, 0);
+    if (output != MAP_FAILED) {
+        result = checkOutput(output, writeOffset, writeOffset);
+        munmap(output, writeOffset);
+    }
+    return result;
+}
+
+EditListAtom::List MovMuxer::fillEdits(const MovSeg &finalSeg) {
+    EditListAtom::List edits;
+    uint fillCount = finishConfig.copyLastFrameCount;
+    if (finishConfig.fillMode == FILL_COPY || fillCount == 0 || finalSeg.sampleSizes.empty()) {
+        return edits;
+    }
+    // in frames of the media, held samples last more than one
+    int64_t mediaFrames  = finalSeg.frameOfSample((uint32_t)finalSeg.sampleSizes.size() - 1) + 1;
+    int64_t lastKeyFrame = finalSeg.frameOfSample(finalSeg.keyFrames.back() - 1);
+    uint loopCount = uint(mediaFrames - lastKeyFrame);
+    edits.push_back({ (uint64_t)timeBase.ticksForFrames(mediaFrames), 0, 1.0 });
+    if (finishConfig.fillMode == FILL_HOLD || loopCount == 1) {
+        edits.push_back({ (uint64_t)timeBase.ticksForFrames(fillCount), timeBase.ticksForFrames(mediaFrames - 1), 0 });
+        return edits;
+    }
+    uint left = fillCount;
+    for (uint loop = 0; left && loop < kMaxFillLoops; ++loop) {
+        uint count = std::min(left, loopCount);
+        edits.push_back({ (uint64_t)timeBase.ticksForFrames(count), timeBase.ticksForFrames(lastKeyFrame), 1.0 });
+        left -= count;
+    }
+    if (left) {
+        // the last loop ended on the last frame
+        edits.push_back({ (uint64_t)timeBase.ticksForFrames(left), timeBase.ticksForFrames(mediaFrames - 1), 0 });
+    }
+    return edits;
+}
+
+void MovMuxer::reorderChunks(MovSeg& finalSeg) {
+    uint64_t samplesPerChunk = 0;
+    uint64_t bytesPerChunk   = 0;
+    switch (finishConfig.chunkPolicy) {
+        case CHUNK_BY_GOP:
+            break;
+        case CHUNK_BY_SAMPLES:
+            samplesPerChunk = finishConfig.samplePerChunk;
+            break;
+        case CHUNK_BY_BYTES:
+            bytesPerChunk = finishConfig.chunkBytes;
+            break;
+        case CHUNK_BY_DURATION:
+            samplesPerChunk = (uint64_t)std::max(1.0, std::round(finishConfig.chunkDuration * frameRate));
+            break;
+    }
+    if (samplesPerChunk == 0 && bytesPerChunk == 0) {
+        finalSeg.compactChunkRuns();
+        return;
+    }
+    MOV_TRACE_SPAN("reorderChunks");
+    // samples lie back to back from offset 0, so any split into runs of whole samples is valid
+    finalSeg.chunkOffsets.clear();
+    finalSeg.chunkSampleSizes.clear();
+    uint offset      = 0;
+    uint chunkOffset = 0;
+    uint chunkCount  = 0;
+    uint64_t chunkBytes = 0;
+    auto closeChunk = [&] {
+        finalSeg.chunkOffsets.push_back(chunkOffset);
+        if (finalSeg.chunkSampleSizes.empty() || finalSeg.chunkSampleSizes.back().sampleSize != chunkCount) {
+            finalSeg.chunkSampleSizes.push_back({ (uint)finalSeg.chunkOffsets.size(), chunkCount });
+        }
+    };
+    for (auto size : finalSeg.sampleSizes) {
+        bool full = samplesPerChunk ? chunkCount == samplesPerChunk : chunkBytes + size > bytesPerChunk;
+        if (chunkCount && full) {
+            closeChunk();
+            chunkOffset = offset;
+            chunkCount  = 0;
+            chunkBytes  = 0;
+        }
+        ++chunkCount;
+        chunkBytes += size;
+        offset += size;
+    }
+    if (chunkCount) {
+        closeChunk();
+    }
+}
+
+} // namespace IVT
@@ -0,0 +1,166 @@
+//
+//  IVTMovMuxer.h
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#ifndef IVTMovMuxer_h
+#define IVTMovMuxer_h
+
+#ifdef __cplusplus
+
+#include "IVTMovIO.h"
+#include "IVTMovSample.h"
+#include "IVTMovSegment.h"
+#include "IVTMovTimeline.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace IVT {
+
+class MovReplayRecorder;
+
+/// Appends encoded samples to the segments of a track and writes the movie, the part of MovFile without CoreMedia.
+class MovMuxer {
+public:
+    /// a segment must start with a sync sample, same value as kVTVideoEncoderNotAvailableNowErr
+    static constexpr int kErrorNeedSyncSample = -12915;
+
+    enum FinishWay {
+        BY_CUSTOM,
+        BY_SYSTEM
+    };
+
+    enum FillMode {
+        FILL_COPY, // duplicate the last frames into the file
+        FILL_HOLD, // dwell on the last frame with an edit
+        FILL_LOOP  // repeat the last GOP with edits up to kMaxFillLoops times then dwell, dwells if the last frame is a key frame
+    };
+
+    static constexpr uint kMaxFillLoops = 4; // keeps the edit list of FILL_LOOP a few entries whatever the fill
+
+    /// how finish groups the samples into chunks, players read a chunk at a time
+    enum ChunkPolicy {
+        CHUNK_BY_GOP,      // a chunk per GOP as ingested, sizes follow the key frame cadence
+        CHUNK_BY_SAMPLES,  // samplePerChunk samples a chunk
+        CHUNK_BY_BYTES,    // as many samples as fit in chunkBytes, a typical read covers whole chunks
+        CHUNK_BY_DURATION, // chunkDuration seconds a chunk
+    };
+
+    static constexpr uint kDefaultChunkBytes = 512 << 10; // in the 256KB-1MB reads of players
+
+    struct FinishConfig {
+        FinishWay way = BY_CUSTOM;
+        uint copyLastFrameCount = 0;
+        FillMode fillMode = FILL_COPY; // how copyLastFrameCount frames are appended, BY_SYSTEM holds for the edit modes
+        ChunkPolicy chunkPolicy = CHUNK_BY_BYTES;
+        uint samplePerChunk = 0;
+        uint chunkBytes = kDefaultChunkBytes; // a sample larger than it takes a chunk alone
+        double chunkDuration = 1; // seconds
+        bool directCopy = false; // copy segments into the output through the io backend bypassing the page cache, instead of mapping it
+    };
+
+    /// sample description of the track, taken from the format description on Apple platforms
+    struct SampleFormat {
+        uint32_t codecType     = 0; // FourCharCode, 'avc1'
+        uint32_t extensionType = 0; // the four characters in file order, "avcC"
+        std::vector<uint8_t> extension; // payload of the extension atom
+        std::string formatName;
+        int hspacing = 0;
+        int vspacing = 0;
+    };
+
+    struct FinishResult {
+        int error   = 0;
+        bool posix  = false; // error is an errno, an OSStatus otherwise
+        std::string message;
+
+        operator bool() const {
+            return error == 0;
+        }
+    };
+
+    const int frameRate;
+    const int timeScale;
+    const int width;
+    const int height;
+    const int maxKeyFrameInterval;
+    const std::string outputPath;
+    const MovTimeBase timeBase;
+    FinishConfig finishConfig;
+    bool cacheFileToMemory = false;
+    double expectedDuration = 0; // seconds, sizes the preallocated extents of segment files, 0 if unknown
+    bool preallocate = true; // reserve segment data and the output in large extents, off to measure appends without it
+    std::shared_ptr<MovIO> io = MovIO::sync(); // set before the first sample, can be shared by the files driven on one thread
+    MovTick lastEncodedFrameTime = kMovTickInvalid;
+    MovCodec codec = CODEC_H264;
+    uint32_t nalLengthSize = 4;
+
+    /// segment files are created in the directory of outputPath
+    MovMuxer(int frameRate, int timeScale, int width, int height, const char *outputPath, int maxKeyFrameInterval);
+    MovMuxer(const MovMuxer &) = delete;
+    virtual ~MovMuxer();
+
+    /// 0 on success, errno if writing fails or kErrorNeedSyncSample
+    int ingest(const EncodedSample &sample);
+    /// ingest the samples of batch in order, each run one frame apart is written by one append and extends the tables at once
+    int ingestBatch(const EncodedBatch &batch);
+
+    /// reserve the tables of the first segment for duration seconds of frames at the key frame cadence, and its memory cache for
+    /// a quarter more than the expected data if it is cached to memory, so ingest doesn't allocate until they are outgrown.
+    /// The sync flags of batches are reserved for a second of frames, a longer batch grows them once.
+    /// Called before the first sample, replaces an earlier plan
+    void planCapacity(double duration);
+
+    /// move the segments of other into this muxer, for time ranges ingested in parallel by muxers of the same track.
+    /// EINVAL if a segment overlaps one of this muxer or doesn't start with a sync sample, nothing is moved then.
+    /// Not to be called while either muxer ingests samples
+    int adoptSegments(MovMuxer &other);
+
+    /// write the samples of all segments to outputPath in the BY_CUSTOM way, the output is validated
+    FinishResult finish(const SampleFormat &format);
+
+    /// write the key frames of all segments to path without re-encoding, each lasts until the next one,
+    /// so they show at their times in the movie written by finish. Not to be called while samples are ingested
+    FinishResult exportKeyFrames(const char *path, const SampleFormat &format);
+
+    /// record the samples, decode requests and finish of this muxer to path, for Tools/ivt_movreplay.cpp. 0 or errno
+    int recordReplay(const char *path);
+
+    MovSeg *findMovSeg(MovTick time) {
+        return segments.find(time);
+    }
+
+protected:
+    static constexpr double kDefaultExtentDuration = 10;
+
+    std::string outputDir;
+    MovTimeline<MovSeg> segments;
+    std::mutex segLock;
+    uint32_t maxFrameSize = 0;
+    long bytesPerSecond   = 0; // expected, sizes the preallocated extents
+    std::shared_ptr<MovReplayRecorder> replayRecorder;
+    std::shared_ptr<MovSegmentLog> log; // data of all segments not cached to memory
+    std::vector<uint8_t> batchSyncs; // sync flags of the batch being ingested, kept to avoid allocating each time
+    std::unique_ptr<MovSeg> plannedSeg; // the first segment reserved by planCapacity
+    size_t plannedBytes = 0;
+
+    MovSeg &ensureMovSeg(MovTick time, bool *needInsert);
+    void detectSyncs(const EncodedBatch &batch);
+    /// split batch into runs one frame apart, with batchSyncs filled
+    int ingestRuns(const EncodedBatch &batch);
+    /// append count samples one frame apart from presentTime in one write, stored back to back in data
+    int ingestRun(const uint8_t *data, const size_t *sizes, const uint8_t *syncs, size_t count, MovTick presentTime);
+
+    void mergeSegments(MovSeg &finalSeg);
+    void reorderChunks(MovSeg &finalSeg);
+    /// edits playing the media and then filling copyLastFrameCount frames, no sample is added
+    EditListAtom::List fillEdits(const MovSeg &finalSeg);
+};
+
+} // namespace IVT
+#endif
+#endif /* IVTMovMuxer_h */
@@ -0,0 +1,252 @@
+//
+//  IVTMovPackedTable.h
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#ifndef IVTMovPackedTable_h
+#define IVTMovPackedTable_h
+
+#ifdef __cplusplus
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+namespace IVT {
+
+/// A sample table column stored as blocks of zigzag varint deltas, a sparse index keeps the first value of each block.
+/// Sizes of similar frames and offsets growing by them take one or two bytes a value instead of four.
+/// Appending and truncating work on the tail, random access decodes at most one block.
+class MovPackedTable {
+public:
+    static constexpr size_t kBlockSize = 64;
+
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = uint32_t;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const uint32_t *;
+        using reference         = uint32_t;
+
+        const_iterator() {}
+
+        uint32_t operator*() const {
+            return value;
+        }
+
+        const_iterator &operator++() {
+            if (++index < table->count) {
+                value = index % kBlockSize ? value + table->decodeDelta(position) : table->blocks[index / kBlockSize].first;
+                if (index % kBlockSize == 0) {
+                    position = table->blocks[index / kBlockSize].position;
+                }
+            }
+            return *this;
+        }
+
+        const_iterator operator++(int) {
+            auto ret = *this;
+            ++*this;
+            return ret;
+        }
+
+        /// steps forward inside the block, seeks from the index otherwise
+        const_iterator operator+(difference_type n) const {
+            size_t target = index + n;
+            if (n >= 0 && target / kBlockSize == index / kBlockSize) {
+                auto ret = *this;
+                while (ret.index < target) {
+                    ++ret;
+                }
+                return ret;
+            }
+            return table->iteratorAt(target);
+        }
+
+        difference_type operator-(const const_iterator &o) const {
+            return (difference_type)index - (difference_type)o.index;
+        }
+
+        bool operator==(const const_iterator &o) const {
+            return index == o.index;
+        }
+
+        bool operator!=(const const_iterator &o) const {
+            return index != o.index;
+        }
+
+    private:
+        friend class MovPackedTable;
+        const MovPackedTable *table = nullptr;
+        size_t index    = 0;
+        size_t position = 0; // of the next delta
+        uint32_t value  = 0;
+    };
+
+    size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    uint32_t back() const {
+        return last;
+    }
+
+    void push_back(uint32_t value) {
+        if (count % kBlockSize == 0) {
+            blocks.push_back({ (uint32_t)data.size(), value });
+        } else {
+            encodeDelta(value - last);
+        }
+        last = value;
+        ++count;
+    }
+
+    /// make room for n more values of about bytesPerValue encoded bytes each, growing geometrically
+    void reserve(size_t n, size_t bytesPerValue = 2) {
+        grow(data, data.size() + n * bytesPerValue);
+        grow(blocks, (count + n + kBlockSize - 1) / kBlockSize);
+    }
+
+    /// append count copies of value
+    void appendRepeated(size_t n, uint32_t value) {
+        while (n--) {
+            push_back(value);
+        }
+    }
+
+    /// append the values of [begin, end), which must not be of this table
+    template <class Iterator>
+    void append(Iterator begin, Iterator end) {
+        for (; begin != end; ++begin) {
+            push_back(*begin);
+        }
+    }
+
+    /// keep the first n values
+    void truncate(size_t n) {
+        if (n >= count) {
+            return;
+        }
+        if (n == 0) {
+            clear();
+            return;
+        }
+        size_t block    = (n - 1) / kBlockSize;
+        size_t position = blocks[block].position;
+        uint32_t value  = blocks[block].first;
+        for (size_t i = block * kBlockSize + 1; i < n; ++i) {
+            value += decodeDelta(position);
+        }
+        data.resize(position);
+        blocks.resize(block + 1);
+        count = n;
+        last  = value;
+    }
+
+    void pop_back() {
+        truncate(count - 1);
+    }
+
+    void clear() {
+        data.clear();
+        blocks.clear();
+        count = 0;
+        last  = 0;
+    }
+
+    uint32_t operator[](size_t index) const {
+        return *iteratorAt(index);
+    }
+
+    const_iterator begin() const {
+        return iteratorAt(0);
+    }
+
+    const_iterator end() const {
+        const_iterator ret;
+        ret.table = this;
+        ret.index = count;
+        return ret;
+    }
+
+    const_iterator iteratorAt(size_t index) const {
+        const_iterator ret;
+        ret.table = this;
+        ret.index = index;
+        if (index >= count) {
+            ret.index = count;
+            return ret;
+        }
+        size_t block = index / kBlockSize;
+        ret.position = blocks[block].position;
+        ret.value    = blocks[block].first;
+        for (size_t i = block * kBlockSize + 1; i <= index; ++i) {
+            ret.value += decodeDelta(ret.position);
+        }
+        return ret;
+    }
+
+    /// decode count values from index into dst
+    void copyTo(uint32_t *dst, size_t index, size_t n) const {
+        for (auto it = iteratorAt(index); n--; ++it) {
+            *dst++ = *it;
+        }
+    }
+
+    /// bytes held, the capacity of a plain vector would be size() * 4
+    size_t memoryUsage() const {
+        return data.capacity() + blocks.capacity() * sizeof(Block);
+    }
+
+private:
+    struct Block {
+        uint32_t position; // in data of the delta of the second value
+        uint32_t first;
+    };
+
+    std::vector<uint8_t> data;
+    std::vector<Block> blocks;
+    size_t count  = 0;
+    uint32_t last = 0;
+
+    template <class T>
+    static void grow(std::vector<T> &vector, size_t size) {
+        if (size > vector.capacity()) {
+            vector.reserve(std::max(size, vector.capacity() * 2));
+        }
+    }
+
+    void encodeDelta(uint32_t delta) {
+        uint32_t zigzag = (delta << 1) ^ (uint32_t)((int32_t)delta >> 31);
+        while (zigzag >= 0x80) {
+            data.push_back((uint8_t)(zigzag | 0x80));
+            zigzag >>= 7;
+        }
+        data.push_back((uint8_t)zigzag);
+    }
+
+    uint32_t decodeDelta(size_t &position) const {
+        uint32_t zigzag = 0;
+        for (int shift = 0;; shift += 7) {
+            uint8_t byte = data[position++];
+            zigzag |= (uint32_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                break;
+            }
+        }
+        return (zigzag >> 1) ^ (0u - (zigzag & 1));
+    }
+};
+
+} // namespace IVT
+#endif
+#endif /* IVTMovPackedTable_h */
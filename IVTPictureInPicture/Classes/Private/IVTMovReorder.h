@@ -0,0 +1,142 @@
+//
+//  IVTMovReorder.h
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#ifndef IVTMovReorder_h
+#define IVTMovReorder_h
+
+#ifdef __cplusplus
+
+#include "IVTMovTimeline.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace IVT {
+
+struct MovReorderStats {
+    uint64_t reordered      = 0; // frames arrived before an earlier one, released in order
+    uint64_t heldFrames     = 0; // missing frames filled with the previous one
+    uint64_t avoidedKeyFrames = 0; // reorders and gaps that would have forced a key frame
+    uint64_t discontinuities = 0; // seeks and gaps too large to hold, they reach the key frame logic
+    uint64_t dropped        = 0; // frames of a time already pending
+};
+
+/// Sorts input frames by time in a window of a few frames before they are encoded,
+/// so jittery producers don't force a key frame and a new segment for every swapped or missing frame.
+/// A gap of up to maxHoldFrames frames is filled by repeating the previous frame,
+/// only real discontinuities are released out of sequence. Not thread safe.
+template <class Frame>
+class MovReorderBuffer {
+public:
+    const MovTimeBase timeBase;
+    size_t window;          // frames waiting for an earlier one, 0 releases every frame at once
+    uint32_t maxHoldFrames; // missing frames filled with the previous one
+
+    MovReorderBuffer(MovTimeBase timeBase, size_t window = 3, uint32_t maxHoldFrames = 2)
+    : timeBase(timeBase), window(window), maxHoldFrames(maxHoldFrames) {}
+
+    const MovReorderStats &stats() const {
+        return counters;
+    }
+
+    /// release calls emit(MovTick, const Frame &) returning 0 or an error, the first error is returned
+    template <class Emit>
+    int push(MovTick time, Frame frame, Emit &&emit) {
+        if (released != kMovTickInvalid && time <= released) {
+            // earlier than a released frame, a seek back
+            ++counters.discontinuities;
+            if (int err = flush(emit)) {
+                return err;
+            }
+            return release(time, frame, emit);
+        }
+        auto it = std::lower_bound(pending.begin(), pending.end(), time, [](const Pending &p, MovTick time) {
+            return p.time < time;
+        });
+        if (it != pending.end() && it->time == time) {
+            ++counters.dropped;
+            return 0;
+        }
+        if (it != pending.end()) {
+            ++counters.reordered;
+            ++counters.avoidedKeyFrames;
+        }
+        pending.insert(it, { time, std::move(frame) });
+        while (!pending.empty()) {
+            MovTick next = released == kMovTickInvalid ? kMovTickInvalid : released + timeBase.frameTicks;
+            bool inSequence = pending.front().time == next;
+            if (!inSequence && pending.size() <= window) {
+                break;
+            }
+            if (int err = releaseFront(emit)) {
+                return err;
+            }
+        }
+        return 0;
+    }
+
+    /// release all the pending frames, before the last frames are completed
+    template <class Emit>
+    int flush(Emit &&emit) {
+        while (!pending.empty()) {
+            if (int err = releaseFront(emit)) {
+                return err;
+            }
+        }
+        return 0;
+    }
+
+    /// drop the pending frames, the next frame starts a new sequence
+    void reset() {
+        pending.clear();
+        previous = Frame();
+        released = kMovTickInvalid;
+    }
+
+private:
+    struct Pending {
+        MovTick time;
+        Frame frame;
+    };
+    std::vector<Pending> pending; // sorted by time
+    Frame previous;
+    MovTick released = kMovTickInvalid;
+    MovReorderStats counters;
+
+    template <class Emit>
+    int releaseFront(Emit &&emit) {
+        Pending front = std::move(pending.front());
+        pending.erase(pending.begin());
+        if (released != kMovTickInvalid) {
+            MovTick missing = (front.time - released) / timeBase.frameTicks - 1;
+            if (missing > 0 && missing <= maxHoldFrames) {
+                for (MovTick i = 1; i <= missing; ++i) {
+                    if (int err = emit(released + timeBase.frameTicks, previous)) {
+                        return err;
+                    }
+                    released += timeBase.frameTicks;
+                }
+                counters.heldFrames += missing;
+                ++counters.avoidedKeyFrames;
+            } else if (missing > 0) {
+                ++counters.discontinuities;
+            }
+        }
+        return release(front.time, front.frame, emit);
+    }
+
+    template <class Emit>
+    int release(MovTick time, const Frame &frame, Emit &&emit) {
+        released = time;
+        previous = frame;
+        return emit(time, frame);
+    }
+};
+
+} // namespace IVT
+#endif
+#endif /* IVTMovReorder_h */
@@ -0,0 +1,127 @@
+//
+//  IVTMovReplay.h
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#ifndef IVTMovReplay_h
+#define IVTMovReplay_h
+
+#ifdef __cplusplus
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <mutex>
+
+namespace IVT {
+
+/// One line of a replay trace, times are microseconds since the trace started.
+///   ivtmov-replay 1 <frameRate> <timeScale> <width> <height> <maxKeyFrameInterval>
+///   F <us> <pts> <size> <sync>     a sample reached the muxer
+///   D <us> <pts>                   a decode request
+///   X <us> <way> <copyLastFrameCount> <fillMode> <samplePerChunk> <chunkPolicy> <chunkBytes> <chunkDuration>
+struct MovReplayEvent {
+    enum Kind : char {
+        HEADER = 'H',
+        SAMPLE = 'F',
+        DECODE = 'D',
+        FINISH = 'X',
+        INVALID = 0,
+    };
+    static constexpr const char *kMagic = "ivtmov-replay";
+    static constexpr int kVersion       = 1;
+
+    Kind kind     = INVALID;
+    uint64_t time = 0;
+    int64_t pts   = 0;
+    uint32_t size = 0;
+    bool sync     = false;
+    // HEADER
+    int frameRate = 0, timeScale = 0, width = 0, height = 0, maxKeyFrameInterval = 0;
+    // FINISH
+    int way = 0, fillMode = 0, chunkPolicy = 0;
+    uint32_t copyLastFrameCount = 0, samplePerChunk = 0, chunkBytes = 0;
+    double chunkDuration = 0;
+
+    bool parse(const char *line) {
+        int version = 0, syncFlag = 0;
+        kind = INVALID;
+        switch (line[0]) {
+            case 'F':
+                if (sscanf(line, "F %" SCNu64 " %" SCNd64 " %" SCNu32 " %d", &time, &pts, &size, &syncFlag) == 4) {
+                    kind = SAMPLE;
+                    sync = syncFlag != 0;
+                }
+                break;
+            case 'D':
+                if (sscanf(line, "D %" SCNu64 " %" SCNd64, &time, &pts) == 2) {
+                    kind = DECODE;
+                }
+                break;
+            case 'X':
+                switch (sscanf(line, "X %" SCNu64 " %d %" SCNu32 " %d %" SCNu32 " %d %" SCNu32 " %lf", &time, &way, &copyLastFrameCount,
+                               &fillMode, &samplePerChunk, &chunkPolicy, &chunkBytes, &chunkDuration)) {
+                    case 5:
+                        // traces before chunk policies chunked by GOP unless samplePerChunk is set
+                        chunkPolicy = samplePerChunk ? 1 : 0;
+                        // fall through
+                    case 8:
+                        kind = FINISH;
+                        break;
+                }
+                break;
+            case 'i':
+                if (sscanf(line, "ivtmov-replay %d %d %d %d %d %d", &version, &frameRate, &timeScale, &width, &height, &maxKeyFrameInterval) == 6 &&
+                    version == kVersion) {
+                    kind = HEADER;
+                }
+                break;
+        }
+        return kind != INVALID;
+    }
+};
+
+/// Appends the events of one muxer to a trace file, called from the encoder and decoder threads.
+class MovReplayRecorder {
+    FILE *file;
+    std::mutex lock;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    uint64_t elapsed() const {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+public:
+    MovReplayRecorder(FILE *file, int frameRate, int timeScale, int width, int height, int maxKeyFrameInterval)
+    : file(file) {
+        fprintf(file, "%s %d %d %d %d %d %d\n", MovReplayEvent::kMagic, MovReplayEvent::kVersion, frameRate, timeScale, width, height, maxKeyFrameInterval);
+    }
+    MovReplayRecorder(const MovReplayRecorder &) = delete;
+
+    ~MovReplayRecorder() {
+        fclose(file);
+    }
+
+    void sample(int64_t pts, size_t size, bool sync) {
+        std::lock_guard<std::mutex> guard(lock);
+        fprintf(file, "F %" PRIu64 " %" PRId64 " %zu %d\n", elapsed(), pts, size, sync ? 1 : 0);
+    }
+
+    void decode(int64_t pts) {
+        std::lock_guard<std::mutex> guard(lock);
+        fprintf(file, "D %" PRIu64 " %" PRId64 "\n", elapsed(), pts);
+    }
+
+    void finish(int way, uint32_t copyLastFrameCount, int fillMode, uint32_t samplePerChunk, int chunkPolicy, uint32_t chunkBytes, double chunkDuration) {
+        std::lock_guard<std::mutex> guard(lock);
+        fprintf(file, "X %" PRIu64 " %d %u %d %u %d %u %g\n", elapsed(), way, copyLastFrameCount, fillMode, samplePerChunk, chunkPolicy, chunkBytes,
+                chunkDuration);
+        fflush(file);
+    }
+};
+
+} // namespace IVT
+#endif
+#endif /* IVTMovReplay_h */
@@ -0,0 +1,87 @@
+//
+//  IVTMovSample.h
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#ifndef IVTMovSample_h
+#define IVTMovSample_h
+
+#ifdef __cplusplus
+
+#include "IVTMovTimeline.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace IVT {
+
+enum MovCodec {
+    CODEC_H264,
+    CODEC_HEVC,
+};
+
+/// the FourCharCode of "avc1", built from bytes as multi-character constants warn
+constexpr uint32_t movFourCC(const char (&s)[5]) {
+    return uint32_t(uint8_t(s[0])) << 24 | uint32_t(uint8_t(s[1])) << 16 | uint32_t(uint8_t(s[2])) << 8 | uint32_t(uint8_t(s[3]));
+}
+
+/// View of encoded samples handed to the muxer, it doesn't own the data.
+/// Samples are length prefixed NAL units as stored in mdat.
+struct EncodedSample {
+    enum Sync : int8_t {
+        SYNC_UNKNOWN = -1, // detected from the NAL unit types
+        NOT_SYNC     = 0,
+        SYNC         = 1,
+    };
+
+    const uint8_t *data = nullptr;
+    size_t size         = 0;
+    MovTick pts         = kMovTickInvalid; // ticks of the track time scale on the frame grid
+    MovTick dts         = kMovTickInvalid; // invalid if equal to pts, reordering is not supported
+    Sync sync           = SYNC_UNKNOWN;    // of the first sample, the following ones are detected
+    int sampleCount     = 1;
+    const size_t *sampleSizes = nullptr;   // sizes of each sample if sampleCount > 1, they follow one frame apart
+};
+
+/// View of samples stored back to back with their own times and syncs, for compressed GOPs replayed from a cache or remuxed.
+/// Runs of samples one frame apart are appended with one write each.
+struct EncodedBatch {
+    const uint8_t *data = nullptr;
+    size_t count        = 0;
+    const size_t *sampleSizes = nullptr;
+    const MovTick *pts  = nullptr;              // increasing on the frame grid, nullptr if they follow one frame apart from firstPts
+    MovTick firstPts    = kMovTickInvalid;
+    const EncodedSample::Sync *syncs = nullptr; // nullptr if all are detected from the NAL unit types
+};
+
+/// whether the sample contains an IDR (H.264) or IRAP (HEVC) NAL unit
+inline bool isSyncByNALTypes(const uint8_t *data, size_t size, uint32_t lengthSize, MovCodec codec) {
+    for (size_t pos = 0; lengthSize && size - pos > lengthSize;) {
+        size_t length = 0;
+        for (uint32_t i = 0; i < lengthSize; ++i) {
+            length = length << 8 | data[pos + i];
+        }
+        pos += lengthSize;
+        if (length == 0 || length > size - pos) {
+            return false;
+        }
+        if (codec == CODEC_H264) {
+            int type = data[pos] & 0x1F;
+            if (type == 5) {
+                return true;
+            }
+        } else {
+            int type = (data[pos] >> 1) & 0x3F;
+            if (type >= 16 && type <= 21) {
+                return true;
+            }
+        }
+        pos += length;
+    }
+    return false;
+}
+
+} // namespace IVT
+#endif
+#endif /* IVTMovSample_h */
@@ -0,0 +1,223 @@
+//
+//  IVTMovSampleCache.h
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#ifndef IVTMovSampleCache_h
+#define IVTMovSampleCache_h
+
+#ifdef __cplusplus
+
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace IVT {
+
+/// what placeholder samples are for, samples of another codec, profile or rate are never mixed up
+struct MovSampleKey {
+    int32_t width      = 0;
+    int32_t height     = 0;
+    uint32_t codecType = 0; // 'avc1'
+    uint8_t profile    = 0; // profile_idc
+    int32_t frameRate  = 0;
+
+    bool operator==(const MovSampleKey &o) const {
+        return width == o.width && height == o.height && codecType == o.codecType && profile == o.profile
+            && frameRate == o.frameRate;
+    }
+};
+
+struct MovSampleKeyHash {
+    size_t operator()(const MovSampleKey &key) const {
+        // every field is mixed in by its own multiply, so transposed sizes don't collide
+        uint64_t h = 0x9e3779b97f4a7c15ull;
+        for (uint64_t v : { (uint64_t)(uint32_t)key.width, (uint64_t)(uint32_t)key.height, (uint64_t)key.codecType,
+                            (uint64_t)key.profile, (uint64_t)(uint32_t)key.frameRate }) {
+            h = (h ^ v) * 0xff51afd7ed558ccdull;
+            h ^= h >> 32;
+        }
+        return (size_t)h;
+    }
+};
+
+struct MovSampleCacheStats {
+    uint64_t hits      = 0;
+    uint64_t misses    = 0;
+    uint64_t loads     = 0; // misses that ran the loader, the others waited for a load in flight
+    uint64_t evictions = 0;
+    size_t bytes       = 0;
+    size_t entries     = 0;
+};
+
+/// An LRU cache of immutable payloads split into shards by key, each shard has its own lock and an equal part of the byte budget,
+/// so lookups of different keys rarely wait for each other. Payloads are shared, an evicted payload lives until its last user drops it.
+/// A miss loads outside the lock and only once, concurrent misses of the same key wait for that load.
+template <class Payload>
+class MovSampleCache {
+public:
+    typedef std::shared_ptr<const Payload> Ref;
+
+    explicit MovSampleCache(size_t byteBudget, size_t shardCount = 8)
+    : shards(shardCount ? shardCount : 1), shardBudget(byteBudget / (shardCount ? shardCount : 1)) {}
+
+    MovSampleCache(const MovSampleCache &) = delete;
+
+    /// nullptr on a miss
+    Ref find(const MovSampleKey &key) {
+        Shard &shard = shardFor(key);
+        std::lock_guard<std::mutex> guard(shard.lock);
+        Ref ref = shard.touch(key);
+        ++(ref ? shard.stats.hits : shard.stats.misses);
+        return ref;
+    }
+
+    /// replaces the payload of key, bytes counts against the budget
+    void insert(const MovSampleKey &key, Ref payload, size_t bytes) {
+        if (!payload) {
+            return;
+        }
+        Shard &shard = shardFor(key);
+        std::lock_guard<std::mutex> guard(shard.lock);
+        shard.put(key, std::move(payload), bytes, shardBudget);
+    }
+
+    /// load(size_t &bytes) returns the payload of a miss or nullptr, which is not cached
+    template <class Load>
+    Ref findOrLoad(const MovSampleKey &key, Load &&load) {
+        Shard &shard = shardFor(key);
+        std::shared_ptr<Flight> flight;
+        {
+            std::unique_lock<std::mutex> guard(shard.lock);
+            if (Ref ref = shard.touch(key)) {
+                ++shard.stats.hits;
+                return ref;
+            }
+            ++shard.stats.misses;
+            auto &&slot = shard.loading[key];
+            if (slot) {
+                flight = slot;
+                shard.loaded.wait(guard, [&] {
+                    return flight->done;
+                });
+                return flight->payload;
+            }
+            flight = slot = std::make_shared<Flight>();
+            ++shard.stats.loads;
+        }
+        size_t bytes = 0;
+        Ref payload  = load(bytes);
+        {
+            std::lock_guard<std::mutex> guard(shard.lock);
+            shard.loading.erase(key);
+            flight->payload = payload;
+            flight->done    = true;
+            if (payload) {
+                shard.put(key, payload, bytes, shardBudget);
+            }
+        }
+        shard.loaded.notify_all();
+        return payload;
+    }
+
+    void erase(const MovSampleKey &key) {
+        Shard &shard = shardFor(key);
+        std::lock_guard<std::mutex> guard(shard.lock);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            shard.remove(it->second);
+        }
+    }
+
+    void clear() {
+        for (auto &&shard : shards) {
+            std::lock_guard<std::mutex> guard(shard.lock);
+            while (!shard.lru.empty()) {
+                shard.remove(shard.lru.begin());
+            }
+        }
+    }
+
+    /// the sum over the shards, each shard is consistent on its own
+    MovSampleCacheStats stats() {
+        MovSampleCacheStats total;
+        for (auto &&shard : shards) {
+            std::lock_guard<std::mutex> guard(shard.lock);
+            total.hits += shard.stats.hits;
+            total.misses += shard.stats.misses;
+            total.loads += shard.stats.loads;
+            total.evictions += shard.stats.evictions;
+            total.bytes += shard.stats.bytes;
+            total.entries += shard.lru.size();
+        }
+        return total;
+    }
+
+private:
+    struct Entry {
+        MovSampleKey key;
+        Ref payload;
+        size_t bytes;
+    };
+
+    struct Flight {
+        bool done = false;
+        Ref payload;
+    };
+
+    struct Shard {
+        std::mutex lock;
+        std::condition_variable loaded;
+        std::list<Entry> lru; // most recent first
+        std::unordered_map<MovSampleKey, typename std::list<Entry>::iterator, MovSampleKeyHash> index;
+        std::unordered_map<MovSampleKey, std::shared_ptr<Flight>, MovSampleKeyHash> loading;
+        MovSampleCacheStats stats;
+
+        Ref touch(const MovSampleKey &key) {
+            auto it = index.find(key);
+            if (it == index.end()) {
+                return nullptr;
+            }
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->payload;
+        }
+
+        void put(const MovSampleKey &key, Ref payload, size_t bytes, size_t budget) {
+            auto it = index.find(key);
+            if (it != index.end()) {
+                remove(it->second);
+            }
+            lru.push_front({ key, std::move(payload), bytes });
+            index[key] = lru.begin();
+            stats.bytes += bytes;
+            // the newest entry stays even if it alone is over the budget
+            while (stats.bytes > budget && lru.size() > 1) {
+                remove(std::prev(lru.end()));
+                ++stats.evictions;
+            }
+        }
+
+        void remove(typename std::list<Entry>::iterator it) {
+            stats.bytes -= it->bytes;
+            index.erase(it->key);
+            lru.erase(it);
+        }
+    };
+
+    std::vector<Shard> shards;
+    const size_t shardBudget;
+
+    Shard &shardFor(const MovSampleKey &key) {
+        return shards[MovSampleKeyHash()(key) % shards.size()];
+    }
+};
+
+} // namespace IVT
+#endif
+#endif /* IVTMovSampleCache_h */
@@ -0,0 +1,206 @@
+//
+//  IVTMovSampleIterator.h
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#ifndef IVTMovSampleIterator_h
+#define IVTMovSampleIterator_h
+
+#ifdef __cplusplus
+
+#include "IVTMovSegment.h"
+#include <cerrno>
+#include <vector>
+
+namespace IVT {
+
+/// Walks the samples of segments in timeline order, reading them in batches into a buffer of bufferSize bytes,
+/// so memory doesn't grow with the recording. A batch holds at least one sample, the buffer grows for a larger one.
+/// Held samples and the last sample before a gap between segments last for the frames they hold.
+class MovSampleIterator {
+public:
+    struct Batch {
+        const uint8_t *data = nullptr; // valid until the next call of next
+        size_t size = 0;
+        uint32_t firstSample = 0; // index in the track
+        uint64_t firstFrame  = 0; // where the first sample shows, in frames of the track
+        std::vector<size_t> sampleSizes;
+        std::vector<uint8_t> syncs;
+        std::vector<uint32_t> frames; // each sample lasts
+
+        bool last = false; // no sample follows
+    };
+
+    /// repeatLast copies of the last sample follow the segments, they are sync if the last sample is
+    template <class Segments>
+    MovSampleIterator(const Segments &segments, const MovTimeBase &timeBase, size_t bufferSize, uint32_t repeatLast = 0)
+    : bufferSize(bufferSize), repeatLeft(repeatLast) {
+        for (auto &&seg : segments) {
+            if (!seg->sampleSizes.empty()) {
+                if (!this->segments.empty()) {
+                    gaps.push_back((uint32_t)timeBase.gapFrames(this->segments.back()->writeEnd, seg->start));
+                }
+                this->segments.push_back(seg);
+                sampleCount += seg->sampleSizes.size();
+            }
+        }
+        gaps.push_back(0);
+        sampleCount += repeatLast;
+        if (!this->segments.empty()) {
+            enterSegment();
+        } else {
+            repeatLeft = 0;
+        }
+    }
+
+    MovSampleIterator(const MovSampleIterator &) = delete;
+
+    /// samples of the segments and the repeats
+    size_t size() const {
+        return sampleCount;
+    }
+
+    /// errno of the failed read, iteration stops at it
+    int error() const {
+        return readError;
+    }
+
+    /// false at the end or on error
+    bool next(Batch &batch) {
+        batch.sampleSizes.clear();
+        batch.syncs.clear();
+        batch.frames.clear();
+        batch.firstSample = nextSample;
+        batch.firstFrame  = nextFrame;
+        batch.size = 0;
+        if (readError) {
+            return false;
+        }
+        while (segmentIndex < segments.size() && !readError) {
+            if (!readRun(batch)) {
+                break;
+            }
+        }
+        if (segmentIndex >= segments.size() && !readError) {
+            repeatRun(batch);
+        }
+        batch.data = buffer.data();
+        batch.last = nextSample == sampleCount;
+        return !readError && !batch.sampleSizes.empty();
+    }
+
+private:
+    std::vector<const MovSeg *> segments;
+    std::vector<uint32_t> gaps; // frames missing after each segment
+    size_t bufferSize;
+    std::vector<uint8_t> buffer;
+    std::vector<uint8_t> lastSample; // for the repeats
+    bool lastSync = false;
+    uint32_t repeatLeft;
+    size_t sampleCount = 0;
+    uint32_t nextSample = 0;
+    uint64_t nextFrame  = 0;
+    int readError = 0;
+
+    size_t segmentIndex = 0;
+    uint32_t sampleInSegment = 0;
+    uint32_t segmentOffset = 0;
+    MovPackedTable::const_iterator sampleSize, keyFrame;
+    std::vector<MovHold>::const_iterator hold;
+    uint32_t held = 0;
+
+    void enterSegment() {
+        auto seg        = segments[segmentIndex];
+        sampleInSegment = 0;
+        segmentOffset   = 0;
+        sampleSize      = seg->sampleSizes.begin();
+        keyFrame        = seg->keyFrames.begin();
+        hold            = seg->holds.begin();
+        held            = 0;
+    }
+
+    bool fits(const Batch &batch, size_t size) const {
+        return batch.sampleSizes.empty() || batch.size + size <= bufferSize;
+    }
+
+    void reserve(size_t size) {
+        if (buffer.size() < size) {
+            buffer.resize(std::max(size, bufferSize));
+        }
+    }
+
+    /// read the samples of the current segment that fit, false if the batch is full
+    bool readRun(Batch &batch) {
+        auto seg = segments[segmentIndex];
+        size_t begin = batch.size, runSize = 0;
+        bool full = false;
+        for (; sampleInSegment < seg->sampleSizes.size(); ++sampleInSegment, ++sampleSize) {
+            uint32_t size = *sampleSize;
+            if (!fits(batch, size)) {
+                full = true;
+                break;
+            }
+            bool sync = keyFrame != seg->keyFrames.end() && *keyFrame == sampleInSegment + 1;
+            if (sync) {
+                ++keyFrame;
+            }
+            uint32_t frames = 1;
+            if (hold != seg->holds.end() && hold->sample == sampleInSegment) {
+                frames += hold->held - held;
+                held = hold->held;
+                ++hold;
+            }
+            if (sampleInSegment + 1 == seg->sampleSizes.size()) {
+                frames += gaps[segmentIndex];
+            }
+            batch.sampleSizes.push_back(size);
+            batch.syncs.push_back(sync);
+            batch.frames.push_back(frames);
+            batch.size += size;
+            runSize += size;
+            lastSync = sync;
+            ++nextSample;
+            nextFrame += frames;
+        }
+        reserve(batch.size);
+        if (runSize && seg->read(buffer.data() + begin, runSize, segmentOffset) != (long)runSize) {
+            readError = errno ?: EIO;
+            return false;
+        }
+        segmentOffset += runSize;
+        if (full) {
+            return false;
+        }
+        if (repeatLeft && segmentIndex + 1 == segments.size()) {
+            size_t lastSize = seg->sampleSizes.back();
+            lastSample.resize(lastSize);
+            if (seg->read(lastSample.data(), lastSize, seg->fileSize - lastSize) != (long)lastSize) {
+                readError = errno ?: EIO;
+                return false;
+            }
+        }
+        if (++segmentIndex < segments.size()) {
+            enterSegment();
+        }
+        return true;
+    }
+
+    void repeatRun(Batch &batch) {
+        for (; repeatLeft && fits(batch, lastSample.size()); --repeatLeft) {
+            reserve(batch.size + lastSample.size());
+            std::memcpy(buffer.data() + batch.size, lastSample.data(), lastSample.size());
+            batch.sampleSizes.push_back(lastSample.size());
+            batch.syncs.push_back(lastSync);
+            batch.frames.push_back(1);
+            batch.size += lastSample.size();
+            ++nextSample;
+            ++nextFrame;
+        }
+    }
+};
+
+} // namespace IVT
+#endif
+#endif /* IVTMovSampleIterator_h */
@@ -0,0 +1,310 @@
+//
+//  IVTMovSegment.h
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#ifndef IVTMovSegment_h
+#define IVTMovSegment_h
+
+#ifdef __cplusplus
+
+#include "IVTMovCacheStore.h"
+#include "IVTMovFormat.h"
+#include "IVTMovIO.h"
+#include "IVTMovPackedTable.h"
+#include "IVTMovSegmentLog.h"
+#include "IVTMovTimeline.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+namespace IVT {
+
+struct stsc {
+    uint firstChunk = 0;
+    uint sampleSize = 0;
+    static constexpr int sampleDescription = 1;
+
+    operator SampleToChunkAtom::SampleToChunkEntry() const {
+        return { firstChunk, sampleSize, sampleDescription };
+    }
+};
+
+/// a sample lasting longer than a frame, it holds through the slots of frames refused or dropped before the next one
+struct MovHold {
+    uint32_t sample = 0;
+    uint32_t held   = 0; // frames held by this sample and the ones before it in the segment
+};
+
+struct MovSeg {
+    MovTick start    = 0;
+    MovTick writeEnd = 0;
+    MovPackedTable sampleSizes;  // stsz Sample Size Atoms
+    MovPackedTable chunkOffsets; // stco Chunk Offset Atoms
+    std::vector<stsc> chunkSampleSizes;   // stsc Sample-to-Chunk Atoms
+    MovPackedTable keyFrames;    // stss sync sample atoms
+    std::vector<MovHold> holds;  // in sample order, the other samples last a frame
+
+    std::string path; // of the final segment
+    FD fd;            // of the final segment
+    uint fileSize = 0;
+    std::shared_ptr<MovIO> io;
+    std::shared_ptr<MovSegmentLog> log; // holds the data unless cached to memory
+    MovExtentList extents;
+    
+    MovCacheStore caches;
+    bool cacheToMemory;
+
+    int lastSample = 0;
+    int lastSampleOffset = 0;
+
+    MovSeg() {}
+    MovSeg(const MovSeg &) = delete;
+    MovSeg(MovSeg &&)      = default;
+
+    MovSeg &operator=(MovSeg &&) = default;
+
+    ~MovSeg() {
+        if (log) {
+            log->release(extents);
+        }
+    }
+
+    int keyFrameForSample(int sample) { //key frame is chunk start
+        int base = 0;
+        for (auto begin = chunkSampleSizes.begin(); begin != chunkSampleSizes.end(); begin++) {
+            auto endChunk = (begin + 1) == chunkSampleSizes.end() ? chunkOffsets.size() + 1 : (begin + 1)->firstChunk;
+            auto end      = base + begin->sampleSize * (endChunk - begin->firstChunk);
+            if (sample < end) {
+                return sample - (sample - base) % begin->sampleSize;
+            }
+            base = (int)end;
+        }
+        MOV_ASSERT(false);
+        return -1;
+    }
+    
+    bool validateChunks() {
+        size_t baseSample = 0;
+        size_t  totalSampleSize = 0;
+        for (auto begin = chunkSampleSizes.begin(); begin != chunkSampleSizes.end(); begin++) {
+            auto sampleSize = begin->sampleSize;
+            auto endChunk = (begin + 1) == chunkSampleSizes.end() ? chunkOffsets.size() + 1 : (begin + 1)->firstChunk;
+            for (auto i = begin->firstChunk; i < endChunk; i++) {
+                int chunkOffset = chunkOffsets[i - 1];
+                MOV_ASSERT(chunkOffset == totalSampleSize);
+                auto size = std::accumulate(sampleSizes.begin() + baseSample, sampleSizes.begin() + baseSample + sampleSize, 0);
+                totalSampleSize += size;
+                baseSample += sampleSize;
+            }
+        }
+        MOV_ASSERT(fileSize == totalSampleSize);
+        MOV_ASSERT(baseSample == sampleSizes.size());
+        return true;
+    }
+
+    /// frames held by the samples before sample
+    uint32_t heldBefore(uint32_t sample) const {
+        auto it = std::lower_bound(holds.begin(), holds.end(), sample, [](const MovHold &hold, uint32_t sample) {
+            return hold.sample < sample;
+        });
+        return it == holds.begin() ? 0 : (it - 1)->held;
+    }
+
+    /// frames from start to where sample shows
+    int64_t frameOfSample(uint32_t sample) const {
+        return sample + heldBefore(sample);
+    }
+
+    /// the sample showing at frames from start, past the last sample it is the sample that would come there
+    int sampleAtFrame(int64_t frame) const {
+        // the first hold ending at frame or after it
+        auto it = std::lower_bound(holds.begin(), holds.end(), frame, [](const MovHold &hold, int64_t frame) {
+            return hold.sample + hold.held < frame;
+        });
+        uint32_t before = it == holds.begin() ? 0 : (it - 1)->held;
+        if (it != holds.end() && frame >= it->sample + before) {
+            return (int)it->sample;
+        }
+        return (int)(frame - before);
+    }
+
+    /// the last sample lasts until the frame after it is shown at frame from start
+    void holdUntil(int64_t frame) {
+        if (sampleSizes.empty()) {
+            return;
+        }
+        uint32_t last = (uint32_t)sampleSizes.size() - 1;
+        if (!holds.empty() && holds.back().sample == last) {
+            holds.pop_back();
+        }
+        uint32_t before = holds.empty() ? 0 : holds.back().held;
+        int64_t extra   = frame - (last + before) - 1;
+        if (extra > 0) {
+            holds.push_back({ last, before + (uint32_t)extra });
+        }
+    }
+
+    /// make room in the tables for frames samples in gops GOPs, so appending them doesn't allocate
+    void reserve(size_t frames, size_t gops) {
+        sampleSizes.reserve(frames, 3); // deltas between key frames and the others take up to 3 bytes
+        keyFrames.reserve(gops);
+        chunkOffsets.reserve(gops, 4);
+        chunkSampleSizes.reserve(gops + 1); // eraseFrameNotLessThan may split the last run
+    }
+
+    /// merge adjacent stsc runs of the same samples per chunk
+    void compactChunkRuns() {
+        size_t kept = 0;
+        for (auto &&run : chunkSampleSizes) {
+            if (kept == 0 || chunkSampleSizes[kept - 1].sampleSize != run.sampleSize) {
+                chunkSampleSizes[kept++] = run;
+            }
+        }
+        chunkSampleSizes.resize(kept);
+    }
+    
+    void eraseFrameNotLessThan(int frame) {
+        int offset = offsetForSample(frame);
+        fileSize = offset;
+        if (cacheToMemory) {
+            caches.truncate(offset);
+        } else if (log) {
+            log->truncate(extents, offset);
+        }
+        long deletedSampleCount = sampleSizes.size() - frame;
+        for (auto i = chunkOffsets.size(); i--; ) {
+            auto chunk = i + 1;
+            auto&& back = chunkSampleSizes.back();
+            MOV_ASSERT(chunk >= back.firstChunk);
+            
+            deletedSampleCount -= back.sampleSize;
+            if (deletedSampleCount >= 0) {
+                chunkOffsets.pop_back();
+                if (chunk == back.firstChunk) {
+                    chunkSampleSizes.pop_back();
+                }
+            } else {
+                chunkSampleSizes.push_back({.firstChunk = (uint)chunk,.sampleSize = (uint) -deletedSampleCount});
+            }
+            
+            if (deletedSampleCount <= 0) {
+                break;
+            }
+        }
+        
+        sampleSizes.truncate(frame);
+        while (!holds.empty() && holds.back().sample >= (uint32_t)frame) {
+            holds.pop_back();
+        }
+        MOV_ASSERT(validateChunks());
+        while (!keyFrames.empty() && keyFrames.back() - 1 >= frame) {
+            keyFrames.pop_back();
+        }
+
+    }
+    int offsetForSample(int sample) {
+        if (abs(lastSample - sample) < 10) {
+            bool neg = lastSample > sample;
+            int sum = 0, i = neg ? sample : lastSample , end = neg ? lastSample : sample;
+            for (auto it = sampleSizes.iteratorAt(i); i != end; ++i, ++it) {
+                sum += *it;
+            }
+            lastSample = sample;
+            lastSampleOffset = neg ? lastSampleOffset - sum : lastSampleOffset + sum;
+            return lastSampleOffset;
+        } else {
+            int base = 0;
+            for (auto begin = chunkSampleSizes.begin(); begin != chunkSampleSizes.end(); begin++) {
+                auto endChunk = (begin + 1) != chunkSampleSizes.end() ? (begin + 1)->firstChunk : chunkOffsets.size() + 1;
+                auto end      = base + begin->sampleSize * (endChunk - begin->firstChunk);
+                if (sample < end) {
+                    int chunk        = begin->firstChunk + (sample - base) / begin->sampleSize;
+                    int offset       = (sample - base) % begin->sampleSize;
+                    int sampleOffset = chunkOffsets[chunk - 1];
+                    for (auto it = sampleSizes.iteratorAt(sample - offset); offset; --offset, ++it) {
+                        sampleOffset += *it;
+                    }
+                    lastSample       = sample;
+                    lastSampleOffset = sampleOffset;
+                    return sampleOffset;
+                }
+                base = (int)end;
+            }
+        }
+        return -1;
+    }
+    
+    long append(const char* ptr, size_t length) {
+        auto fileSize = this->fileSize;
+        auto ret = write(ptr, length, fileSize);
+        if (ret == -1) {
+            return -1;
+        }
+        this->fileSize = uint(fileSize + length);
+        return length;
+    }
+    
+    long write(const char* ptr, size_t length, off_t offset) {
+        if (cacheToMemory) {
+            return writeToCache(ptr, length, offset);
+        }
+        MOV_ASSERT(offset == fileSize && "the log only appends");
+        return log->append(extents, ptr, length);
+    }
+    
+    long writeToCache(const char* ptr, size_t length, off_t offset) {
+        MOV_ASSERT(offset == caches.size() && "the cache only appends");
+        caches.append(ptr, length);
+        return length;
+    }
+    
+    int writeToFD(int fd, off_t offset, bool direct) {
+        if (cacheToMemory) {
+            return caches.forEachBlock([&](const char *data, size_t length, size_t start) {
+                return io->queueWrite(fd, data, length, offset + start);
+            });
+        }
+        return log->copyTo(extents, fd, offset, direct);
+    }
+    
+    long readToMemory(void* ptr) {
+        if (cacheToMemory) {
+            return readFromCache(ptr, 0 , caches.size());
+        }
+        return log->read(extents, ptr, fileSize, 0);
+    }
+    
+    long read(void* ptr, size_t length, off_t offset) const {
+        if (cacheToMemory) {
+            return readFromCache(ptr, offset, length);
+        }
+        return log->read(extents, ptr, length, offset);
+    }
+    
+    long readFromCache(void *target, size_t offset, size_t size) const {
+        return caches.read(target, size, offset);
+    }
+
+    /// pins the cached bytes for reading in place, false if the segment isn't cached to memory
+    bool pin(MovCacheView &view, size_t length, off_t offset) const {
+        return cacheToMemory && caches.view(view, length, offset);
+    }
+    
+    bool check() const {
+        if (cacheToMemory) {
+            return fileSize == caches.size();
+        }
+        return (log ? log->length(extents) : 0) == fileSize;
+    }
+};
+
+} // namespace IVT
+#endif
+#endif /* IVTMovSegment_h */
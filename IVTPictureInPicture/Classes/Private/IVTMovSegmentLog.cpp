@@ -0,0 +1,330 @@
+//
+//  IVTMovSegmentLog.cpp
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#include "IVTMovSegmentLog.h"
+#include "IVTMovTrace.h"
+#include <stdio.h>
+#if defined(__APPLE__)
+#include <pthread.h>
+#endif
+
+namespace IVT {
+
+int MovSegmentLog::openLog(const std::string &path) {
+    int fd = open(path.data(), O_CREAT | O_TRUNC | O_RDWR, 0660);
+#ifdef F_RDAHEAD
+    if (fd != -1) {
+        fcntl(fd, F_RDAHEAD, 1);
+        fcntl(fd, F_NOCACHE, 0);
+    }
+#endif
+    return fd;
+}
+
+MovSegmentLog::MovSegmentLog(std::string path, std::shared_ptr<MovIO> io, off_t extentSize)
+: path(std::move(path)), io(std::move(io)) {
+    fd = openLog(this->path);
+    openError = fd == -1 ? errno : 0;
+    prealloc.extentSize = extentSize;
+}
+
+MovSegmentLog::~MovSegmentLog() {
+    {
+        std::lock_guard<std::mutex> guard(compactorLock);
+        stopping = true;
+    }
+    compactorWakeup.notify_one();
+    if (compactor.joinable()) {
+        compactor.join();
+    }
+    if (fd != -1) {
+        io->flush();
+        close(fd);
+        unlink(path.data());
+    }
+}
+
+void MovSegmentLog::attach(MovExtentList &extents, int64_t order) {
+    std::lock_guard<MovRWLock> guard(lock);
+    attached.push_back({ &extents, order });
+}
+
+long MovSegmentLog::append(MovExtentList &extents, const char *ptr, size_t length) {
+    std::lock_guard<MovRWLock> guard(lock);
+    if (fd == -1) {
+        errno = openError;
+        return -1;
+    }
+    prealloc.ensure(fd, tail + length);
+    if (int err = io->queueWrite(fd, ptr, length, tail)) {
+        errno = err;
+        return -1;
+    }
+    uint32_t offset = extents.empty() ? 0 : extents.back().offset + extents.back().length;
+    if (!extents.empty() && extents.back().position + extents.back().length == tail) {
+        extents.back().length += length;
+    } else {
+        extents.push_back({ offset, (uint32_t)length, tail });
+    }
+    tail += length;
+    return length;
+}
+
+void MovSegmentLog::truncate(MovExtentList &extents, uint32_t size) {
+    std::lock_guard<MovRWLock> guard(lock);
+    while (!extents.empty()) {
+        MovExtent &last = extents.back();
+        if (last.offset >= size) {
+            garbage += last.length;
+            extents.pop_back();
+        } else {
+            uint32_t keep = size - last.offset;
+            if (keep < last.length) {
+                garbage += last.length - keep;
+                last.length = keep;
+            }
+            break;
+        }
+    }
+    requestCompaction();
+}
+
+void MovSegmentLog::release(MovExtentList &extents) {
+    std::lock_guard<MovRWLock> guard(lock);
+    for (auto &&extent : extents) {
+        garbage += extent.length;
+    }
+    extents.clear();
+    attached.erase(std::remove_if(attached.begin(), attached.end(), [&](const Attached &entry) {
+        return entry.extents == &extents;
+    }), attached.end());
+    if (!attached.empty()) {
+        requestCompaction();
+    }
+}
+
+uint32_t MovSegmentLog::length(const MovExtentList &extents) {
+    MovSharedGuard guard(lock);
+    uint32_t length = 0;
+    for (auto &&extent : extents) {
+        length += extent.length;
+    }
+    return length;
+}
+
+long MovSegmentLog::read(const MovExtentList &extents, void *ptr, size_t length, off_t offset) {
+    MovSharedGuard guard(lock);
+    auto it = std::upper_bound(extents.begin(), extents.end(), offset, [](off_t offset, const MovExtent &extent) {
+        return offset < extent.offset;
+    });
+    if (it == extents.begin()) {
+        return length == 0 ? 0 : -1;
+    }
+    --it;
+    char *buf  = (char *)ptr;
+    long total = 0;
+    for (; length && it != extents.end(); ++it) {
+        off_t skip = offset - it->offset;
+        if (skip >= it->length) {
+            break;
+        }
+        size_t count = std::min(length, (size_t)(it->length - skip));
+        long read    = io->read(fd, buf, count, it->position + skip);
+        if (read == -1) {
+            return -1;
+        }
+        total += read;
+        if (read < (long)count) {
+            break;
+        }
+        buf += count;
+        offset += count;
+        length -= count;
+    }
+    return total;
+}
+
+int MovSegmentLog::copyTo(const MovExtentList &extents, int outFd, off_t offset, bool direct) {
+    MovSharedGuard guard(lock);
+    for (auto &&extent : extents) {
+        if (int err = io->queueCopy(fd, extent.position, outFd, offset, extent.length, direct)) {
+            return err;
+        }
+        offset += extent.length;
+    }
+    return 0;
+}
+
+void MovSegmentLog::requestCompaction() {
+    if (fd == -1 || !shouldCompact()) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(compactorLock);
+    if (stopping) {
+        return;
+    }
+    compactRequested = true;
+    if (!compactor.joinable()) {
+        compactor = std::thread([this] { compactorLoop(); });
+    }
+    compactorWakeup.notify_one();
+}
+
+void MovSegmentLog::compactorLoop() {
+#if defined(__APPLE__)
+    pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+#endif
+    std::unique_lock<std::mutex> guard(compactorLock);
+    while (true) {
+        compactorWakeup.wait(guard, [this] { return compactRequested || stopping; });
+        if (stopping) {
+            return;
+        }
+        compactRequested = false;
+        guard.unlock();
+        compact(); // the log stays valid if it fails
+        guard.lock();
+    }
+}
+
+namespace {
+
+/// bytes [from, from + length) of the old file are at to in the new one
+struct MovRemap {
+    off_t from;
+    off_t length;
+    off_t to;
+};
+
+int copyRange(MovIO &io, int inFd, off_t inOffset, int outFd, off_t outOffset, off_t length, char *buffer, size_t bufferSize) {
+    while (length) {
+        size_t count = (size_t)std::min((off_t)bufferSize, length);
+        long read    = io.read(inFd, buffer, count, inOffset);
+        if (read < (long)count) {
+            return read == -1 ? errno : EIO;
+        }
+        if (MovSyncIO::pwriteAll(outFd, buffer, count, outOffset) == -1) {
+            return errno;
+        }
+        length -= count;
+        inOffset += count;
+        outOffset += count;
+    }
+    return 0;
+}
+
+/// extents moved to the new file, false if a byte of them wasn't copied
+bool remapExtents(const MovExtentList &extents, const std::vector<MovRemap> &remaps, MovExtentList &out) {
+    for (auto &&extent : extents) {
+        off_t position  = extent.position;
+        uint32_t offset = extent.offset;
+        uint32_t left   = extent.length;
+        while (left) {
+            auto it = std::upper_bound(remaps.begin(), remaps.end(), position, [](off_t position, const MovRemap &remap) {
+                return position < remap.from;
+            });
+            if (it == remaps.begin() || position >= (--it)->from + it->length) {
+                return false;
+            }
+            uint32_t count = (uint32_t)std::min((off_t)left, it->from + it->length - position);
+            off_t to       = it->to + (position - it->from);
+            if (!out.empty() && out.back().offset + out.back().length == offset && out.back().position + out.back().length == to) {
+                out.back().length += count;
+            } else {
+                out.push_back({ offset, count, to });
+            }
+            position += count;
+            offset += count;
+            left -= count;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int MovSegmentLog::compact() {
+    MOV_TRACE_SPAN("log compaction");
+    static constexpr size_t kCopyBufferSize = 256 * 1024;
+    std::vector<MovRemap> remaps;
+    off_t copied = 0, snapshotTail = 0;
+    int oldFd = -1;
+    bool reserve = false;
+    {
+        std::lock_guard<MovRWLock> guard(lock);
+        if (fd == -1) {
+            return openError;
+        }
+        std::stable_sort(attached.begin(), attached.end(), [](const Attached &a, const Attached &b) {
+            return a.order < b.order;
+        });
+        for (auto &&entry : attached) {
+            for (auto &&extent : *entry.extents) {
+                remaps.push_back({ extent.position, extent.length, copied });
+                copied += extent.length;
+            }
+        }
+        snapshotTail = tail;
+        oldFd        = fd;
+        reserve      = prealloc.extentSize != 0;
+    }
+    std::string compactPath = path + ".compact";
+    int newFd = openLog(compactPath);
+    if (newFd == -1) {
+        return errno;
+    }
+    if (reserve) {
+        preallocateFile(newFd, 0, copied);
+    }
+    // only this thread replaces fd, and the bytes below snapshotTail stay as they are, truncation only marks them garbage
+    std::unique_ptr<char[]> buffer(new char[kCopyBufferSize]);
+    int err = 0;
+    for (auto it = remaps.begin(); !err && it != remaps.end(); ++it) {
+        err = stopping ? ECANCELED : copyRange(*io, oldFd, it->from, newFd, it->to, it->length, buffer.get(), kCopyBufferSize);
+    }
+
+    std::lock_guard<MovRWLock> guard(lock);
+    // appended while copying, the only bytes copied with appends held off
+    off_t appended = tail - snapshotTail;
+    if (!err && appended) {
+        err = copyRange(*io, fd, snapshotTail, newFd, copied, appended, buffer.get(), kCopyBufferSize);
+        remaps.push_back({ snapshotTail, appended, copied });
+    }
+    std::sort(remaps.begin(), remaps.end(), [](const MovRemap &a, const MovRemap &b) {
+        return a.from < b.from;
+    });
+    std::vector<MovExtentList> lists(attached.size());
+    for (size_t i = 0; !err && i < attached.size(); ++i) {
+        if (!remapExtents(*attached[i].extents, remaps, lists[i])) {
+            err = EINVAL;
+        }
+    }
+    // copies queued by copyTo may still read the old file
+    err = err ?: io->flush();
+    if (err || rename(compactPath.data(), path.data()) != 0) {
+        err = err ?: errno;
+        close(newFd);
+        unlink(compactPath.data());
+        return err;
+    }
+    close(fd);
+    fd = newFd;
+    off_t live = 0;
+    for (size_t i = 0; i < attached.size(); ++i) {
+        for (auto &&extent : lists[i]) {
+            live += extent.length;
+        }
+        *attached[i].extents = std::move(lists[i]);
+    }
+    // bytes truncated while copying came along, they stay garbage
+    tail    = copied + appended;
+    garbage = tail - live;
+    prealloc.reserved = reserve ? copied : 0;
+    return 0;
+}
+
+} // namespace IVT
@@ -0,0 +1,156 @@
+//
+//  IVTMovSegmentLog.h
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#ifndef IVTMovSegmentLog_h
+#define IVTMovSegmentLog_h
+
+#ifdef __cplusplus
+
+#include "IVTMovIO.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <pthread.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace IVT {
+
+/// bytes [offset, offset + length) of a segment stored at position of the log
+struct MovExtent {
+    uint32_t offset = 0;
+    uint32_t length = 0;
+    off_t position  = 0;
+};
+
+typedef std::vector<MovExtent> MovExtentList;
+
+/// readers share it, a writer holds it alone. std::shared_mutex needs iOS 10, the pod targets 9
+class MovRWLock {
+public:
+    MovRWLock() {
+        pthread_rwlock_init(&rwlock, nullptr);
+    }
+    MovRWLock(const MovRWLock &) = delete;
+    ~MovRWLock() {
+        pthread_rwlock_destroy(&rwlock);
+    }
+
+    void lock() {
+        pthread_rwlock_wrlock(&rwlock);
+    }
+    void unlock() {
+        pthread_rwlock_unlock(&rwlock);
+    }
+    void lock_shared() {
+        pthread_rwlock_rdlock(&rwlock);
+    }
+    void unlock_shared() {
+        pthread_rwlock_unlock(&rwlock);
+    }
+
+private:
+    pthread_rwlock_t rwlock;
+};
+
+/// holds a MovRWLock shared for its scope, std::lock_guard holds it alone
+class MovSharedGuard {
+public:
+    explicit MovSharedGuard(MovRWLock &lock) : lock(lock) {
+        lock.lock_shared();
+    }
+    MovSharedGuard(const MovSharedGuard &) = delete;
+    ~MovSharedGuard() {
+        lock.unlock_shared();
+    }
+
+private:
+    MovRWLock &lock;
+};
+
+/// One append-only file holding the data of all segments of a muxer, each segment is a list of extents.
+/// Truncated data stays in the file as garbage until compaction rewrites the live extents in segment order.
+/// Compaction runs on a thread of the log once truncations leave enough garbage. Bytes below the tail are never
+/// rewritten, so it copies them without the lock, and takes it alone only to copy what was appended meanwhile and swap the file.
+/// Reads share the lock, so they run in parallel with each other, appends take it alone.
+class MovSegmentLog {
+public:
+    static constexpr off_t kCompactMinGarbage = 8 * 1024 * 1024;
+
+    /// the file is created at path, unlinked when the log is destroyed
+    MovSegmentLog(std::string path, std::shared_ptr<MovIO> io, off_t extentSize);
+    MovSegmentLog(const MovSegmentLog &) = delete;
+    ~MovSegmentLog();
+
+    /// errno if the file can't be opened
+    int error() const {
+        return fd == -1 ? openError : 0;
+    }
+
+    /// extents hold the data of a segment starting at order, compaction lays the segments out by order.
+    /// extents must stay at its address until released
+    void attach(MovExtentList &extents, int64_t order);
+    /// append to the end of extents, -1 with errno on error
+    long append(MovExtentList &extents, const char *ptr, size_t length);
+    /// drop the bytes from size on, they become garbage
+    void truncate(MovExtentList &extents, uint32_t size);
+    /// the segment is gone, all of its bytes become garbage, extents is detached
+    void release(MovExtentList &extents);
+    /// bytes held by extents, compaction may rewrite the list at any time
+    uint32_t length(const MovExtentList &extents);
+
+    long read(const MovExtentList &extents, void *ptr, size_t length, off_t offset);
+    /// queue a copy of all the extents to fd at offset
+    int copyTo(const MovExtentList &extents, int fd, off_t offset, bool direct);
+
+    /// rewrite the live extents of the attached lists in order into a new file, on the calling thread
+    int compact();
+
+    off_t garbageSize() const {
+        MovSharedGuard guard(lock);
+        return garbage;
+    }
+
+    off_t size() const {
+        MovSharedGuard guard(lock);
+        return tail;
+    }
+
+private:
+    const std::string path;
+    const std::shared_ptr<MovIO> io;
+    int fd        = -1;
+    int openError = 0;
+    off_t tail    = 0;
+    off_t garbage = 0;
+    MovPreallocation prealloc;
+    mutable MovRWLock lock;
+    struct Attached {
+        MovExtentList *extents;
+        int64_t order;
+    };
+    std::vector<Attached> attached;
+
+    std::thread compactor;
+    std::mutex compactorLock;
+    std::condition_variable compactorWakeup;
+    bool compactRequested = false;
+    std::atomic<bool> stopping{ false };
+
+    static int openLog(const std::string &path);
+    bool shouldCompact() const {
+        return garbage >= kCompactMinGarbage && garbage > tail - garbage;
+    }
+    /// wake the compactor if truncations left enough garbage, called with the lock held
+    void requestCompaction();
+    void compactorLoop();
+};
+
+} // namespace IVT
+#endif
+#endif /* IVTMovSegmentLog_h */
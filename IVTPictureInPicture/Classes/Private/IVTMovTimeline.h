@@ -0,0 +1,160 @@
+//
+//  IVTMovTimeline.h
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#ifndef IVTMovTimeline_h
+#define IVTMovTimeline_h
+
+#ifdef __cplusplus
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace IVT {
+
+/// time in ticks of the track timescale, every timestamp is converted once at ingest
+typedef int64_t MovTick;
+static constexpr MovTick kMovTickInvalid = INT64_MIN;
+
+struct MovTimeBase {
+    int32_t timeScale  = 1;
+    int32_t frameRate  = 1;
+    MovTick frameTicks = 1; // ticks of one frame, timeScale is expected to be a multiple of frameRate
+
+    MovTimeBase() {}
+    MovTimeBase(int32_t frameRate, int32_t timeScale)
+    : timeScale(timeScale), frameRate(frameRate), frameTicks(std::max<MovTick>(1, timeScale / frameRate)) {}
+
+    /// snap (value / scale) seconds to the frame grid and return it in ticks
+    MovTick ticks(int64_t value, int32_t scale) const {
+        if (scale == 0) {
+            return kMovTickInvalid;
+        }
+        if (scale == timeScale && frameTicks == 1) {
+            return value;
+        }
+        return value * frameRate / scale * frameTicks;
+    }
+
+    MovTick ticksForFrames(int64_t frames) const {
+        return frames * frameTicks;
+    }
+
+    int64_t framesForTicks(MovTick ticks) const {
+        return frameTicks == 1 ? ticks : ticks / frameTicks;
+    }
+
+    /// frames missing between the frame at lastEnd and the one at nextStart, 0 if nextStart follows or comes before it
+    int64_t gapFrames(MovTick lastEnd, MovTick nextStart) const {
+        return nextStart > lastEnd + frameTicks ? framesForTicks(nextStart - lastEnd) - 1 : 0;
+    }
+};
+
+/// Segments sorted by start tick, looked up with a binary search.
+/// Seg must expose `MovTick start` and `MovTick writeEnd`(inclusive), update is called when either changes.
+/// Segments overlap when a newer one written from a seek back runs over older ones, a new segment always starts
+/// where no segment covers it, so where segments overlap the one starting earlier was written later.
+/// A sample after a gap goes to the segment before the gap, which holds its last sample through it.
+template <class Seg>
+class MovTimeline {
+    std::vector<Seg *> segments;
+    std::vector<MovTick> maxEnds; // the greatest writeEnd of segments up to each one, find searches it
+
+    struct StartLess {
+        bool operator()(MovTick tick, const Seg *seg) const {
+            return tick < seg->start;
+        }
+        bool operator()(const Seg *seg, MovTick tick) const {
+            return seg->start < tick;
+        }
+    };
+
+    /// maxEnds from index on, it stops where an entry keeps its value as the ones after depend on it only
+    void updateMaxEnds(size_t index) {
+        for (size_t i = index; i < segments.size(); ++i) {
+            MovTick maxEnd = i == 0 ? segments[i]->writeEnd : std::max(maxEnds[i - 1], segments[i]->writeEnd);
+            if (i > index && maxEnds[i] == maxEnd) {
+                break;
+            }
+            maxEnds[i] = maxEnd;
+        }
+    }
+
+public:
+    typedef typename std::vector<Seg *>::const_iterator const_iterator;
+
+    const_iterator begin() const { return segments.begin(); }
+    const_iterator end() const { return segments.end(); }
+    size_t size() const { return segments.size(); }
+    bool empty() const { return segments.empty(); }
+    Seg *front() const { return segments.front(); }
+    Seg *back() const { return segments.back(); }
+
+    /// the segment with the greatest start not after tick
+    Seg *floor(MovTick tick) const {
+        auto it = std::upper_bound(segments.begin(), segments.end(), tick, StartLess());
+        return it == segments.begin() ? nullptr : *(it - 1);
+    }
+
+    /// the newest segment whose written range covers tick, the first covering it in start order.
+    /// The segments before the first whose maxEnds reaches tick all end before it, that one covers tick if it starts by it.
+    /// slack extends each range, a frame of it finds the segment a sample continues
+    Seg *find(MovTick tick, MovTick slack = 0) const {
+        auto it = std::lower_bound(maxEnds.begin(), maxEnds.end(), tick - slack);
+        if (it == maxEnds.end()) {
+            return nullptr;
+        }
+        Seg *seg = segments[it - maxEnds.begin()];
+        return seg->start <= tick ? seg : nullptr;
+    }
+
+    void reserve(size_t n) {
+        segments.reserve(n);
+        maxEnds.reserve(n);
+    }
+
+    void insert(Seg *seg) {
+        auto it = std::upper_bound(segments.begin(), segments.end(), seg->start, StartLess());
+        size_t index = it - segments.begin();
+        segments.insert(it, seg);
+        maxEnds.insert(maxEnds.begin() + index, seg->writeEnd);
+        updateMaxEnds(index);
+    }
+
+    /// the start or writeEnd of seg changed, usually the end of the segment being written grows
+    void update(Seg *seg) {
+        auto range = std::equal_range(segments.begin(), segments.end(), seg->start, StartLess());
+        auto it    = std::find(range.first, range.second, seg);
+        if (it == range.second) {
+            it = std::find(segments.begin(), segments.end(), seg);
+            if (it == segments.end()) {
+                return;
+            }
+        }
+        if ((it != segments.begin() && seg->start < (*(it - 1))->start) || (it + 1 != segments.end() && (*(it + 1))->start < seg->start)) {
+            // moved by a new start
+            size_t index = it - segments.begin();
+            segments.erase(it);
+            maxEnds.erase(maxEnds.begin() + index);
+            if (index < segments.size()) {
+                updateMaxEnds(index);
+            }
+            insert(seg);
+            return;
+        }
+        updateMaxEnds(it - segments.begin());
+    }
+
+    void clear() {
+        segments.clear();
+        maxEnds.clear();
+    }
+};
+
+} // namespace IVT
+#endif
+#endif /* IVTMovTimeline_h */
@@ -0,0 +1,171 @@
+//
+//  IVTMovTrace.cpp
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#include "IVTMovTrace.h"
+#include <algorithm>
+#include <chrono>
+#include <errno.h>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <stdio.h>
+#include <vector>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace IVT {
+
+std::atomic<bool> MovTrace::sEnabled { false };
+
+namespace {
+
+struct TraceEvent {
+    std::atomic<const char *> name { nullptr };
+    std::atomic<uint64_t> begin { 0 };
+    std::atomic<uint64_t> end { 0 };
+    std::atomic<uint64_t> tid { 0 };
+};
+
+/// written by one thread at a time, a ring is handed to a new thread when its owner exits
+struct TraceRing {
+    std::atomic<uint64_t> head { 0 }; // count of events ever written
+    std::atomic<bool> owned { true };
+    TraceEvent events[MovTrace::kRingSize];
+};
+
+std::mutex sRingsLock;
+std::vector<std::unique_ptr<TraceRing>> *sRings = new std::vector<std::unique_ptr<TraceRing>>(); // never freed, threads may exit after static destruction
+
+uint64_t currentThreadId() {
+#if defined(__APPLE__)
+    uint64_t tid = 0;
+    pthread_threadid_np(nullptr, &tid);
+    return tid;
+#elif defined(__linux__)
+    return (uint64_t)syscall(SYS_gettid);
+#else
+    return (uint64_t)(uintptr_t)pthread_self();
+#endif
+}
+
+struct ThreadRing {
+    TraceRing *ring = nullptr;
+    uint64_t tid    = 0;
+
+    TraceRing *get() {
+        if (ring) {
+            return ring;
+        }
+        tid = currentThreadId();
+        std::lock_guard<std::mutex> guard(sRingsLock);
+        for (auto &&candidate : *sRings) {
+            bool expected = false;
+            if (candidate->owned.compare_exchange_strong(expected, true)) {
+                ring = candidate.get();
+                return ring;
+            }
+        }
+        sRings->emplace_back(new TraceRing());
+        ring = sRings->back().get();
+        return ring;
+    }
+
+    ~ThreadRing() {
+        if (ring) {
+            ring->owned.store(false);
+        }
+    }
+};
+
+thread_local ThreadRing sThreadRing;
+
+} // namespace
+
+uint64_t MovTrace::now() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void MovTrace::record(const char *name, uint64_t begin, uint64_t end) {
+    TraceRing *ring   = sThreadRing.get();
+    uint64_t head     = ring->head.load(std::memory_order_relaxed);
+    TraceEvent &event = ring->events[head % kRingSize];
+    event.name.store(name, std::memory_order_relaxed);
+    event.begin.store(begin, std::memory_order_relaxed);
+    event.end.store(end, std::memory_order_relaxed);
+    event.tid.store(sThreadRing.tid, std::memory_order_relaxed);
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+std::string MovTrace::dumpJSON() {
+    struct Span {
+        const char *name;
+        uint64_t begin, end, tid;
+    };
+    std::vector<Span> spans;
+    {
+        std::lock_guard<std::mutex> guard(sRingsLock);
+        for (auto &&ring : *sRings) {
+            uint64_t head  = ring->head.load(std::memory_order_acquire);
+            uint64_t first = head > kRingSize ? head - kRingSize : 0;
+            size_t start   = spans.size();
+            for (uint64_t i = first; i < head; ++i) {
+                TraceEvent &event = ring->events[i % kRingSize];
+                spans.push_back({ event.name.load(std::memory_order_relaxed), event.begin.load(std::memory_order_relaxed),
+                                  event.end.load(std::memory_order_relaxed), event.tid.load(std::memory_order_relaxed) });
+            }
+            // the events overwritten while copying are dropped
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t after = ring->head.load(std::memory_order_relaxed);
+            if (after > kRingSize && after - kRingSize > first) {
+                size_t overwritten = (size_t)std::min(after - kRingSize - first, head - first);
+                spans.erase(spans.begin() + start, spans.begin() + start + overwritten);
+            }
+        }
+    }
+    std::sort(spans.begin(), spans.end(), [](const Span &a, const Span &b) { return a.begin < b.begin; });
+
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    char buffer[256];
+    bool first = true;
+    for (auto &&span : spans) {
+        if (!span.name) {
+            continue;
+        }
+        snprintf(buffer, sizeof(buffer), "%s{\"name\":\"%s\",\"cat\":\"mov\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%llu}",
+                 first ? "" : ",", span.name, span.begin / 1000.0, (span.end - span.begin) / 1000.0, (unsigned long long)span.tid);
+        json += buffer;
+        first = false;
+    }
+    json += "]}";
+    return json;
+}
+
+} // namespace IVT
+
+void IVTMovTraceSetEnabled(bool enabled) {
+    IVT::MovTrace::setEnabled(enabled);
+}
+
+bool IVTMovTraceIsEnabled(void) {
+    return IVT::MovTrace::enabled();
+}
+
+int IVTMovTraceDump(const char *path) {
+    std::string json = IVT::MovTrace::dumpJSON();
+    FILE *file       = fopen(path, "w");
+    if (!file) {
+        return errno;
+    }
+    size_t written = fwrite(json.data(), 1, json.size(), file);
+    int err        = written == json.size() ? 0 : errno ?: EIO;
+    if (fclose(file) != 0 && !err) {
+        err = errno;
+    }
+    return err;
+}
@@ -0,0 +1,85 @@
+//
+//  IVTMovTrace.h
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#ifndef IVTMovTrace_h
+#define IVTMovTrace_h
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// start or stop recording the trace spans, recorded spans are kept
+void IVTMovTraceSetEnabled(bool enabled);
+bool IVTMovTraceIsEnabled(void);
+/// write the recorded spans to path as Chrome/Perfetto trace JSON, 0 or errno
+int IVTMovTraceDump(const char *path);
+
+#ifdef __cplusplus
+}
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace IVT {
+
+/// Spans are kept in a ring buffer per thread, only the owning thread writes it,
+/// so recording takes no lock. The oldest spans are overwritten when it is full.
+class MovTrace {
+public:
+    static constexpr size_t kRingSize = 4096;
+
+    static bool enabled() {
+        return sEnabled.load(std::memory_order_relaxed);
+    }
+
+    static void setEnabled(bool enabled) {
+        sEnabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    static uint64_t now();
+
+    /// name must be a string literal, it is stored as the pointer
+    static void record(const char *name, uint64_t begin, uint64_t end);
+
+    /// {"traceEvents": [...]} of all the threads, complete events in microseconds
+    static std::string dumpJSON();
+
+private:
+    static std::atomic<bool> sEnabled;
+};
+
+class MovTraceSpan {
+    const char *name;
+    uint64_t begin;
+
+public:
+    explicit MovTraceSpan(const char *name) : name(name), begin(MovTrace::enabled() ? MovTrace::now() : 0) {}
+    MovTraceSpan(const MovTraceSpan &) = delete;
+
+    /// close the span before the end of the scope
+    void end() {
+        if (begin) {
+            MovTrace::record(name, begin, MovTrace::now());
+            begin = 0;
+        }
+    }
+
+    ~MovTraceSpan() {
+        end();
+    }
+};
+
+#define MOV_TRACE_CONCAT_(a, b) a##b
+#define MOV_TRACE_CONCAT(a, b) MOV_TRACE_CONCAT_(a, b)
+#define MOV_TRACE_SPAN(name) IVT::MovTraceSpan MOV_TRACE_CONCAT(_movTraceSpan, __LINE__)(name)
+
+} // namespace IVT
+#endif
+#endif /* IVTMovTrace_h */
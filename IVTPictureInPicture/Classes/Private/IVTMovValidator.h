@@ -0,0 +1,345 @@
+//
+//  IVTMovValidator.h
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#ifndef IVTMovValidator_h
+#define IVTMovValidator_h
+
+#ifdef __cplusplus
+
+#include "IVTMovDataType.h"
+#include <algorithm>
+
+namespace IVT {
+
+#define CheckMovResult(exp)  \
+    ({                       \
+        auto _result = exp;  \
+        if (!_result) {      \
+            return _result;  \
+        };                   \
+    })
+
+struct MovCheckResult {
+    enum Error {
+        OK = 0,
+        BOX_SIZE,        // box sizes don't add up to their parent or the file
+        MISSING_BOX,     // a required box is absent
+        TABLE_SIZE,      // entry count of a table exceeds its box
+        CHUNK_OFFSET,    // chunk offsets not monotonic, overlapping or out of mdat
+        SAMPLE_TO_CHUNK, // stsc runs malformed or not covering stsz
+        SYNC_SAMPLE,     // stss entries not increasing or out of range
+        SAMPLE_TIME,     // stts doesn't cover stsz
+        NAL_LENGTH,      // NAL unit lengths don't add up to the sample size
+    };
+    Error error         = OK;
+    const char *message = "";
+    uint64_t position   = 0; // file offset where the error is found
+
+    operator bool() const {
+        return error == OK;
+    }
+};
+
+/// Layout of the first track gathered while validating, for tuning the chunk policy of finish.
+struct MovLayoutStats {
+    uint64_t readSize   = 0; // bytes of one player read, reads are counted if set
+    uint64_t moovSize   = 0;
+    uint64_t chunkCount = 0;
+    uint64_t runCount   = 0; // stsc entries
+    uint64_t reads      = 0; // to load the chunks in order, each chunk starts a new read
+};
+
+/// Checks the sample tables of the first track and the mdat of a movie in one pass without allocation,
+/// cheap enough to run on every finished file.
+class MovValidator {
+    struct Range {
+        uint64_t begin = 0;
+        uint64_t end   = 0;
+        bool found() const { return end != 0; }
+        uint64_t size() const { return end - begin; }
+    };
+
+    static constexpr int kMaxDepth = 8;
+
+    const uint8_t *base;
+    uint64_t fileSize;
+    uint64_t loaded; // bytes at base, the rest of the file is only bounds checked
+    int trackCount = 0;
+    Range mdat, stsd, stts, stsz, stsc, stco, co64, stss;
+    uint32_t nalLengthSize = 0; // 0 if the codec is unknown, NALs are not checked then
+    MovLayoutStats *stats  = nullptr;
+
+    static constexpr uint32_t fourcc(const char (&s)[5]) {
+        return uint32_t(uint8_t(s[0])) << 24 | uint32_t(uint8_t(s[1])) << 16 | uint32_t(uint8_t(s[2])) << 8 | uint32_t(uint8_t(s[3]));
+    }
+
+    uint32_t load32(uint64_t pos) const {
+        uint32_t v;
+        memcpy(&v, base + pos, 4);
+        return bswap(v);
+    }
+
+    uint64_t load64(uint64_t pos) const {
+        uint64_t v;
+        memcpy(&v, base + pos, 8);
+        return bswap(v);
+    }
+
+    static MovCheckResult fail(MovCheckResult::Error error, const char *message, uint64_t position) {
+        MovCheckResult result;
+        result.error    = error;
+        result.message  = message;
+        result.position = position;
+        return result;
+    }
+
+    /// walks the boxes in [begin, end), their sizes must add up to it
+    MovCheckResult walk(uint64_t begin, uint64_t end, int depth) {
+        for (uint64_t pos = begin; pos < end;) {
+            if (end - pos < 8) {
+                return fail(MovCheckResult::BOX_SIZE, "truncated box header", pos);
+            }
+            if (loaded - std::min(loaded, pos) < 8) {
+                return fail(MovCheckResult::BOX_SIZE, "box header out of the loaded bytes", pos);
+            }
+            uint64_t size   = load32(pos);
+            uint32_t type   = load32(pos + 4);
+            uint64_t header = 8;
+            if (size == 1) {
+                if (end - pos < 16 || loaded - pos < 16) {
+                    return fail(MovCheckResult::BOX_SIZE, "truncated large box header", pos);
+                }
+                size   = load64(pos + 8);
+                header = 16;
+            } else if (size == 0) {
+                size = end - pos;
+            }
+            if (size < header || size > end - pos) {
+                return fail(MovCheckResult::BOX_SIZE, "box size exceeds its parent", pos);
+            }
+            Range payload = { pos + header, pos + size };
+            if (type != fourcc("mdat") && payload.end > loaded) {
+                return fail(MovCheckResult::BOX_SIZE, "box out of the loaded bytes", pos);
+            }
+            switch (type) {
+                case fourcc("trak"):
+                    ++trackCount;
+                    // fall through
+                case fourcc("moov"):
+                    if (depth == 0 && stats) {
+                        stats->moovSize = size;
+                    }
+                    // fall through
+                case fourcc("edts"):
+                case fourcc("mdia"):
+                case fourcc("minf"):
+                case fourcc("dinf"):
+                case fourcc("stbl"):
+                    if (depth < kMaxDepth) {
+                        CheckMovResult(walk(payload.begin, payload.end, depth + 1));
+                    }
+                    break;
+                case fourcc("mdat"):
+                    if (depth == 0 && !mdat.found()) {
+                        mdat = payload;
+                    }
+                    break;
+                case fourcc("stsd"): record(stsd, payload); break;
+                case fourcc("stts"): record(stts, payload); break;
+                case fourcc("stsz"): record(stsz, payload); break;
+                case fourcc("stsc"): record(stsc, payload); break;
+                case fourcc("stco"): record(stco, payload); break;
+                case fourcc("co64"): record(co64, payload); break;
+                case fourcc("stss"): record(stss, payload); break;
+                default:
+                    break;
+            }
+            pos += size;
+        }
+        return {};
+    }
+
+    void record(Range &range, Range payload) {
+        if (trackCount == 1 && !range.found()) {
+            range = payload;
+        }
+    }
+
+    /// table of a full box: version and flags, `skip` bytes, entry count and entries
+    MovCheckResult table(Range box, uint64_t skip, uint64_t entrySize, uint64_t *count, uint64_t *entries) const {
+        if (box.size() < 8 + skip) {
+            return fail(MovCheckResult::TABLE_SIZE, "table header truncated", box.begin);
+        }
+        *count   = load32(box.begin + 4 + skip);
+        *entries = box.begin + 8 + skip;
+        if (*count * entrySize > box.end - *entries) {
+            return fail(MovCheckResult::TABLE_SIZE, "table entries exceed the box", box.begin);
+        }
+        return {};
+    }
+
+    /// length size of the NAL units from avcC or hvcC of the first sample description
+    void findNALLengthSize() {
+        static constexpr uint64_t kVisualSampleEntrySize = 86;
+        if (stsd.size() < 16) {
+            return;
+        }
+        uint64_t entry     = stsd.begin + 8;
+        uint64_t entrySize = load32(entry);
+        if (entrySize < kVisualSampleEntrySize || entrySize > stsd.end - entry) {
+            return;
+        }
+        for (uint64_t pos = entry + kVisualSampleEntrySize, end = entry + entrySize; end - pos >= 8;) {
+            uint64_t size = load32(pos);
+            uint32_t type = load32(pos + 4);
+            if (size < 8 || size > end - pos) {
+                return;
+            }
+            if (type == fourcc("avcC") && size > 12) {
+                nalLengthSize = (base[pos + 12] & 0b11) + 1;
+            } else if (type == fourcc("hvcC") && size > 29) {
+                nalLengthSize = (base[pos + 29] & 0b11) + 1;
+            }
+            pos += size;
+        }
+    }
+
+    MovCheckResult checkNALs(uint64_t pos, uint64_t size) const {
+        uint64_t end = pos + size;
+        while (pos < end) {
+            if (end - pos < nalLengthSize) {
+                return fail(MovCheckResult::NAL_LENGTH, "NAL length prefix truncated", pos);
+            }
+            uint64_t length = 0;
+            for (uint32_t i = 0; i < nalLengthSize; ++i) {
+                length = length << 8 | base[pos + i];
+            }
+            pos += nalLengthSize + length;
+        }
+        if (pos != end) {
+            return fail(MovCheckResult::NAL_LENGTH, "NAL lengths exceed the sample", end);
+        }
+        return {};
+    }
+
+public:
+    MovValidator(const void *file, uint64_t size, MovLayoutStats *stats = nullptr)
+    : base((const uint8_t *)file), fileSize(size), loaded(size), stats(stats) {}
+
+    MovCheckResult validate() {
+        CheckMovResult(walk(0, fileSize, 0));
+        if (!mdat.found() || !stsz.found() || !stsc.found() || !stts.found() || !(stco.found() || co64.found())) {
+            return fail(MovCheckResult::MISSING_BOX, "mdat or a required sample table is missing", 0);
+        }
+        findNALLengthSize();
+        if (mdat.end > loaded) {
+            nalLengthSize = 0; // the samples are not loaded
+        }
+
+        uint64_t sampleCount, sizeEntries, fixedSize;
+        if (stsz.size() < 8) {
+            return fail(MovCheckResult::TABLE_SIZE, "stsz truncated", stsz.begin);
+        }
+        fixedSize = load32(stsz.begin + 4);
+        CheckMovResult(table(stsz, 4, fixedSize ? 0 : 4, &sampleCount, &sizeEntries));
+
+        bool wide = !stco.found();
+        uint64_t chunkCount, offsetEntries;
+        CheckMovResult(table(wide ? co64 : stco, 0, wide ? 8 : 4, &chunkCount, &offsetEntries));
+
+        uint64_t runCount, runEntries;
+        CheckMovResult(table(stsc, 0, 12, &runCount, &runEntries));
+
+        uint64_t timeCount, timeEntries, timedSamples = 0;
+        CheckMovResult(table(stts, 0, 8, &timeCount, &timeEntries));
+        for (uint64_t i = 0; i < timeCount; ++i) {
+            timedSamples += load32(timeEntries + i * 8);
+        }
+        if (timedSamples != sampleCount) {
+            return fail(MovCheckResult::SAMPLE_TIME, "stts sample count differs from stsz", stts.begin);
+        }
+
+        if (stss.found()) {
+            uint64_t syncCount, syncEntries, prev = 0;
+            CheckMovResult(table(stss, 0, 4, &syncCount, &syncEntries));
+            if (sampleCount && (syncCount == 0 || load32(syncEntries) != 1)) {
+                return fail(MovCheckResult::SYNC_SAMPLE, "first sample is not a sync sample", stss.begin);
+            }
+            for (uint64_t i = 0; i < syncCount; ++i) {
+                uint64_t sample = load32(syncEntries + i * 4);
+                if (sample <= prev || sample > sampleCount) {
+                    return fail(MovCheckResult::SYNC_SAMPLE, "sync samples not increasing or out of range", syncEntries + i * 4);
+                }
+                prev = sample;
+            }
+        }
+
+        if (chunkCount && !runCount) {
+            return fail(MovCheckResult::SAMPLE_TO_CHUNK, "chunks without stsc runs", stsc.begin);
+        }
+        uint64_t sample = 0, prevEnd = mdat.begin;
+        for (uint64_t run = 0; run < runCount; ++run) {
+            uint64_t entry          = runEntries + run * 12;
+            uint64_t firstChunk     = load32(entry);
+            uint64_t samplePerChunk = load32(entry + 4);
+            uint64_t endChunk       = run + 1 < runCount ? load32(entry + 12) : chunkCount + 1;
+            if ((run == 0 && firstChunk != 1) || firstChunk > chunkCount || endChunk <= firstChunk || endChunk > chunkCount + 1 || samplePerChunk == 0) {
+                return fail(MovCheckResult::SAMPLE_TO_CHUNK, "stsc run out of order or out of range", entry);
+            }
+            for (uint64_t chunk = firstChunk; chunk < endChunk; ++chunk) {
+                uint64_t pos = wide ? load64(offsetEntries + (chunk - 1) * 8) : load32(offsetEntries + (chunk - 1) * 4);
+                if (pos < prevEnd || pos > mdat.end) {
+                    return fail(MovCheckResult::CHUNK_OFFSET, "chunk offset not increasing or out of mdat", pos);
+                }
+                for (uint64_t i = 0; i < samplePerChunk; ++i, ++sample) {
+                    if (sample >= sampleCount) {
+                        return fail(MovCheckResult::SAMPLE_TO_CHUNK, "stsc runs cover more samples than stsz", entry);
+                    }
+                    uint64_t size = fixedSize ?: load32(sizeEntries + sample * 4);
+                    if (size > mdat.end - pos) {
+                        return fail(MovCheckResult::CHUNK_OFFSET, "sample exceeds mdat", pos);
+                    }
+                    if (nalLengthSize) {
+                        CheckMovResult(checkNALs(pos, size));
+                    }
+                    pos += size;
+                }
+                if (stats && stats->readSize) {
+                    uint64_t chunkStart = wide ? load64(offsetEntries + (chunk - 1) * 8) : load32(offsetEntries + (chunk - 1) * 4);
+                    stats->reads += (pos - chunkStart + stats->readSize - 1) / stats->readSize;
+                }
+                prevEnd = pos;
+            }
+        }
+        if (sample != sampleCount) {
+            return fail(MovCheckResult::SAMPLE_TO_CHUNK, "stsc runs cover less samples than stsz", stsc.begin);
+        }
+        if (stats) {
+            stats->chunkCount = chunkCount;
+            stats->runCount   = runCount;
+        }
+        return {};
+    }
+
+    static MovCheckResult validate(const void *file, uint64_t size, MovLayoutStats *stats = nullptr) {
+        return MovValidator(file, size, stats).validate();
+    }
+
+    /// check a file of size bytes from its first loaded bytes at header, which hold every box but the mdat payload.
+    /// The samples are checked against the mdat bounds without reading them, for outputs written without mapping
+    static MovCheckResult validateHeader(const void *header, uint64_t loaded, uint64_t size, MovLayoutStats *stats = nullptr) {
+        MovValidator validator(header, size, stats);
+        validator.loaded = std::min(loaded, size);
+        return validator.validate();
+    }
+};
+
+#undef CheckMovResult
+
+} // namespace IVT
+#endif
+#endif /* IVTMovValidator_h */
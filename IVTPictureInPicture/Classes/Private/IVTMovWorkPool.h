@@ -0,0 +1,166 @@
+//
+//  IVTMovWorkPool.h
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#ifndef IVTMovWorkPool_h
+#define IVTMovWorkPool_h
+
+#ifdef __cplusplus
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace IVT {
+
+/// A fixed number of threads, each owning a queue.
+/// Workers run their own queue from the back and steal from the front of the others when it is empty,
+/// so a few long jobs don't leave the other threads idle behind them.
+class MovWorkPool {
+public:
+    typedef std::function<void()> Task;
+
+    /// threadInit runs on every worker before its first task, e.g. to set the thread priority
+    explicit MovWorkPool(unsigned threadCount = 0, std::function<void(unsigned worker)> threadInit = nullptr) {
+        if (threadCount == 0) {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (unsigned i = 0; i < threadCount; ++i) {
+            queues.emplace_back(new Queue());
+        }
+        for (unsigned i = 0; i < threadCount; ++i) {
+            threads.emplace_back([this, i, threadInit] {
+                if (threadInit) {
+                    threadInit(i);
+                }
+                run(i);
+            });
+        }
+    }
+
+    MovWorkPool(const MovWorkPool &) = delete;
+    MovWorkPool &operator=(const MovWorkPool &) = delete;
+
+    ~MovWorkPool() {
+        wait();
+        {
+            std::lock_guard<std::mutex> guard(stateLock);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        for (auto &&thread : threads) {
+            thread.join();
+        }
+    }
+
+    unsigned threadCount() const {
+        return (unsigned)threads.size();
+    }
+
+    /// index of the calling worker of this pool, -1 on other threads
+    int currentWorker() const {
+        return current().pool == this ? current().index : -1;
+    }
+
+    /// tasks submitted by a worker go to its own queue, the others are spread round robin
+    void submit(Task task) {
+        int self      = currentWorker();
+        unsigned index = self >= 0 ? (unsigned)self : next++ % (unsigned)queues.size();
+        ++pending;
+        ++queued; // before the push, so a pop never takes it below zero
+        {
+            std::lock_guard<std::mutex> guard(queues[index]->lock);
+            queues[index]->tasks.push_back(std::move(task));
+        }
+        std::lock_guard<std::mutex> guard(stateLock);
+        wakeup.notify_one();
+    }
+
+    /// block until every submitted task has finished, must not be called from a worker
+    void wait() {
+        std::unique_lock<std::mutex> guard(stateLock);
+        idle.wait(guard, [this] { return pending.load() == 0; });
+    }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    struct Current {
+        const MovWorkPool *pool = nullptr;
+        int index               = -1;
+    };
+    static Current &current() {
+        static thread_local Current current;
+        return current;
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+    std::atomic<unsigned> next { 0 };
+    std::atomic<size_t> queued { 0 };  // in the queues
+    std::atomic<size_t> pending { 0 }; // submitted and not finished
+    std::mutex stateLock;
+    std::condition_variable wakeup, idle;
+    bool stopping = false;
+
+    bool pop(unsigned self, Task &task) {
+        {
+            Queue &own = *queues[self];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                --queued;
+                return true;
+            }
+        }
+        for (size_t i = 1, count = queues.size(); i < count; ++i) {
+            Queue &victim = *queues[(self + i) % count];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                --queued;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(unsigned self) {
+        current() = { this, (int)self };
+        for (;;) {
+            Task task;
+            if (pop(self, task)) {
+                task();
+                task = nullptr;
+                if (--pending == 0) {
+                    std::lock_guard<std::mutex> guard(stateLock);
+                    idle.notify_all();
+                }
+                continue;
+            }
+            std::unique_lock<std::mutex> guard(stateLock);
+            wakeup.wait(guard, [this] { return stopping || queued.load() > 0; });
+            if (stopping && queued.load() == 0) {
+                return;
+            }
+        }
+    }
+};
+
+} // namespace IVT
+#endif
+#endif /* IVTMovWorkPool_h */
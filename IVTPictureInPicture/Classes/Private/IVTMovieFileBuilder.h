@@ -21,6 +21,12 @@ enum EncodeQuality {
     HighQuality
 };
 
+enum MovieFillMode {
+    FillByCopy,
+    FillByHold,
+    FillByLoop
+};
+
 //视频帧
 @interface IVTPixelBuffer : NSObject
 @property (nonatomic, assign, direct) CVPixelBufferRef buffer;//buffer
@@ -38,17 +44,45 @@ enum EncodeQuality {
 @property (nonatomic, assign) int maxKeyFrameInterval;//默认为 20
 @property (nonatomic, assign) int copyLastFrameCount;//追加lastKeyFrame的copy帧,默认为 0
 @property (nonatomic, assign) BOOL isFillLast;//是否自动设置copyLastFrameCount以追加满尾部帧,默认为 NO
+@property (nonatomic, assign) enum MovieFillMode fillMode;//追加帧的方式,FillByHold停留在最后一帧,FillByLoop循环最后的GOP,二者只写编辑列表不增加文件体积,默认为 FillByCopy
+@property (nonatomic, copy) NSString *keyFramePath;//非空时另存只含关键帧的视频到该路径,时间与原视频一致,用于快速拖动预览,默认为 nil
+@property (nonatomic, copy) NSString *replayTracePath;//非空时把写入过程记录到该路径,可用Tools/ivt_movreplay回放,默认为 nil
 @end
 
 @interface IVTMovieFileBuilder : NSObject
 @property (nonatomic, readonly, strong) IVTMovieModel *movieModel;
+@property (nonatomic, assign) qos_class_t qos;//生成线程的优先级,在movieFileBuild前设置,默认为 QOS_CLASS_USER_INITIATED
+@property (nonatomic, assign) NSInteger maxConcurrency;//长的帧序列按关键帧切成时间段并发编码后无损拼接,各段参数集不同时退回串行编码,默认为活跃的CPU核数,1为串行
 - (instancetype)initWithMovieModel:(IVTMovieModel *)movieModel;
 - (void)movieFileBuild:(void (^)(NSError *err))completion;
+//把排队或生成中的任务提升到 QOS_CLASS_USER_INITIATED,包括并发编码各段的线程
+- (void)promote;
+@end
+
+//批量生成的统计
+@interface IVTMovieBatchStats : NSObject
+@property (nonatomic, readonly) NSInteger movieCount;
+@property (nonatomic, readonly) NSInteger failedCount;
+@property (nonatomic, readonly) NSInteger frameCount;//编码的帧数
+@property (nonatomic, readonly) unsigned long long bytesWritten;//成功文件的总大小
+@property (nonatomic, readonly) NSTimeInterval elapsed;
+@property (nonatomic, readonly) double framesPerSecond;
+@property (nonatomic, readonly) double bytesPerSecond;
+@end
+
+//在有限的线程上并发生成多个视频,相同尺寸共享缓存的样本
+@interface IVTMovieBatchBuilder : NSObject
+@property (nonatomic, readonly, copy) NSArray<IVTMovieModel *> *movieModels;
+@property (nonatomic, assign) NSInteger maxConcurrency;//并发线程数,默认为活跃的CPU核数
+- (instancetype)initWithMovieModels:(NSArray<IVTMovieModel *> *)movieModels;
+//errors以outputPath为key,只含失败的视频,在主线程回调
+- (void)build:(void (^)(NSDictionary<NSString *, NSError *> *errors, IVTMovieBatchStats *stats))completion;
 @end
 
 @interface IVTMovieSampleCacheCenter : NSObject
 @property (nonatomic) BOOL cacheFileToDisk;
-+ (NSArray<IVTPixelBuffer *> *)createSamplesForSize:(CGSize)size;
+//按尺寸和帧率查找缓存的样本,没有时从磁盘读取或直接生成,并发调用不会互相等待
++ (NSArray<IVTPixelBuffer *> *)createSamplesForSize:(CGSize)size frameRate:(int)frameRate;
 + (void)cacheAsset:(AVAsset *)asset size:(CGSize)size;
 
 @end
@@ -13,6 +13,13 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include "IVTMovFormat.h"
+#include "IVTMovH264Synth.h"
+#include "IVTMovSampleCache.h"
+#include "IVTMovArena.h"
+#include "IVTMovWorkPool.h"
+#include <atomic>
+#include <chrono>
+#include <pthread.h>
 
 static bool sCacheToDisk = YES;
 
@@ -30,8 +37,35 @@ template <typename F>
 IVTMV::FinalAction<F> finally(F f) {
     return IVTMV::FinalAction<F>(f); }
 
-@interface IVTPixelBuffer()
+/// an IDR and the frame following it, repeated to make a placeholder movie
+struct PlaceholderSamples {
+    std::array<CMSampleBufferRef, 2> buffers;
+    bool synthesized; // by MovH264Synth, samples read from an encoded movie replace them
 
+    PlaceholderSamples(std::array<CMSampleBufferRef, 2> buffers, bool synthesized) : buffers(buffers), synthesized(synthesized) {}
+    PlaceholderSamples(const PlaceholderSamples &) = delete;
+
+    ~PlaceholderSamples() {
+        for (auto buffer : buffers) {
+            if (buffer) {
+                CFRelease(buffer);
+            }
+        }
+    }
+
+    size_t bytes() const {
+        size_t total = 0;
+        for (auto buffer : buffers) {
+            total += CMSampleBufferGetTotalSampleSize(buffer);
+        }
+        return total;
+    }
+};
+
+@interface IVTPixelBuffer() {
+@public
+    std::shared_ptr<const PlaceholderSamples> _samples; // keeps sampleBuffer alive after the cache evicted it
+}
 @end
 
 @implementation IVTPixelBuffer
@@ -60,9 +94,224 @@ IVTMV::FinalAction<F> finally(F f) {
 
 @end
 
-static void ensureSampleBufferCache();
+static std::array<CMSampleBufferRef, 2> synthesizeSampleBuffers(CGSize size);
+
+static constexpr int kMinRangeFrames = 120; // shorter ranges don't pay for their compression session
+
+/// the range workers of a build, promote overrides their QoS whether they started before or after it
+struct RangePromotion {
+    std::mutex lock;
+    bool promoted = false;
+    std::vector<pthread_t> workers;
+    std::vector<pthread_override_t> overrides;
+
+    void attach(pthread_t worker) {
+        std::lock_guard<std::mutex> guard(lock);
+        workers.push_back(worker);
+        if (promoted) {
+            overrides.push_back(pthread_override_qos_class_start_np(worker, QOS_CLASS_USER_INITIATED, 0));
+        }
+    }
+
+    /// before the workers exit
+    void detachAll() {
+        std::lock_guard<std::mutex> guard(lock);
+        for (auto override : overrides) {
+            pthread_override_qos_class_end_np(override);
+        }
+        overrides.clear();
+        workers.clear();
+    }
+
+    void promote() {
+        std::lock_guard<std::mutex> guard(lock);
+        if (promoted) {
+            return;
+        }
+        promoted = true;
+        for (auto worker : workers) {
+            overrides.push_back(pthread_override_qos_class_start_np(worker, QOS_CLASS_USER_INITIATED, 0));
+        }
+    }
+};
+
+/// the tables and the memory cache are reserved for plannedDuration seconds, so encoding them doesn't allocate
+static std::shared_ptr<IVT::IMovFile> createMovFile(IVTMovieModel *movieModel, const char *outputPath, double plannedDuration) {
+    auto frameRate = movieModel.frameRate;
+    auto&& file = IVT::IMovFile::create(frameRate, frameRate, movieModel.width, movieModel.height, (IVT::IMovFile::EncodeQuality)movieModel.quality, outputPath, movieModel.maxKeyFrameInterval, true, plannedDuration);
+    file->cacheFileToMemory = true;
+    file->expectedDuration = movieModel.duration;
+    return file;
+}
 
-@interface IVTMovieFileBuilder()
+static int frameCountOf(IVTPixelBuffer *pb) {
+    if (pb.buffer) {
+        return 1;
+    }
+    return pb.sampleBuffer ? (int)CMSampleBufferGetNumSamples(pb.sampleBuffer) : 0;
+}
+
+/// a range can start at pb, the first frame of a range is encoded as a key frame
+static bool startsWithSyncSample(IVTPixelBuffer *pb) {
+    if (pb.buffer) {
+        return true;
+    }
+    CFArrayRef attachments = pb.sampleBuffer ? CMSampleBufferGetSampleAttachmentsArray(pb.sampleBuffer, false) : nullptr;
+    if (!attachments || CFArrayGetCount(attachments) == 0) {
+        return pb.sampleBuffer != nullptr;
+    }
+    auto notSync = (CFBooleanRef)CFDictionaryGetValue((CFDictionaryRef)CFArrayGetValueAtIndex(attachments, 0), kCMSampleAttachmentKey_NotSync);
+    return !notSync || !CFBooleanGetValue(notSync);
+}
+
+/// encode pixelBuffers[begin, end) from frame firstIndex, the timing arrays come from arena,
+/// returns the index after the last frame
+static int encodeEntries(IVT::IMovFile &file, NSArray<IVTPixelBuffer *> *pixelBuffers, NSUInteger begin, NSUInteger end, int firstIndex, int frameRate, IVT::MovArena &arena) {
+    int maxIndex = firstIndex;
+    for (NSUInteger index = begin; index < end; ++index) {
+        IVTPixelBuffer *pb = pixelBuffers[index];
+        if (CVPixelBufferRef buffer = pb.buffer) {
+            file.encodeFrame(buffer, CMTimeMake(maxIndex, frameRate));
+            ++maxIndex;
+        } else if (auto sampleBufferRef = pb.sampleBuffer) {
+            auto sampleCount = CMSampleBufferGetNumSamples(sampleBufferRef);
+            CMSampleTimingInfo *timeInfo = arena.allocate<CMSampleTimingInfo>(sampleCount);
+            CMSampleBufferRef sampleCopy = nil;
+            auto cleaner = finally([&]{
+                CFBridgingRelease(sampleCopy);
+            });
+            for (auto i = 0; i < sampleCount; ++i, ++maxIndex) {
+                timeInfo[i] = CMSampleTimingInfo {
+                    .duration = CMTimeMake(1, frameRate),
+                    .presentationTimeStamp = CMTimeMake(maxIndex, frameRate),
+                    .decodeTimeStamp = kCMTimeInvalid
+                };
+                
+            }
+            CMSampleBufferCreateCopyWithNewTiming(kCFAllocatorDefault, sampleBufferRef, sampleCount, timeInfo, &sampleCopy);
+            file.encodeSample(sampleCopy);
+        } else {
+        }
+    }
+    return maxIndex;
+}
+
+/// encode key frame aligned ranges of pixelBuffers with their own files in parallel and stitch them into file,
+/// the workers start at the QoS of the caller and follow promotion,
+/// returns the number of frames, or -1 if the list is too short to split or the ranges can't be stitched
+static int buildRanges(std::shared_ptr<IVT::IMovFile> file, IVTMovieModel *movieModel, NSArray<IVTPixelBuffer *> *pixelBuffers, unsigned rangeCount, RangePromotion *promotion) {
+    NSUInteger count = pixelBuffers.count;
+    std::vector<int> firstFrames(count + 1);
+    for (NSUInteger i = 0; i < count; ++i) {
+        firstFrames[i + 1] = firstFrames[i] + frameCountOf(pixelBuffers[i]);
+    }
+    int totalFrames = firstFrames[count];
+    rangeCount = std::min(rangeCount, (unsigned)(totalFrames / kMinRangeFrames));
+    struct Range {
+        NSUInteger begin;
+        NSUInteger end;
+        std::shared_ptr<IVT::IMovFile> file;
+        OSStatus error;
+    };
+    std::vector<Range> ranges;
+    NSUInteger begin = 0;
+    for (unsigned r = 1; r < rangeCount; ++r) {
+        int target = (int)((int64_t)totalFrames * r / rangeCount);
+        NSUInteger split = begin + 1;
+        while (split < count && (firstFrames[split] < target || !startsWithSyncSample(pixelBuffers[split]))) {
+            ++split;
+        }
+        if (split >= count) {
+            break;
+        }
+        ranges.push_back({ begin, split, nullptr, 0 });
+        begin = split;
+    }
+    if (ranges.empty()) {
+        return -1;
+    }
+    ranges.push_back({ begin, count, nullptr, 0 });
+
+    auto frameRate = movieModel.frameRate;
+    qos_class_t qos = qos_class_self();
+    {
+        IVT::MovWorkPool pool((unsigned)ranges.size(), [qos, promotion](unsigned) {
+            pthread_set_qos_class_self_np(qos, 0);
+            if (promotion) {
+                promotion->attach(pthread_self());
+            }
+        });
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            Range *range = &ranges[i];
+            // only the first range writes to outputPath, the others stay in memory until they are stitched
+            double rangeDuration = (double)(firstFrames[range->end] - firstFrames[range->begin]) / frameRate;
+            if (i == 0) {
+                file->planCapacity(rangeDuration);
+            }
+            range->file = i == 0 ? file : createMovFile(movieModel, [movieModel.outputPath stringByAppendingFormat:@".range%zu", i].fileSystemRepresentation, rangeDuration);
+            pool.submit([range, pixelBuffers, &firstFrames, frameRate] {
+                @autoreleasepool {
+                    IVT::MovArena arena(4096);
+                    encodeEntries(*range->file, pixelBuffers, range->begin, range->end, firstFrames[range->begin], frameRate, arena);
+                    range->error = range->file->completeFrames();
+                }
+            });
+        }
+        pool.wait();
+        if (promotion) {
+            promotion->detachAll();
+        }
+    }
+    for (auto&& range : ranges) {
+        if (range.error || (range.file != file && file->stitch(*range.file))) {
+            return -1;
+        }
+    }
+    return totalFrames;
+}
+
+/// encode the movie on the calling thread, the timing arrays come from arena,
+/// long frame lists are split into up to rangeCount ranges encoded in parallel,
+/// returns the number of frames encoded
+static int buildMovieFile(IVTMovieModel *movieModel, NSInteger totalFrameCount, NSArray<IVTPixelBuffer *> *pixelBuffers, IVT::MovArena &arena, unsigned rangeCount, RangePromotion *promotion, std::function<void(NSError *error)> completion) {
+    const char *outputPath = [movieModel.outputPath UTF8String];
+    auto frameRate = movieModel.frameRate;
+    auto&& file = createMovFile(movieModel, outputPath, movieModel.duration);
+    NSString *replayTracePath = movieModel.replayTracePath;
+    if (replayTracePath) {
+        file->recordReplay(replayTracePath.fileSystemRepresentation);
+    }
+    pixelBuffers = movieModel.pixelBuffers ?: pixelBuffers ?: [IVTMovieSampleCacheCenter createSamplesForSize:CGSizeMake(movieModel.width, movieModel.height) frameRate:frameRate];
+    // a trace records one muxer, ranges are not traced
+    int maxIndex = rangeCount > 1 && !replayTracePath ? buildRanges(file, movieModel, pixelBuffers, rangeCount, promotion) : -1;
+    if (maxIndex < 0) {
+        if (file->lastEncodedFrameTime != IVT::kMovTickInvalid) {
+            // ranges of different parameter sets, encode them again through one session
+            file = createMovFile(movieModel, outputPath, movieModel.duration);
+        }
+        maxIndex = encodeEntries(*file, pixelBuffers, 0, pixelBuffers.count, 0, frameRate, arena);
+    }
+    if (movieModel.isFillLast) {
+        movieModel.copyLastFrameCount = (int)totalFrameCount - maxIndex - 1;
+    }
+    file->finishConfig.way = IVT::IMovFile::FinishWay::BY_CUSTOM;
+    file->finishConfig.copyLastFrameCount = movieModel.copyLastFrameCount;
+    file->finishConfig.fillMode = (IVT::IMovFile::FillMode)movieModel.fillMode;
+    NSString *keyFramePath = movieModel.keyFramePath;
+    file->finishWriting([file, keyFramePath, completion](NSError *err) {
+        if (!err && keyFramePath) {
+            err = file->exportKeyFrameMovie(keyFramePath.fileSystemRepresentation);
+        }
+        completion(err);
+    });
+    return maxIndex;
+}
+
+@interface IVTMovieFileBuilder() {
+    dispatch_block_t _buildBlock;
+    std::atomic<bool> _promoted;
+    std::shared_ptr<RangePromotion> _rangePromotion;
+}
 @property (nonatomic, strong) IVTMovieModel *movieModel;
 @property (nonatomic, assign) NSInteger totalFrameCount;
 @end
@@ -73,6 +322,8 @@ static void ensureSampleBufferCache();
     if (self = [super init]) {
         _movieModel = movieModel;
         _totalFrameCount = ceil(movieModel.frameRate * movieModel.duration);
+        _qos = QOS_CLASS_USER_INITIATED;
+        _maxConcurrency = NSProcessInfo.processInfo.activeProcessorCount;
     }
     return self;
 }
@@ -82,53 +333,139 @@ static void ensureSampleBufferCache();
         completion([NSError errorWithDomain:@"required argument missed" code:0 userInfo:nil]);
         return ;
     }
-    ensureSampleBufferCache();
+    auto rangePromotion = std::make_shared<RangePromotion>();
+    _rangePromotion = rangePromotion;
+    dispatch_block_t block = dispatch_block_create_with_qos_class((dispatch_block_flags_t)0, _qos, 0, ^{
+        IVT::MovArena arena(4096);
+        buildMovieFile(self.movieModel, self.totalFrameCount, nil, arena, (unsigned)MAX(1, self.maxConcurrency), rangePromotion.get(), [completion](NSError * error) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(error);
+            });
+        });
+    });
+    _buildBlock = block;
+    dispatch_async(dispatch_get_global_queue(_qos, 0), block);
+}
+
+- (void)promote {
+    dispatch_block_t block = _buildBlock;
+    if (!block || _qos >= QOS_CLASS_USER_INITIATED || _promoted.exchange(true)) {
+        return;
+    }
+    // the range workers are threads of their own, the wait below doesn't reach them
+    _rangePromotion->promote();
+    // a waiter of higher QoS raises the QoS of the block whether it is queued or running
     dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
-        const char *outputPath = [self.movieModel.outputPath UTF8String];
-        auto frameRate = self.movieModel.frameRate;
-        auto width = self.movieModel.width;
-        auto height = self.movieModel.height;
-        auto&& file = IVT::IMovFile::create(self.movieModel.frameRate, frameRate, width, height, (IVT::IMovFile::EncodeQuality)self.movieModel.quality, outputPath, self.movieModel.maxKeyFrameInterval, true);
-        file->cacheFileToMemory = true;
-        int maxIndex = 0;
-        auto pixelBuffers = self.movieModel.pixelBuffers ?: [IVTMovieSampleCacheCenter createSamplesForSize:CGSizeMake(width, height)];
-        for (IVTPixelBuffer *pb in pixelBuffers) {
-            if (CVPixelBufferRef buffer = pb.buffer) {
-                file->encodeFrame(buffer, CMTimeMake(maxIndex, frameRate));
-                ++maxIndex;
-            } else if (auto sampleBufferRef = pb.sampleBuffer) {
-                auto sampleCount = CMSampleBufferGetNumSamples(sampleBufferRef);
-                CMSampleTimingInfo *timeInfo = new CMSampleTimingInfo[sampleCount];
-                CMSampleBufferRef sampleCopy = nil;
-                auto cleaner = finally([=]{
-                    CFBridgingRelease(sampleCopy);
-                    delete [] timeInfo;
-                });
-                for (auto i = 0; i < sampleCount; ++i, ++maxIndex) {
-                    timeInfo[i] = CMSampleTimingInfo {
-                        .duration = CMTimeMake(1, frameRate),
-                        .presentationTimeStamp = CMTimeMake(maxIndex, frameRate),
-                        .decodeTimeStamp = kCMTimeInvalid
-                    };
-                    
+        dispatch_block_wait(block, DISPATCH_TIME_FOREVER);
+    });
+}
+
+@end
+
+@interface IVTMovieBatchStats()
+@property (nonatomic, readwrite) NSInteger movieCount;
+@property (nonatomic, readwrite) NSInteger failedCount;
+@property (nonatomic, readwrite) NSInteger frameCount;
+@property (nonatomic, readwrite) unsigned long long bytesWritten;
+@property (nonatomic, readwrite) NSTimeInterval elapsed;
+@end
+
+@implementation IVTMovieBatchStats
+
+- (double)framesPerSecond {
+    return _elapsed > 0 ? _frameCount / _elapsed : 0;
+}
+
+- (double)bytesPerSecond {
+    return _elapsed > 0 ? _bytesWritten / _elapsed : 0;
+}
+
+@end
+
+@implementation IVTMovieBatchBuilder
+
+- (instancetype)initWithMovieModels:(NSArray<IVTMovieModel *> *)movieModels {
+    if (self = [super init]) {
+        _movieModels = [movieModels copy];
+        _maxConcurrency = NSProcessInfo.processInfo.activeProcessorCount;
+    }
+    return self;
+}
+
+- (void)build:(void (^)(NSDictionary<NSString *, NSError *> *errors, IVTMovieBatchStats *stats))completion {
+    NSArray<IVTMovieModel *> *movieModels = self.movieModels;
+    unsigned threadCount = (unsigned)MAX(1, MIN(self.maxConcurrency, (NSInteger)movieModels.count));
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        struct Job {
+            IVTMovieModel *movieModel;
+            NSInteger totalFrameCount;
+            NSArray<IVTPixelBuffer *> *pixelBuffers;
+            NSError *error;
+            int frameCount;
+            off_t fileSize;
+        };
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<Job> jobs(movieModels.count);
+        for (NSUInteger i = 0; i < movieModels.count; ++i) {
+            Job &job = jobs[i];
+            job.movieModel = movieModels[i];
+            job.totalFrameCount = ceil(job.movieModel.frameRate * job.movieModel.duration);
+            if (job.totalFrameCount == 0 || !job.movieModel.outputPath) {
+                job.error = [NSError errorWithDomain:@"required argument missed" code:0 userInfo:nil];
+                continue;
+            }
+            if (!job.movieModel.pixelBuffers) {
+                // jobs of the same size and rate share the cached samples read only
+                CGSize size = CGSizeMake(job.movieModel.width, job.movieModel.height);
+                job.pixelBuffers = [IVTMovieSampleCacheCenter createSamplesForSize:size frameRate:job.movieModel.frameRate];
+            }
+        }
+        {
+            std::vector<IVT::MovArena> arenas;
+            for (unsigned i = 0; i < threadCount; ++i) {
+                arenas.emplace_back(4096);
+            }
+            IVT::MovWorkPool pool(threadCount, [](unsigned) {
+                pthread_set_qos_class_self_np(QOS_CLASS_USER_INITIATED, 0);
+            });
+            for (auto&& job : jobs) {
+                if (job.error) {
+                    continue;
                 }
-                CMSampleBufferCreateCopyWithNewTiming(kCFAllocatorDefault, sampleBufferRef, sampleCount, timeInfo, &sampleCopy);
-                file->encodeSample(sampleCopy);
-            } else {
+                Job *pJob = &job;
+                pool.submit([pJob, &pool, &arenas] {
+                    @autoreleasepool {
+                        IVT::MovArena &arena = arenas[pool.currentWorker()];
+                        arena.reset();
+                        // movies already run in parallel, each is built serially
+                        pJob->frameCount = buildMovieFile(pJob->movieModel, pJob->totalFrameCount, pJob->pixelBuffers, arena, 1, nullptr, [pJob](NSError *error) {
+                            pJob->error = error;
+                        });
+                        struct stat st;
+                        if (!pJob->error && stat(pJob->movieModel.outputPath.UTF8String, &st) == 0) {
+                            pJob->fileSize = st.st_size;
+                        }
+                    }
+                });
             }
+            pool.wait();
         }
-        if (self.movieModel.isFillLast) {
-            self.movieModel.copyLastFrameCount = (int)self.totalFrameCount - maxIndex - 1;
+        IVTMovieBatchStats *stats = [[IVTMovieBatchStats alloc] init];
+        NSMutableDictionary<NSString *, NSError *> *errors = [NSMutableDictionary dictionary];
+        for (auto&& job : jobs) {
+            stats.movieCount += 1;
+            stats.frameCount += job.frameCount;
+            stats.bytesWritten += job.fileSize;
+            if (job.error) {
+                stats.failedCount += 1;
+                errors[job.movieModel.outputPath ?: @""] = job.error;
+            }
         }
-        file->finishConfig.way = IVT::IMovFile::FinishWay::BY_CUSTOM;
-        file->finishConfig.copyLastFrameCount = self.movieModel.copyLastFrameCount;
-        file->finishWriting([completion](NSError * error) {
-            dispatch_async(dispatch_get_main_queue(), ^{
-                completion(error);
-            });
+        stats.elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completion(errors, stats);
         });
     });
-   
 }
 
 @end
@@ -143,29 +480,38 @@ static void ensureSampleBufferCache();
     return sCacheToDisk;
 }
 
-struct CGSizeHash {
-    size_t operator()(CGSize size) const  {
-        return size_t(size.width) + size_t(size.height);
-    }
-};
-struct CGSizeEqual {
-    bool operator()(CGSize size1, CGSize size2) const {
-        return size1.width == size2.width && size1.height == size2.height;
-    }
-};
+static constexpr size_t kSampleCacheBudget = 8 << 20;
 
-typedef std::unordered_map<CGSize, std::array<CMSampleBufferRef, 2>, CGSizeHash, CGSizeEqual> SampleCacheMap;
-
-static SampleCacheMap* sSampleBufferCache;
-static std::mutex sInitLock;
+static IVT::MovSampleCache<PlaceholderSamples> &sampleCache() {
+    static auto cache = new IVT::MovSampleCache<PlaceholderSamples>(kSampleCacheBudget);
+    return *cache;
+}
 
+/// movies built without pixel buffers repeat synthesized samples or samples read back from such movies
+static IVT::MovSampleKey placeholderKey(CGSize size, int frameRate) {
+    IVT::MovSampleKey key;
+    key.width = size.width;
+    key.height = size.height;
+    key.codecType = kCMVideoCodecType_H264;
+    key.profile = IVT::MovH264Synth::kProfileIdc;
+    key.frameRate = frameRate;
+    return key;
+}
 
-static void ensureSampleBufferCache() {
-    if (sSampleBufferCache) {
-        return;
+/// the profile comes from the avcC of the format
+static IVT::MovSampleKey keyForFormat(CGSize size, CMFormatDescriptionRef format, int frameRate) {
+    IVT::MovSampleKey key = placeholderKey(size, frameRate);
+    key.codecType = CMFormatDescriptionGetMediaSubType(format);
+    key.profile = 0;
+    NSDictionary *atoms = (__bridge NSDictionary *)CMFormatDescriptionGetExtension(format, kCMFormatDescriptionExtension_SampleDescriptionExtensionAtoms);
+    id avcC = atoms[@"avcC"];
+    if ([avcC isKindOfClass:NSArray.class]) {
+        avcC = [avcC firstObject];
+    }
+    if ([avcC isKindOfClass:NSData.class] && [avcC length] > 1) {
+        key.profile = ((const uint8_t *)[avcC bytes])[1];
     }
-    std::scoped_lock guard(sInitLock);
-    sSampleBufferCache = new SampleCacheMap;
+    return key;
 }
 
 static NSString * cachePipDir() {
@@ -173,11 +519,11 @@ static NSString * cachePipDir() {
     NSString *pipDir = [libDir stringByAppendingString:@"/picture_in_picture_cache_file"];
     return pipDir;
 }
-static NSString * cachePathForSize(CGSize size) {
+static NSString * cachePathForKey(const IVT::MovSampleKey &key) {
     NSString *pipDir = cachePipDir();
     NSString *movFilePath = [pipDir stringByAppendingString:
-                             [NSString stringWithFormat:@"/pip_%dx%d",
-                              (int)size.width, (int)size.height]];
+                             [NSString stringWithFormat:@"/pip_%dx%d_%08x_%d_%d",
+                              key.width, key.height, key.codecType, key.profile, key.frameRate]];
     return movFilePath;
 }
 
@@ -189,91 +535,82 @@ static NSArray<IVTPixelBuffer *> * createPixelBuffersForSize(CGSize size) {
     return @[pixelBuffer, pixelBuffer];
 }
 
-
-+ (NSArray<IVTPixelBuffer *> *)createSamplesForSize:(CGSize)size {
-    std::scoped_lock guard(sInitLock);
-    auto cache = sSampleBufferCache;
-    
-    if (!cache) {
-        return createPixelBuffersForSize(size);
-    }
-    auto&& iterator = cache->find(size);
-    if (iterator != cache->end()) {
-        auto&& buffers = iterator->second;
-        if (buffers[0] == nullptr) {
-            return createPixelBuffersForSize(size);
-        }
-        auto createBuffer = [&](int index) {
-            IVTPixelBuffer *pixelBuffer = [[IVTPixelBuffer alloc] init];
-            pixelBuffer.sampleBuffer = buffers[index];
-            return pixelBuffer;
-        };
-        return @[createBuffer(0), createBuffer(1)];
-    }
-    if (!sCacheToDisk) {
-        return createPixelBuffersForSize(size);
-    }
-    NSString *path = cachePathForSize(size);
-    if (![NSFileManager.defaultManager fileExistsAtPath:path]) {
-        cache->try_emplace(size);
-        return createPixelBuffersForSize(size);
-    }
-    
-    auto buffers = readSampleBufferFromCache(path, size);
-    if (buffers[0] == nullptr) {
-        return createPixelBuffersForSize(size);
-    }
-    cache->try_emplace(size, buffers);
+static NSArray<IVTPixelBuffer *> * pixelBuffersForSamples(const std::shared_ptr<const PlaceholderSamples> &samples) {
     auto createBuffer = [&](int index) {
         IVTPixelBuffer *pixelBuffer = [[IVTPixelBuffer alloc] init];
-        pixelBuffer.sampleBuffer = buffers[index];
+        pixelBuffer->_samples = samples;
+        pixelBuffer.sampleBuffer = samples->buffers[index];
         return pixelBuffer;
     };
     return @[createBuffer(0), createBuffer(1)];
 }
 
++ (NSArray<IVTPixelBuffer *> *)createSamplesForSize:(CGSize)size frameRate:(int)frameRate {
+    auto key = placeholderKey(size, frameRate);
+    // the disk is read outside of any lock, concurrent starts of the same key wait for one read
+    auto samples = sampleCache().findOrLoad(key, [&](size_t &bytes) -> std::shared_ptr<const PlaceholderSamples> {
+        std::array<CMSampleBufferRef, 2> buffers = {nil, nil};
+        bool synthesized = false;
+        NSString *path = cachePathForKey(key);
+        if (sCacheToDisk && [NSFileManager.defaultManager fileExistsAtPath:path]) {
+            buffers = readSampleBufferFromCache(path, size);
+        }
+        if (buffers[0] == nullptr) {
+            buffers = synthesizeSampleBuffers(size);
+            synthesized = true;
+        }
+        if (buffers[0] == nullptr) {
+            return nullptr;
+        }
+        auto samples = std::make_shared<const PlaceholderSamples>(buffers, synthesized);
+        bytes = samples->bytes();
+        return samples;
+    });
+    return samples ? pixelBuffersForSamples(samples) : createPixelBuffersForSize(size);
+}
+
 + (void)cacheAsset:(AVAsset *)asset size:(CGSize)size {
     if (!asset) {
         return;
     }
-    std::scoped_lock guard(sInitLock);
-    auto&& current = sSampleBufferCache->find(size);
-    if (current != sSampleBufferCache->end() && current->second.at(0) != nullptr) {
-        return;
-    }
-    dispatch_async(dispatch_get_global_queue(0, 0), ^{
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        AVAssetTrack *track = [asset tracksWithMediaType:AVMediaTypeVideo].firstObject;
+        auto format = (__bridge CMFormatDescriptionRef)track.formatDescriptions.firstObject;
+        if (!format) {
+            return;
+        }
+        auto key = keyForFormat(size, format, (int)lroundf(track.nominalFrameRate));
+        auto cached = sampleCache().find(key);
+        if (cached && !cached->synthesized) {
+            return;
+        }
         auto buffers = readSampleBufferFromAsset(asset);
         if (!buffers[0]) {
             return;
         }
-        
-        {
-            std::scoped_lock guard(sInitLock);
-            sSampleBufferCache->insert_or_assign(size, buffers);
-        }
+        auto samples = std::make_shared<const PlaceholderSamples>(buffers, false);
+        sampleCache().insert(key, samples, samples->bytes());
         if (!sCacheToDisk) {
             return;
         }
         if (![NSFileManager.defaultManager fileExistsAtPath:cachePipDir()]) {
             [NSFileManager.defaultManager createDirectoryAtPath:cachePipDir() withIntermediateDirectories:YES attributes:nil error:nil];
         }
-        NSString *path = cachePathForSize(size);
+        NSString *path = cachePathForKey(key);
         if ([NSFileManager.defaultManager isReadableFileAtPath:path]) {
             return;
         }
 
         int bufferLength = 0;
-        for (auto sampleBuffer : buffers) {
+        for (auto sampleBuffer : samples->buffers) {
             CMBlockBufferRef block = CMSampleBufferGetDataBuffer(sampleBuffer);
             bufferLength += CMBlockBufferGetDataLength(block);
         }
-        auto format = CMSampleBufferGetFormatDescription(buffers[0]);
-        
-        NSDictionary * dict = (__bridge NSDictionary *)CMFormatDescriptionGetExtensions(format);
+        NSDictionary * dict = (__bridge NSDictionary *)CMFormatDescriptionGetExtensions(CMSampleBufferGetFormatDescription(samples->buffers[0]));
         NSData * formatData = [NSKeyedArchiver archivedDataWithRootObject:dict];
         auto buffer = std::make_unique<char[]>(bufferLength + 16 + formatData.length);
         int writeLength = 0;
-        for (auto sampleBuffer : buffers) {
+        for (auto sampleBuffer : samples->buffers) {
             CMBlockBufferRef block = CMSampleBufferGetDataBuffer(sampleBuffer);
             size_t length = 0;
             char *dataPointer = nullptr;
@@ -333,7 +670,7 @@ static CMSampleBufferRef createSample(const char * sourceData, size_t size, CMTi
     
     CFMutableDictionaryRef dictionary = (CFMutableDictionaryRef)CFArrayGetValueAtIndex(attachmentArray, 0);
     if (!isSync) {
-        CFDictionarySetValue(dictionary, kCMSampleAttachmentKey_NotSync, kCFBooleanFalse);
+        CFDictionarySetValue(dictionary, kCMSampleAttachmentKey_NotSync, kCFBooleanTrue);
     }
     
     return sample;
@@ -438,4 +775,39 @@ static std::array<CMSampleBufferRef, 2> readSampleBufferFromAsset(AVAsset * asse
     return result;
 }
 
+/// an IDR and a skipped frame from MovH264Synth, enough for a placeholder movie
+static std::array<CMSampleBufferRef, 2> synthesizeSampleBuffers(CGSize size) {
+    std::array<CMSampleBufferRef, 2> result = {nil, nil};
+    int width = size.width, height = size.height;
+    if (width <= 0 || height <= 0 || width % 2 || height % 2) {
+        return result;
+    }
+    IVT::MovH264Synth synth(width, height);
+    auto&& sps = synth.sps();
+    auto&& pps = synth.pps();
+    const uint8_t *parameterSets[] = {sps.data(), pps.data()};
+    size_t parameterSetSizes[] = {sps.size(), pps.size()};
+    CMVideoFormatDescriptionRef videoFormat = NULL;
+    if (CMVideoFormatDescriptionCreateFromH264ParameterSets(NULL, 2, parameterSets, parameterSetSizes, 4, &videoFormat) != noErr) {
+        return result;
+    }
+    auto cleaner = finally([=] {
+        CFBridgingRelease(videoFormat);
+    });
+    auto idr = synth.idrFrame();
+    auto skip = synth.skipFrame(1);
+    result[0] = createSample((const char *)idr.data(), idr.size(), kCMTimeZero, videoFormat, true);
+    result[1] = createSample((const char *)skip.data(), skip.size(), CMTimeMake(1, 60), videoFormat, false);
+    if (!result[0] || !result[1]) {
+        if (result[0]) {
+            CFRelease(result[0]);
+        }
+        if (result[1]) {
+            CFRelease(result[1]);
+        }
+        result = {nil, nil};
+    }
+    return result;
+}
+
 @end
@@ -0,0 +1,23 @@
+//
+//  IVTMoviePrewarmScheduler.h
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+//在后台预先生成小窗的占位视频,相同尺寸和时长的请求共用一个任务,只在主线程调用
+@interface IVTMoviePrewarmScheduler : NSObject
+@property (class, nonatomic, readonly) IVTMoviePrewarmScheduler *sharedScheduler;
+@property (nonatomic, assign) int frameRate;//占位视频的帧率,默认为 10
+//以 QOS_CLASS_BACKGROUND 逐个生成这些小窗尺寸的占位视频和样本缓存,已生成或已在队列中的会跳过
+- (void)prewarmSizes:(NSArray<NSValue *> *)sizes duration:(NSTimeInterval)duration;
+//取得占位视频的路径,队列中的任务立即开始,生成中的任务提升优先级,在主线程回调
+- (void)requestMovieWithSize:(CGSize)size duration:(NSTimeInterval)duration completion:(void (^)(NSString * _Nullable path, NSError * _Nullable error))completion;
+@end
+
+NS_ASSUME_NONNULL_END
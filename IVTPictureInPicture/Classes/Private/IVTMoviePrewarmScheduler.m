@@ -0,0 +1,167 @@
+//
+//  IVTMoviePrewarmScheduler.m
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#import "IVTMoviePrewarmScheduler.h"
+#import "IVTMovieFileBuilder.h"
+#import "IVTPictureInPictureInner.h"
+
+typedef void (^IVTMoviePrewarmCompletion)(NSString *path, NSError *error);
+
+@interface IVTMoviePrewarmJob : NSObject
+@property (nonatomic) CGSize size;
+@property (nonatomic) NSTimeInterval duration;
+@property (nonatomic, copy) NSString *path;
+@property (nonatomic) IVTMovieFileBuilder *builder;//生成中时非空
+@property (nonatomic) NSMutableArray<IVTMoviePrewarmCompletion> *completions;
+@property (nonatomic) BOOL prewarm;//以低优先级开始
+@end
+
+@implementation IVTMoviePrewarmJob
+@end
+
+@interface IVTMoviePrewarmScheduler()
+@property (nonatomic) NSMutableDictionary<NSString *, IVTMoviePrewarmJob *> *jobs;//以path为key,排队和生成中的任务
+@property (nonatomic) NSMutableArray<IVTMoviePrewarmJob *> *pending;//等待低优先级生成的任务
+@property (nonatomic) NSInteger runningPrewarms;
+@end
+
+@implementation IVTMoviePrewarmScheduler
+
++ (IVTMoviePrewarmScheduler *)sharedScheduler {
+    static IVTMoviePrewarmScheduler *scheduler;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        scheduler = [[IVTMoviePrewarmScheduler alloc] init];
+    });
+    return scheduler;
+}
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _frameRate = 10;
+        _jobs = [NSMutableDictionary dictionary];
+        _pending = [NSMutableArray array];
+    }
+    return self;
+}
+
+static NSString *moviePath(CGSize size, NSTimeInterval duration) {
+    NSString *libDir = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) firstObject];
+    NSString *pipDir = [libDir stringByAppendingString:@"/picture_in_picture_mov_file"];
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    if (![fileManager fileExistsAtPath:pipDir]) {
+        [fileManager createDirectoryAtPath:pipDir withIntermediateDirectories:YES attributes:nil error:nil];
+    }
+    return [pipDir stringByAppendingString:
+            [NSString stringWithFormat:@"/pip_%dx%d_%.1f.mov",
+             (int)size.width, (int)size.height, duration]];
+}
+
+- (void)prewarmSizes:(NSArray<NSValue *> *)sizes duration:(NSTimeInterval)duration {
+    assert_main_thread();
+    for (NSValue *value in sizes) {
+        CGSize size = value.CGSizeValue;
+        if (size.width <= 0 || size.height <= 0) {
+            continue;
+        }
+        NSString *path = moviePath(size, duration);
+        if (_jobs[path] || [NSFileManager.defaultManager fileExistsAtPath:path]) {
+            continue;
+        }
+        IVTMoviePrewarmJob *job = [self jobWithSize:size duration:duration path:path];
+        job.prewarm = YES;
+        [_pending addObject:job];
+    }
+    [self startPrewarms];
+}
+
+- (void)requestMovieWithSize:(CGSize)size duration:(NSTimeInterval)duration completion:(IVTMoviePrewarmCompletion)completion {
+    assert_main_thread();
+    NSString *path = moviePath(size, duration);
+    IVTMoviePrewarmJob *job = _jobs[path];
+    if (!job && [NSFileManager.defaultManager fileExistsAtPath:path]) {
+        completion(path, nil);
+        return;
+    }
+    if (!job) {
+        job = [self jobWithSize:size duration:duration path:path];
+    }
+    [job.completions addObject:completion];
+    if (job.builder) {
+        if (job.prewarm) {
+            LOGI("promote prewarm %s", path.lastPathComponent.UTF8String);
+        }
+        [job.builder promote];
+        return;
+    }
+    [_pending removeObject:job];
+    job.prewarm = NO;
+    [self startJob:job];
+}
+
+- (IVTMoviePrewarmJob *)jobWithSize:(CGSize)size duration:(NSTimeInterval)duration path:(NSString *)path {
+    IVTMoviePrewarmJob *job = [[IVTMoviePrewarmJob alloc] init];
+    job.size = size;
+    job.duration = duration;
+    job.path = path;
+    job.completions = [NSMutableArray array];
+    _jobs[path] = job;
+    return job;
+}
+
+/// one prewarm at a time, they only use the time PiP doesn't
+- (void)startPrewarms {
+    while (_runningPrewarms == 0 && _pending.count) {
+        IVTMoviePrewarmJob *job = _pending.firstObject;
+        [_pending removeObjectAtIndex:0];
+        [self startJob:job];
+    }
+}
+
+- (void)startJob:(IVTMoviePrewarmJob *)job {
+    IVTMovieModel *movieModel = [[IVTMovieModel alloc] init];
+    movieModel.frameRate = _frameRate;
+    movieModel.duration = job.duration != 0 ? job.duration + 0.5 : IVTDefaultLiveDuration;
+    movieModel.width = job.size.width;
+    movieModel.height = job.size.height;
+    static int counter = 0;
+    NSString *tmpMovFilePath = [job.path stringByAppendingFormat:@"%d.mov", ++counter];
+    movieModel.outputPath = tmpMovFilePath;
+    movieModel.isFillLast = YES;
+    movieModel.fillMode = FillByLoop;
+    IVTMovieFileBuilder *builder = [[IVTMovieFileBuilder alloc] initWithMovieModel:movieModel];
+    if (job.prewarm) {
+        builder.qos = QOS_CLASS_BACKGROUND;
+        ++_runningPrewarms;
+    }
+    job.builder = builder;
+    [builder movieFileBuild:^(NSError *err) {
+        if (!err) {
+            [NSFileManager.defaultManager moveItemAtPath:tmpMovFilePath toPath:job.path error:&err];
+        }
+        AVAsset *asset = err ? nil : [AVURLAsset URLAssetWithURL:[NSURL fileURLWithPath:job.path] options:nil];
+        [IVTMovieSampleCacheCenter cacheAsset:asset size:job.size];
+        [self finishJob:job error:err];
+    }];
+}
+
+- (void)finishJob:(IVTMoviePrewarmJob *)job error:(NSError *)error {
+    [_jobs removeObjectForKey:job.path];
+    if (job.builder.qos == QOS_CLASS_BACKGROUND) {
+        --_runningPrewarms;
+    }
+    job.builder = nil;
+    if (error && job.completions.count == 0) {
+        LOGError("prewarm movie failed", error);
+    }
+    for (IVTMoviePrewarmCompletion completion in job.completions) {
+        completion(error ? nil : job.path, error);
+    }
+    [self startPrewarms];
+}
+
+@end
@@ -2,7 +2,7 @@
 
 #import "IVTPictureInPictureAVPlayerView.h"
 #import "IVTPictureInPictureInner.h"
-#import "IVTMovieFileBuilder.h"
+#import "IVTMoviePrewarmScheduler.h"
 #import <pthread/pthread.h>
 #import <sys/sysctl.h>
 #import <AVKit/AVKit.h>
@@ -88,44 +88,14 @@ NS_INLINE AVAsset *assetFromPath(NSString *path) {
 }
 
 - (void)createMovieFileWithDuration:(double)duration size:(CGSize)size completion:(void (^)(AVAsset *asset,NSError * _Nullable))completion {
-
-    IVTMovieModel *movieModel = [[IVTMovieModel alloc] init];
-    movieModel.frameRate = 10;
-    movieModel.duration = duration != 0 ? duration + 0.5 : IVTDefaultLiveDuration;
-    movieModel.width = size.width;
-    movieModel.height = size.height;
-    NSString *libDir = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) firstObject];
-    NSString *pipDir = [libDir stringByAppendingString:@"/picture_in_picture_mov_file"];
-    NSFileManager *fileManager = [NSFileManager defaultManager];
-    if (![fileManager fileExistsAtPath:pipDir]) {
-        [fileManager createDirectoryAtPath:pipDir withIntermediateDirectories:YES attributes:nil error:nil];
-    }
-    NSString *movFilePath = [pipDir stringByAppendingString:
-                             [NSString stringWithFormat:@"/pip_%dx%d_%.1f.mov",
-                              movieModel.width, movieModel.height, duration]];
-    
-    if ([NSFileManager.defaultManager fileExistsAtPath:movFilePath]) {
-        _movFilePath = movFilePath;
-        AVAsset *asset = assetFromPath(movFilePath);
-        if (asset) {
-            completion(asset, nil);
-        }
-        return;
-    }
-    static int counter = 0;
-    NSString *tmpMovFilePath = [movFilePath stringByAppendingFormat:@"%d.mov", ++counter];
-    movieModel.outputPath = tmpMovFilePath;
-    movieModel.isFillLast = YES;
-    IVTMovieFileBuilder *movieFileBuilder = [[IVTMovieFileBuilder alloc] initWithMovieModel:movieModel];
-    [movieFileBuilder movieFileBuild:^(NSError *err) {
-        if (!err) {
-            [NSFileManager.defaultManager moveItemAtPath:tmpMovFilePath toPath:movFilePath error:&err];
+    [IVTMoviePrewarmScheduler.sharedScheduler requestMovieWithSize:size duration:duration completion:^(NSString *movFilePath, NSError *err) {
+        if (movFilePath) {
+            self.movFilePath = movFilePath;
         }
         AVAsset *asset = err ? nil : assetFromPath(movFilePath);
         err = asset ? nil : err ?: [NSError errorWithDomain:@IVTPictureInPictureTag code:-1 userInfo:@{
             NSLocalizedDescriptionKey:@"create asset for pip failed"
         }];
-        [IVTMovieSampleCacheCenter cacheAsset:asset size:size];
         !completion ?: completion(asset, err);
     }];
 }
@@ -20,6 +20,9 @@ extern  void(^IVTPictureInPictureLogCallaback)(NSUInteger level,const char *tag,
 
 extern void IVTPictureInPictureLog(int level, const char *format, ...);
 
+///非空时Error级别的日志会把trace写入该路径
+extern NSString * _Nullable IVTPictureInPictureTraceDumpPath;
+
 #define LOGI(format, ...) IVTPictureInPictureLog(1, format, ##__VA_ARGS__)
 #define LOGE(format, ...) IVTPictureInPictureLog(3, format, ##__VA_ARGS__)
 
@@ -5,10 +5,48 @@
 //
 
 #import "IVTPictureInPictureInner.h"
+#import "IVTMovTrace.h"
 #import <sys/sysctl.h>
+#import <stdatomic.h>
 
 void(^IVTPictureInPictureLogCallaback)(NSUInteger level, const char *tag, const char *log);
 
+NSString *IVTPictureInPictureTraceDumpPath;
+
+static const uint64_t kTraceDumpIntervalNs = 5 * NSEC_PER_SEC; // a burst of errors dumps once
+
+/// dump the trace rings on a utility queue, at most once an interval, the rings still hold the spans before the error
+static void dumpTraceOnError(int level) {
+    NSString *path = IVTPictureInPictureTraceDumpPath;
+    if (level < 3 || !path || !IVTMovTraceIsEnabled()) {
+        return;
+    }
+    static _Atomic uint64_t nextDumpTime;
+    uint64_t now = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+    uint64_t next = atomic_load_explicit(&nextDumpTime, memory_order_relaxed);
+    if (now < next || !atomic_compare_exchange_strong(&nextDumpTime, &next, now + kTraceDumpIntervalNs)) {
+        return;
+    }
+    static dispatch_queue_t queue;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        queue = dispatch_queue_create("IVTPictureInPicture.traceDump", dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0));
+    });
+    dispatch_async(queue, ^{
+        int err = IVTMovTraceDump(path.fileSystemRepresentation);
+        __auto_type callback = IVTPictureInPictureLogCallaback;
+        if (callback != nil) {
+            char buffer[1024];
+            if (err) {
+                snprintf(buffer, sizeof(buffer), "trace dump failed:%d", err);
+            } else {
+                snprintf(buffer, sizeof(buffer), "trace dumped to %s", path.fileSystemRepresentation);
+            }
+            callback(1, IVTPictureInPictureTag, buffer);
+        }
+    });
+}
+
 void IVTPictureInPictureLog(int level, const char *format, ...) {
     __auto_type callback = IVTPictureInPictureLogCallaback;
     if (callback != nil) {
@@ -45,6 +83,7 @@ void IVTPictureInPictureLog(int level, const char *format, ...) {
     vsnprintf(buffer + prefixLength, 2047 - prefixLength, format, args);
     va_end(args);
     printf("%s\n", buffer);
+    dumpTraceOnError(level);
 }
 
 ///A10（iphone 7）以下最小16，A10以上最小6
@@ -0,0 +1,72 @@
+//
+//  ivt_movcheck.cpp
+//
+//  Validate movies produced by IVTMovFile, -r <bytes> also prints the moov size and the reads of that size to load the chunks.
+//  c++ -std=c++17 -I IVTPictureInPicture/Classes/Private Tools/ivt_movcheck.cpp -o ivt_movcheck
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#include "IVTMovValidator.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int check(const char *path, uint64_t readSize) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        perror(path);
+        return 2;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || sb.st_size == 0) {
+        fprintf(stderr, "%s: empty or unreadable\n", path);
+        close(fd);
+        return 2;
+    }
+    void *base = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror(path);
+        return 2;
+    }
+    IVT::MovLayoutStats stats;
+    stats.readSize = readSize;
+    auto result    = IVT::MovValidator::validate(base, sb.st_size, &stats);
+    munmap(base, sb.st_size);
+    if (!result) {
+        printf("%s: error %d at %llu: %s\n", path, result.error, (unsigned long long)result.position, result.message);
+        return 1;
+    }
+    if (readSize) {
+        printf("%s: ok, moov %llu bytes, %llu chunks, %llu stsc runs, %llu reads of %llu bytes\n", path, (unsigned long long)stats.moovSize,
+               (unsigned long long)stats.chunkCount, (unsigned long long)stats.runCount, (unsigned long long)stats.reads, (unsigned long long)readSize);
+    } else {
+        printf("%s: ok\n", path);
+    }
+    return 0;
+}
+
+int main(int argc, const char *argv[]) {
+    uint64_t readSize = 0;
+    int first         = 1;
+    if (argc > 2 && strcmp(argv[1], "-r") == 0) {
+        readSize = strtoull(argv[2], nullptr, 0);
+        first    = 3;
+    }
+    if (argc <= first) {
+        fprintf(stderr, "usage: %s [-r readSize] file...\n", argv[0]);
+        return 2;
+    }
+    int ret = 0;
+    for (int i = first; i < argc; ++i) {
+        ret = std::max(ret, check(argv[i], readSize));
+    }
+    return ret;
+}
@@ -0,0 +1,267 @@
+//
+//  ivt_movreplay.cpp
+//
+//  Replay traces recorded by MovMuxer::recordReplay against the muxer with synthetic payloads.
+//  Run a trace with and without -n to compare the append latency percentiles of ingest with preallocated extents and without.
+//  Build with clang, gcc ignores packed on the atoms holding non-POD fields and writes a broken moov.
+//  clang++ -std=c++17 -O2 -I IVTPictureInPicture/Classes/Private Tools/ivt_movreplay.cpp
+//      IVTPictureInPicture/Classes/Private/{IVTMovMuxer,IVTMovIO,IVTMovTrace,IVTMovByteSwap,IVTMovSegmentLog}.cpp -o ivt_movreplay
+//  On Linux add -lpthread, and -luring when liburing is installed, IVTMovIO.cpp builds the io_uring backend once it finds <liburing.h>.
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#include "IVTMovMuxer.h"
+#include "IVTMovReplay.h"
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+using namespace IVT;
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    bool pace       = false;
+    bool memory     = false;
+    bool uring      = false;
+    bool keep       = false;
+    bool preallocate = true;
+    const char *out = "/tmp/ivt_movreplay.mov";
+};
+
+struct Latencies {
+    std::vector<double> samples; // microseconds
+
+    void add(Clock::time_point begin) {
+        samples.push_back(std::chrono::duration<double, std::micro>(Clock::now() - begin).count());
+    }
+
+    double percentile(double p) {
+        if (samples.empty()) {
+            return 0;
+        }
+        size_t index = std::min(samples.size() - 1, (size_t)(p * samples.size()));
+        std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+        return samples[index];
+    }
+
+    void print(const char *name) {
+        if (samples.empty()) {
+            return;
+        }
+        double p50 = percentile(0.5), p90 = percentile(0.9), p99 = percentile(0.99), p999 = percentile(0.999);
+        double max = *std::max_element(samples.begin(), samples.end());
+        printf("  %-8s %8zu ops  p50 %9.1f us  p90 %9.1f us  p99 %9.1f us  p99.9 %9.1f us  max %9.1f us\n", name, samples.size(),
+               p50, p90, p99, p999, max);
+    }
+};
+
+/// length prefixed NAL unit of size bytes, IDR or non-IDR slice
+static void fillPayload(std::vector<uint8_t> &payload, uint32_t size, bool sync) {
+    size = std::max(size, 5u);
+    payload.resize(size);
+    uint32_t length = size - 4;
+    payload[0] = length >> 24;
+    payload[1] = length >> 16;
+    payload[2] = length >> 8;
+    payload[3] = length;
+    payload[4] = sync ? 0x65 : 0x41;
+}
+
+static MovMuxer::SampleFormat syntheticFormat() {
+    static const uint8_t sps[] = { 0x67, 0x42, 0xc0, 0x1e, 0xda, 0x02, 0x80, 0xbf, 0xe5, 0x84 };
+    static const uint8_t pps[] = { 0x68, 0xce, 0x3c, 0x80 };
+    MovMuxer::SampleFormat format;
+    format.codecType = movFourCC("avc1");
+    memcpy(&format.extensionType, "avcC", 4);
+    format.extension = { 1, sps[1], sps[2], sps[3], 0xff, 0xe1, 0, sizeof(sps) };
+    format.extension.insert(format.extension.end(), sps, sps + sizeof(sps));
+    format.extension.insert(format.extension.end(), { 1, 0, sizeof(pps) });
+    format.extension.insert(format.extension.end(), pps, pps + sizeof(pps));
+    format.formatName = "H.264";
+    return format;
+}
+
+/// reads the samples from the key frame like a decoder without a cursor
+static long readForDecode(MovMuxer &muxer, MovTick pts, std::vector<uint8_t> &buffer) {
+    MovSeg *seg = muxer.findMovSeg(pts);
+    if (!seg) {
+        return -1;
+    }
+    int sampleNum = seg->sampleAtFrame(muxer.timeBase.framesForTicks(pts - seg->start));
+    if (sampleNum >= (int)seg->sampleSizes.size()) {
+        return -1;
+    }
+    int keyFrame = seg->keyFrameForSample(sampleNum);
+    if (keyFrame < 0) {
+        return -1;
+    }
+    size_t total = 0;
+    for (int i = keyFrame; i <= sampleNum; ++i) {
+        total += seg->sampleSizes[i];
+    }
+    buffer.resize(total);
+    return seg->read(buffer.data(), total, seg->offsetForSample(keyFrame));
+}
+
+static long peakRSS() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+static int replay(const char *path, const Options &options) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        return 2;
+    }
+    std::unique_ptr<MovMuxer> muxer;
+    std::vector<uint8_t> payload, readBuffer;
+    Latencies ingestLatency, decodeLatency, finishLatency;
+    uint64_t ingestBytes = 0, readBytes = 0;
+    int ingestErrors = 0, decodeMisses = 0;
+    bool finished    = false;
+    double ingestTime = 0;
+    char line[256];
+    const auto start = Clock::now();
+    MovReplayEvent event;
+    int ret = 0;
+    while (fgets(line, sizeof(line), file)) {
+        if (!event.parse(line)) {
+            continue;
+        }
+        if (event.kind == MovReplayEvent::HEADER) {
+            muxer = std::make_unique<MovMuxer>(event.frameRate, event.timeScale, event.width, event.height, options.out, event.maxKeyFrameInterval);
+            muxer->cacheFileToMemory = options.memory;
+            muxer->preallocate       = options.preallocate;
+            if (options.uring) {
+                muxer->io = MovIO::create(MovIO::IO_URING);
+            }
+            continue;
+        }
+        if (!muxer) {
+            fprintf(stderr, "%s: missing header\n", path);
+            ret = 2;
+            break;
+        }
+        if (options.pace) {
+            std::this_thread::sleep_until(start + std::chrono::microseconds(event.time));
+        }
+        auto begin = Clock::now();
+        switch (event.kind) {
+            case MovReplayEvent::SAMPLE: {
+                fillPayload(payload, event.size, event.sync);
+                EncodedSample sample;
+                sample.data = payload.data();
+                sample.size = payload.size();
+                sample.pts  = event.pts;
+                sample.sync = event.sync ? EncodedSample::SYNC : EncodedSample::NOT_SYNC;
+                begin = Clock::now();
+                if (muxer->ingest(sample)) {
+                    ++ingestErrors;
+                } else {
+                    ingestBytes += payload.size();
+                }
+                ingestLatency.add(begin);
+                ingestTime += ingestLatency.samples.back();
+                break;
+            }
+            case MovReplayEvent::DECODE: {
+                long read = readForDecode(*muxer, event.pts, readBuffer);
+                decodeLatency.add(begin);
+                if (read < 0) {
+                    ++decodeMisses;
+                } else {
+                    readBytes += read;
+                }
+                break;
+            }
+            case MovReplayEvent::FINISH: {
+                muxer->finishConfig.way                = MovMuxer::BY_CUSTOM;
+                muxer->finishConfig.copyLastFrameCount = event.copyLastFrameCount;
+                muxer->finishConfig.fillMode           = (MovMuxer::FillMode)event.fillMode;
+                muxer->finishConfig.samplePerChunk     = event.samplePerChunk;
+                muxer->finishConfig.chunkPolicy        = (MovMuxer::ChunkPolicy)event.chunkPolicy;
+                if (event.chunkBytes) {
+                    muxer->finishConfig.chunkBytes = event.chunkBytes;
+                }
+                if (event.chunkDuration > 0) {
+                    muxer->finishConfig.chunkDuration = event.chunkDuration;
+                }
+                auto result = muxer->finish(syntheticFormat());
+                finishLatency.add(begin);
+                if (!result) {
+                    fprintf(stderr, "%s: finish failed %d %s\n", path, result.error, result.message.c_str());
+                    ret = 1;
+                }
+                finished = true;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    fclose(file);
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    struct stat sb = {};
+    if (finished) {
+        stat(options.out, &sb);
+    }
+    printf("%s: %.3f s, preallocation %s\n", path, elapsed, options.preallocate && !options.memory ? "on" : "off");
+    printf("  ingest   %.1f MB/s, %.0f samples/s, %d rejected\n", ingestTime > 0 ? ingestBytes / ingestTime : 0,
+           ingestTime > 0 ? ingestLatency.samples.size() / ingestTime * 1e6 : 0, ingestErrors);
+    ingestLatency.print("ingest");
+    decodeLatency.print("decode");
+    finishLatency.print("finish");
+    printf("  decode   %llu bytes read, %d misses\n", (unsigned long long)readBytes, decodeMisses);
+    printf("  written  %llu bytes to segments, %lld bytes output\n", (unsigned long long)ingestBytes, (long long)sb.st_size);
+    printf("  peak rss %ld KB\n", peakRSS());
+    muxer.reset();
+    if (finished && !options.keep) {
+        unlink(options.out);
+    }
+    return ret;
+}
+
+int main(int argc, const char *argv[]) {
+    Options options;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; ++i) {
+        if (!strcmp(argv[i], "-p")) {
+            options.pace = true;
+        } else if (!strcmp(argv[i], "-m")) {
+            options.memory = true;
+        } else if (!strcmp(argv[i], "-u")) {
+            options.uring = true;
+        } else if (!strcmp(argv[i], "-n")) {
+            options.preallocate = false;
+        } else if (!strcmp(argv[i], "-k")) {
+            options.keep = true;
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            options.out = argv[++i];
+        } else {
+            break;
+        }
+    }
+    if (i >= argc) {
+        fprintf(stderr, "usage: %s [-p pace] [-m segments in memory] [-u io_uring] [-n no preallocation] [-k keep output] [-o output.mov] trace...\n", argv[0]);
+        return 2;
+    }
+    int ret = 0;
+    for (; i < argc; ++i) {
+        ret = std::max(ret, replay(argv[i], options));
+    }
+    return ret;
+}
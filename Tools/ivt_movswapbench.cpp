@@ -0,0 +1,122 @@
+//
+//  ivt_movswapbench.cpp
+//
+//  Compare the element-wise BigEndian conversions the sample tables used before MovByteSwap,
+//  std::copy_n into big-endian entries and the updateOffset load-add-store loop, with the swap32/swap64 and fused add kernels.
+//  Each case checks its output against the scalar path before it is timed, -n <entries> sets the table size.
+//  c++ -std=c++17 -O2 -I IVTPictureInPicture/Classes/Private Tools/ivt_movswapbench.cpp
+//      IVTPictureInPicture/Classes/Private/IVTMovByteSwap.cpp -o ivt_movswapbench
+//
+//  Created by Osl on 2026/10/19.
+//  Copyright © 2026 Gavin. All rights reserved.
+//
+
+#include "IVTMovByteSwap.h"
+#include "IVTMovDataType.h"
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace IVT;
+using Clock = std::chrono::steady_clock;
+
+/// best of the rounds in nanoseconds per entry, the best round is the one least disturbed by the scheduler
+template <class Body>
+static double timeEntries(size_t count, int rounds, Body &&body) {
+    double best = 1e300;
+    for (int round = 0; round < rounds; ++round) {
+        auto begin = Clock::now();
+        body();
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - begin).count();
+        best = std::min(best, ns / count);
+    }
+    return best;
+}
+
+static void report(const char *name, size_t count, size_t entrySize, double scalarNs, double kernelNs) {
+    double bytes = (double)count * entrySize;
+    printf("  %-22s scalar %7.3f ns/entry %7.2f GB/s   %s %7.3f ns/entry %7.2f GB/s   x%.2f\n", name, scalarNs,
+           bytes / (scalarNs * count), MovByteSwap::kernelName(), kernelNs, bytes / (kernelNs * count), scalarNs / kernelNs);
+}
+
+/// stsz/stss/stco tables are built from host order vectors
+template <class T, class BE, class Swap>
+static bool benchBuild(const char *name, size_t count, int rounds, Swap swap) {
+    std::vector<T> host(count);
+    for (size_t i = 0; i < count; ++i) {
+        host[i] = (T)(i * 2654435761u + 17);
+    }
+    std::vector<BE> scalar(count);
+    std::vector<T> swapped(count);
+    std::copy_n(host.begin(), count, scalar.data());
+    swap(swapped.data(), host.data(), count);
+    if (memcmp(scalar.data(), swapped.data(), count * sizeof(T)) != 0) {
+        fprintf(stderr, "%s: kernel output differs from the scalar path\n", name);
+        return false;
+    }
+    double scalarNs = timeEntries(count, rounds, [&] { std::copy_n(host.begin(), count, scalar.data()); });
+    double kernelNs = timeEntries(count, rounds, [&] { swap(swapped.data(), host.data(), count); });
+    report(name, count, sizeof(T), scalarNs, kernelNs);
+    return true;
+}
+
+/// chunk offsets are shifted in place by the header size once the moov is laid out
+template <class T, class BE, class Add>
+static bool benchUpdate(const char *name, size_t count, int rounds, Add add) {
+    std::vector<BE> scalar(count);
+    for (size_t i = 0; i < count; ++i) {
+        scalar[i] = (T)(i * 40503u);
+    }
+    std::vector<T> fused(count);
+    memcpy(fused.data(), scalar.data(), count * sizeof(T));
+    const T offset = 4096;
+    for (auto &entry : scalar) {
+        entry = entry + offset;
+    }
+    add(fused.data(), fused.data(), count, offset);
+    if (memcmp(scalar.data(), fused.data(), count * sizeof(T)) != 0) {
+        fprintf(stderr, "%s: kernel output differs from the scalar path\n", name);
+        return false;
+    }
+    // each round shifts the table once more, the offset is small enough not to wrap within the rounds
+    double scalarNs = timeEntries(count, rounds, [&] {
+        for (size_t i = count; i--;) {
+            auto addr = scalar.data() + i;
+            *addr = *addr + offset;
+        }
+    });
+    double kernelNs = timeEntries(count, rounds, [&] { add(fused.data(), fused.data(), count, offset); });
+    report(name, count, sizeof(T), scalarNs, kernelNs);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    std::vector<size_t> counts = { 1024, 16384, 262144, 4194304 };
+    int rounds = 20;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            counts = { (size_t)strtoull(argv[++i], nullptr, 10) };
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            rounds = std::max(1, atoi(argv[++i]));
+        } else {
+            fprintf(stderr, "usage: %s [-n entries] [-r rounds]\n", argv[0]);
+            return 2;
+        }
+    }
+    printf("kernel %s, best of %d rounds\n", MovByteSwap::kernelName(), rounds);
+    bool ok = true;
+    for (size_t count : counts) {
+        if (count == 0) {
+            continue;
+        }
+        printf("%zu entries\n", count);
+        ok &= benchBuild<uint32_t, buint32_t>("copy_n / swap32", count, rounds, MovByteSwap::swap32);
+        ok &= benchBuild<uint64_t, buint64_t>("copy_n / swap64", count, rounds, MovByteSwap::swap64);
+        ok &= benchUpdate<uint32_t, buint32_t>("updateOffset / add32", count, rounds, MovByteSwap::addBigEndian32);
+        ok &= benchUpdate<uint64_t, buint64_t>("updateOffset / add64", count, rounds, MovByteSwap::addBigEndian64);
+    }
+    return ok ? 0 : 1;
+}